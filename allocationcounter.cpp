@@ -0,0 +1,86 @@
+#include "allocationcounter.h"
+
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+
+uint64_t ThreadAllocationCount()
+{
+    return allocations;
+}
+
+void *operator new(
+    size_t size)
+{
+    allocations++;
+
+    if (auto p = std::malloc(size > 0 ? size : 1))
+    {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](
+    size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(
+    size_t size,
+    const std::nothrow_t &) noexcept
+{
+    allocations++;
+
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](
+    size_t size,
+    const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(
+    void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](
+    void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(
+    void *p,
+    size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](
+    void *p,
+    size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(
+    void *p,
+    const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](
+    void *p,
+    const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
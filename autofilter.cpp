@@ -0,0 +1,271 @@
+#include "autofilter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cellnumber.h>
+#include <cstring>
+#include <fmt/format.h>
+#include <sqlitelib.h>
+
+static std::string Trim(
+    const std::string &str)
+{
+    auto begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+
+    auto end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+static std::string ToLower(
+    std::string str)
+{
+    for (auto &c : str)
+    {
+        c = char(std::tolower((unsigned char)c));
+    }
+
+    return str;
+}
+
+bool ColumnPredicate::Parse(
+    const std::string &input,
+    ColumnPredicate &out)
+{
+    static const std::pair<const char *, Operator> operators[] = {
+        {"<>", NotEqual},
+        {"!=", NotEqual},
+        {">=", GreaterOrEqual},
+        {"<=", LessOrEqual},
+        {">", Greater},
+        {"<", Less},
+        {"=", Equal},
+    };
+
+    auto str = Trim(input);
+    out.op = Equal;
+
+    for (auto const &op : operators)
+    {
+        auto len = strlen(op.first);
+        if (str.compare(0, len, op.first) == 0)
+        {
+            out.op = op.second;
+            str = Trim(str.substr(len));
+            break;
+        }
+    }
+
+    if (str.empty())
+    {
+        return false;
+    }
+
+    out.numeric = ParseCellNumber(str, out.number);
+    out.text = ToLower(str);
+
+    return true;
+}
+
+std::string ColumnPredicate::ToString() const
+{
+    static const char *names[] = {"=", "<>", "<", "<=", ">", ">="};
+
+    return fmt::format("{} {}", names[op], text);
+}
+
+void ColumnIndex::Build(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    int col)
+{
+    _numbers.clear();
+    _texts.clear();
+
+    for (auto const &cell : db.execute_cursor<int, std::string>("SELECT row, tmp_value FROM cells WHERE sheet = ? AND col = ?", sheet, col))
+    {
+        auto const &value = std::get<1>(cell);
+
+        double number;
+        if (ParseCellNumber(value, number))
+        {
+            _numbers.emplace_back(number, std::get<0>(cell));
+        }
+        else if (!value.empty())
+        {
+            _texts.emplace_back(ToLower(value), std::get<0>(cell));
+        }
+    }
+
+    std::sort(_numbers.begin(), _numbers.end());
+    std::sort(_texts.begin(), _texts.end());
+}
+
+template <typename TEntries, typename TValue>
+static void EvaluateRun(
+    const TEntries &entries,
+    ColumnPredicate::Operator op,
+    const TValue &value,
+    RowBitmap &out)
+{
+    auto lower = std::lower_bound(
+        entries.begin(),
+        entries.end(),
+        value,
+        [](const typename TEntries::value_type &entry, const TValue &v) { return entry.first < v; });
+
+    auto upper = std::upper_bound(
+        lower,
+        entries.end(),
+        value,
+        [](const TValue &v, const typename TEntries::value_type &entry) { return v < entry.first; });
+
+    auto from = entries.begin(), to = entries.end();
+    switch (op)
+    {
+        case ColumnPredicate::Equal:
+        case ColumnPredicate::NotEqual:
+            from = lower, to = upper;
+            break;
+        case ColumnPredicate::Less:
+            to = lower;
+            break;
+        case ColumnPredicate::LessOrEqual:
+            to = upper;
+            break;
+        case ColumnPredicate::Greater:
+            from = upper;
+            break;
+        case ColumnPredicate::GreaterOrEqual:
+            from = lower;
+            break;
+    }
+
+    for (auto it = from; it != to; ++it)
+    {
+        if (it->second < out.Size())
+        {
+            out.Set(it->second);
+        }
+    }
+}
+
+void ColumnIndex::Evaluate(
+    const ColumnPredicate &predicate,
+    RowBitmap &out) const
+{
+    if (predicate.numeric)
+    {
+        EvaluateRun(_numbers, predicate.op, predicate.number, out);
+    }
+    else
+    {
+        EvaluateRun(_texts, predicate.op, predicate.text, out);
+    }
+
+    // Not equal keeps everything else, including empty cells
+    if (predicate.op == ColumnPredicate::NotEqual)
+    {
+        out.Invert();
+    }
+}
+
+size_t ColumnIndex::MemoryUsage() const
+{
+    auto size = _numbers.capacity() * sizeof(_numbers[0]) + _texts.capacity() * sizeof(_texts[0]);
+
+    for (auto const &entry : _texts)
+    {
+        if (entry.first.capacity() > sizeof(std::string))
+        {
+            size += entry.first.capacity();
+        }
+    }
+
+    return size;
+}
+
+void AutoFilter::SetPredicate(
+    int col,
+    const ColumnPredicate &predicate)
+{
+    _predicates[col] = predicate;
+}
+
+void AutoFilter::ClearPredicate(
+    int col)
+{
+    _predicates.erase(col);
+}
+
+void AutoFilter::ClearPredicates()
+{
+    _predicates.clear();
+}
+
+bool AutoFilter::HasPredicate(
+    int col) const
+{
+    return _predicates.count(col) > 0;
+}
+
+bool AutoFilter::IsEmpty() const
+{
+    return _predicates.empty();
+}
+
+const std::map<int, ColumnPredicate> &AutoFilter::Predicates() const
+{
+    return _predicates;
+}
+
+RowBitmap AutoFilter::Evaluate(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    int rowCount)
+{
+    RowBitmap result(rowCount, true);
+
+    for (auto const &predicate : _predicates)
+    {
+        auto index = _indexes.find(predicate.first);
+        if (index == _indexes.end())
+        {
+            index = _indexes.emplace(predicate.first, ColumnIndex()).first;
+            index->second.Build(db, sheet, predicate.first);
+        }
+
+        RowBitmap matches(rowCount);
+        index->second.Evaluate(predicate.second, matches);
+        result.And(matches);
+    }
+
+    result.Seal();
+
+    return result;
+}
+
+void AutoFilter::InvalidateIndex(
+    int col)
+{
+    _indexes.erase(col);
+}
+
+void AutoFilter::InvalidateIndexes()
+{
+    _indexes.clear();
+}
+
+size_t AutoFilter::MemoryUsage() const
+{
+    size_t size = 0;
+    for (auto const &index : _indexes)
+    {
+        size += index.second.MemoryUsage();
+    }
+
+    return size;
+}
@@ -0,0 +1,207 @@
+#include "blockcodec.h"
+
+#include <cstdint>
+#include <cstring>
+
+static const size_t MinMatch = 4;
+static const size_t MaxOffset = 65535;
+static const int HashBits = 12;
+
+// The end of a block is always literals, so the decompressor never reads a
+// reference past its input
+static const size_t LastLiterals = 5;
+
+static uint32_t Read32(
+    const char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(
+    uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+static void PutLength(
+    std::vector<char> &out,
+    size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(char(255));
+        length -= 255;
+    }
+    out.push_back(char(length));
+}
+
+static void PutSequence(
+    std::vector<char> &out,
+    const char *literals,
+    size_t literalCount,
+    size_t offset,
+    size_t matchLength)
+{
+    auto matchCode = matchLength >= MinMatch ? matchLength - MinMatch : 0;
+    out.push_back(char(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+
+    if (literalCount >= 15)
+    {
+        PutLength(out, literalCount - 15);
+    }
+    out.insert(out.end(), literals, literals + literalCount);
+
+    if (matchLength == 0)
+    {
+        return;
+    }
+
+    out.push_back(char(offset & 0xFF));
+    out.push_back(char(offset >> 8));
+
+    if (matchCode >= 15)
+    {
+        PutLength(out, matchCode - 15);
+    }
+}
+
+void BlockCompress(
+    const char *data,
+    size_t size,
+    std::vector<char> &out)
+{
+    out.clear();
+    out.reserve(size / 2 + 16);
+
+    // Positions plus one, zero is empty
+    uint32_t table[1 << HashBits] = {};
+
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    if (size > MinMatch + LastLiterals)
+    {
+        auto limit = size - LastLiterals;
+
+        while (pos + MinMatch <= limit)
+        {
+            auto sequence = Read32(data + pos);
+            auto hash = Hash(sequence);
+            auto candidate = size_t(table[hash]);
+            table[hash] = uint32_t(pos + 1);
+
+            if (candidate == 0 || pos - (candidate - 1) > MaxOffset || Read32(data + candidate - 1) != sequence)
+            {
+                pos++;
+                continue;
+            }
+
+            auto match = candidate - 1;
+            auto length = MinMatch;
+            while (pos + length < limit && data[match + length] == data[pos + length])
+            {
+                length++;
+            }
+
+            PutSequence(out, data + anchor, pos - anchor, pos - match, length);
+
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    PutSequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+static bool GetLength(
+    const uint8_t *&in,
+    const uint8_t *end,
+    size_t &length)
+{
+    uint8_t byte;
+    do
+    {
+        if (in == end)
+        {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+bool BlockDecompress(
+    const char *data,
+    size_t size,
+    char *out,
+    size_t outSize)
+{
+    auto in = reinterpret_cast<const uint8_t *>(data);
+    auto end = in + size;
+    size_t written = 0;
+
+    while (in < end)
+    {
+        auto token = *in++;
+
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !GetLength(in, end, literalCount))
+        {
+            return false;
+        }
+
+        if (literalCount > size_t(end - in) || literalCount > outSize - written)
+        {
+            return false;
+        }
+        memcpy(out + written, in, literalCount);
+        in += literalCount;
+        written += literalCount;
+
+        // The last sequence has literals only
+        if (in == end)
+        {
+            break;
+        }
+
+        if (end - in < 2)
+        {
+            return false;
+        }
+        size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+        in += 2;
+
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !GetLength(in, end, matchLength))
+        {
+            return false;
+        }
+        matchLength += MinMatch;
+
+        if (offset == 0 || offset > written || matchLength > outSize - written)
+        {
+            return false;
+        }
+
+        // A reference overlapping what it produces repeats it, byte by byte
+        auto from = out + written - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(out + written, from, matchLength);
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; i++)
+            {
+                out[written + i] = from[i];
+            }
+        }
+        written += matchLength;
+    }
+
+    return written == outSize;
+}
@@ -0,0 +1,24 @@
+#include "cellnumber.h"
+
+#include <cmath>
+#include <cstdlib>
+
+bool ParseCellNumber(
+    const std::string &value,
+    double &out)
+{
+    if (value.empty())
+    {
+        return false;
+    }
+
+    char *end = nullptr;
+    auto number = std::strtod(value.c_str(), &end);
+    if (end == value.c_str() || *end != '\0' || !std::isfinite(number))
+    {
+        return false;
+    }
+
+    out = number;
+    return true;
+}
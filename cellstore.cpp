@@ -0,0 +1,611 @@
+#include "cellstore.h"
+
+#include <algorithm>
+#include <blockcodec.h>
+#include <chrono>
+#include <cstring>
+#include <sqlitelib.h>
+
+static bool EntryBefore(
+    const CellChunk::Entry &entry,
+    uint16_t offset)
+{
+    return entry.offset < offset;
+}
+
+CellChunk::CellChunk(
+    const CellChunk &other)
+    : version(other.version),
+      entries(other.entries),
+      packed(other.packed),
+      packedEntries(other.packedEntries),
+      unpackedSize(other.unpackedSize),
+      bytes(other.bytes)
+{}
+
+bool CellChunk::IsPacked() const
+{
+    return packedEntries > 0;
+}
+
+size_t CellChunk::MeasureBytes() const
+{
+    static const auto inlineCapacity = std::string().capacity();
+
+    auto size = sizeof(CellChunk) + entries.capacity() * sizeof(Entry) + packed.capacity();
+    for (auto const &entry : entries)
+    {
+        if (entry.value.capacity() > inlineCapacity)
+        {
+            size += entry.value.capacity() + 1;
+        }
+    }
+
+    return size;
+}
+
+// Entries as offset and length (both little endian) and the value bytes,
+// then block compressed
+static std::shared_ptr<CellChunk> PackChunk(
+    const CellChunk &chunk)
+{
+    std::vector<char> raw;
+    for (auto const &entry : chunk.entries)
+    {
+        auto length = uint32_t(entry.value.size());
+        char header[6] = {
+            char(entry.offset & 0xFF), char(entry.offset >> 8),
+            char(length & 0xFF), char((length >> 8) & 0xFF), char((length >> 16) & 0xFF), char(length >> 24)};
+        raw.insert(raw.end(), header, header + sizeof(header));
+        raw.insert(raw.end(), entry.value.begin(), entry.value.end());
+    }
+
+    auto packed = std::make_shared<CellChunk>();
+    packed->version = chunk.version;
+    BlockCompress(raw.data(), raw.size(), packed->packed);
+    packed->packed.shrink_to_fit();
+    packed->packedEntries = uint32_t(chunk.entries.size());
+    packed->unpackedSize = uint32_t(raw.size());
+    packed->bytes = packed->MeasureBytes();
+
+    return packed;
+}
+
+static std::shared_ptr<CellChunk> UnpackChunk(
+    const CellChunk &chunk)
+{
+    auto unpacked = std::make_shared<CellChunk>();
+    unpacked->version = chunk.version;
+
+    std::vector<char> raw(chunk.unpackedSize);
+    if (BlockDecompress(chunk.packed.data(), chunk.packed.size(), raw.data(), raw.size()))
+    {
+        auto data = reinterpret_cast<const uint8_t *>(raw.data());
+        size_t pos = 0;
+
+        unpacked->entries.reserve(chunk.packedEntries);
+        while (pos + 6 <= raw.size())
+        {
+            auto offset = uint16_t(data[pos] | (data[pos + 1] << 8));
+            auto length = uint32_t(data[pos + 2]) | (uint32_t(data[pos + 3]) << 8) | (uint32_t(data[pos + 4]) << 16) | (uint32_t(data[pos + 5]) << 24);
+            pos += 6;
+
+            length = uint32_t(std::min<size_t>(length, raw.size() - pos));
+            unpacked->entries.push_back(CellChunk::Entry{offset, std::string(raw.data() + pos, length)});
+            pos += length;
+        }
+    }
+
+    unpacked->bytes = unpacked->MeasureBytes();
+
+    return unpacked;
+}
+
+CellSnapshot::CellSnapshot()
+    : _unpacked(std::make_shared<UnpackedChunks>())
+{
+    static const auto empty = std::make_shared<const CellTable>();
+
+    _table = empty;
+}
+
+uint64_t CellSnapshot::Version() const
+{
+    return _table->version;
+}
+
+const CellChunk *CellSnapshot::Chunk(
+    int chunkCol,
+    int chunkRow) const
+{
+    if (chunkRow < 0 || size_t(chunkRow) >= _table->bands.size() || _table->bands[chunkRow] == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto const &chunks = _table->bands[chunkRow]->chunks;
+    if (chunkCol < 0 || size_t(chunkCol) >= chunks.size() || chunks[chunkCol] == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto chunk = chunks[chunkCol].get();
+
+    // Only written when it changes, so reading a chunk over and over does
+    // not write to its cache line
+    if (_table->store != nullptr)
+    {
+        auto epoch = _table->store->_epoch.load(std::memory_order_relaxed);
+        if (chunk->touched.load(std::memory_order_relaxed) != epoch)
+        {
+            chunk->touched.store(epoch, std::memory_order_relaxed);
+        }
+    }
+
+    return chunk->IsPacked() ? Unpacked(*chunk) : chunk;
+}
+
+const CellChunk *CellSnapshot::Unpacked(
+    const CellChunk &chunk) const
+{
+    std::lock_guard<std::mutex> lock(_unpacked->mutex);
+
+    auto &unpacked = _unpacked->chunks[&chunk];
+    if (unpacked == nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unpacked = UnpackChunk(chunk);
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        if (_table->store != nullptr)
+        {
+            _table->store->_unpacks++;
+            _table->store->_unpackNanoseconds += uint64_t(elapsed.count());
+        }
+    }
+
+    return unpacked.get();
+}
+
+const std::string *CellSnapshot::Find(
+    int col,
+    int row) const
+{
+    if (col < 0 || row < 0)
+    {
+        return nullptr;
+    }
+
+    auto chunk = Chunk(col / CellStore::ChunkCols, row / CellStore::ChunkRows);
+    if (chunk == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto offset = uint16_t((row % CellStore::ChunkRows) * CellStore::ChunkCols + col % CellStore::ChunkCols);
+    auto found = std::lower_bound(chunk->entries.begin(), chunk->entries.end(), offset, EntryBefore);
+    if (found == chunk->entries.end() || found->offset != offset)
+    {
+        return nullptr;
+    }
+
+    return &found->value;
+}
+
+uint64_t CellSnapshot::ChunkVersion(
+    int col,
+    int row) const
+{
+    if (col < 0 || row < 0)
+    {
+        return 0;
+    }
+
+    auto chunk = Chunk(col / CellStore::ChunkCols, row / CellStore::ChunkRows);
+
+    return chunk != nullptr ? chunk->version : 0;
+}
+
+void CellSnapshot::ForEach(
+    int fromCol,
+    int fromRow,
+    int toCol,
+    int toRow,
+    const std::function<void(int col, int row, const std::string &value)> &callback) const
+{
+    fromCol = std::max(0, fromCol);
+    fromRow = std::max(0, fromRow);
+    if (toCol < fromCol || toRow < fromRow)
+    {
+        return;
+    }
+
+    for (int chunkRow = fromRow / CellStore::ChunkRows; chunkRow <= toRow / CellStore::ChunkRows; chunkRow++)
+    {
+        if (size_t(chunkRow) >= _table->bands.size())
+        {
+            break;
+        }
+
+        auto baseRow = chunkRow * CellStore::ChunkRows;
+        auto firstRow = std::max(fromRow, baseRow) - baseRow;
+        auto lastRow = std::min(toRow, baseRow + CellStore::ChunkRows - 1) - baseRow;
+
+        // Entries are sorted by row first, so each chunk is entered at the
+        // first row of the range
+        for (int row = firstRow; row <= lastRow; row++)
+        {
+            for (int chunkCol = fromCol / CellStore::ChunkCols; chunkCol <= toCol / CellStore::ChunkCols; chunkCol++)
+            {
+                auto chunk = Chunk(chunkCol, chunkRow);
+                if (chunk == nullptr)
+                {
+                    continue;
+                }
+
+                auto baseCol = chunkCol * CellStore::ChunkCols;
+                auto firstCol = std::max(fromCol, baseCol) - baseCol;
+                auto lastCol = std::min(toCol, baseCol + CellStore::ChunkCols - 1) - baseCol;
+
+                auto from = uint16_t(row * CellStore::ChunkCols + firstCol);
+                auto to = uint16_t(row * CellStore::ChunkCols + lastCol);
+
+                for (auto it = std::lower_bound(chunk->entries.begin(), chunk->entries.end(), from, EntryBefore); it != chunk->entries.end() && it->offset <= to; ++it)
+                {
+                    callback(baseCol + it->offset % CellStore::ChunkCols, baseRow + row, it->value);
+                }
+            }
+        }
+    }
+}
+
+CellTransaction::CellTransaction(
+    CellStore &store)
+    : _store(&store),
+      _lock(store._writeMutex),
+      _cleared(false)
+{
+    std::lock_guard<std::mutex> lock(store._mutex);
+    _base = store._current;
+}
+
+void CellTransaction::Clear()
+{
+    _dirty.clear();
+    _cleared = true;
+}
+
+void CellTransaction::Set(
+    int col,
+    int row,
+    const std::string &value)
+{
+    if (col < 0 || row < 0)
+    {
+        return;
+    }
+
+    auto key = ChunkKey(row / CellStore::ChunkRows, col / CellStore::ChunkCols);
+
+    auto found = _dirty.find(key);
+    if (found == _dirty.end())
+    {
+        // First write to the chunk in this transaction, copy it
+        std::shared_ptr<CellChunk> chunk;
+        const CellChunk *base = nullptr;
+
+        if (!_cleared && size_t(key.first) < _base->bands.size() && _base->bands[key.first] != nullptr)
+        {
+            auto const &chunks = _base->bands[key.first]->chunks;
+            if (size_t(key.second) < chunks.size())
+            {
+                base = chunks[key.second].get();
+            }
+        }
+
+        if (base == nullptr)
+        {
+            chunk = std::make_shared<CellChunk>();
+        }
+        else
+        {
+            chunk = base->IsPacked() ? UnpackChunk(*base) : std::make_shared<CellChunk>(*base);
+        }
+        found = _dirty.emplace(key, chunk).first;
+    }
+
+    auto &entries = found->second->entries;
+    auto offset = uint16_t((row % CellStore::ChunkRows) * CellStore::ChunkCols + col % CellStore::ChunkCols);
+    auto it = std::lower_bound(entries.begin(), entries.end(), offset, EntryBefore);
+    auto exists = it != entries.end() && it->offset == offset;
+
+    if (value.empty())
+    {
+        if (exists)
+        {
+            entries.erase(it);
+        }
+    }
+    else if (exists)
+    {
+        it->value = value;
+    }
+    else
+    {
+        entries.insert(it, CellChunk::Entry{offset, value});
+    }
+}
+
+uint64_t CellTransaction::Commit()
+{
+    auto table = std::make_shared<CellTable>();
+    table->version = _base->version + 1;
+    table->store = _store;
+
+    // Written chunks count as read now, so the next Compact does not pack them
+    auto epoch = _store->_epoch.load();
+
+    if (!_cleared)
+    {
+        table->bands = _base->bands;
+    }
+
+    // Dirty chunks are ordered by band, so every changed band is copied once
+    std::shared_ptr<CellBand> band;
+    int bandIndex = -1;
+
+    for (auto &dirty : _dirty)
+    {
+        auto chunkRow = dirty.first.first;
+        auto chunkCol = dirty.first.second;
+
+        if (chunkRow != bandIndex)
+        {
+            if (size_t(chunkRow) >= table->bands.size())
+            {
+                table->bands.resize(chunkRow + 1);
+            }
+
+            auto const &previous = table->bands[chunkRow];
+            band = previous != nullptr ? std::make_shared<CellBand>(*previous) : std::make_shared<CellBand>();
+            table->bands[chunkRow] = band;
+            bandIndex = chunkRow;
+        }
+
+        if (size_t(chunkCol) >= band->chunks.size())
+        {
+            band->chunks.resize(chunkCol + 1);
+        }
+
+        if (dirty.second->entries.empty())
+        {
+            band->chunks[chunkCol] = nullptr;
+        }
+        else
+        {
+            dirty.second->version = table->version;
+            dirty.second->bytes = dirty.second->MeasureBytes();
+            dirty.second->touched = epoch;
+            band->chunks[chunkCol] = dirty.second;
+        }
+    }
+
+    _dirty.clear();
+    _store->Publish(table);
+    _lock.unlock();
+
+    return table->version;
+}
+
+CellStore::CellStore()
+    : _memoryBudget(0),
+      _epoch(1),
+      _unpacks(0),
+      _unpackNanoseconds(0)
+{
+    auto table = std::make_shared<CellTable>();
+    table->store = this;
+    _current = table;
+}
+
+CellSnapshot CellStore::Snapshot() const
+{
+    CellSnapshot snapshot;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    snapshot._table = _current;
+
+    return snapshot;
+}
+
+CellTransaction CellStore::Begin()
+{
+    return CellTransaction(*this);
+}
+
+void CellStore::Publish(
+    std::shared_ptr<const CellTable> table)
+{
+    // The previous version is freed outside the lock, or by the last reader
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::swap(_current, table);
+}
+
+void CellStore::Load(
+    sqlitelib::Sqlite &db,
+    int sheet)
+{
+    auto transaction = Begin();
+    transaction.Clear();
+
+    for (auto const &cell : db.prepare<int, int, std::string>("SELECT col, row, tmp_value FROM cells WHERE sheet = ?").execute_cursor(sheet))
+    {
+        transaction.Set(std::get<0>(cell), std::get<1>(cell), std::get<2>(cell));
+    }
+
+    transaction.Commit();
+}
+
+void CellStore::LoadRows(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    int fromRow,
+    int toRow)
+{
+    auto transaction = Begin();
+
+    auto cursor = db.prepare<int, int, std::string>("SELECT col, row, tmp_value FROM cells WHERE sheet = ? AND row BETWEEN ? AND ?").execute_cursor(sheet, fromRow, toRow);
+    for (auto const &cell : cursor)
+    {
+        transaction.Set(std::get<0>(cell), std::get<1>(cell), std::get<2>(cell));
+    }
+
+    transaction.Commit();
+}
+
+double CellStoreStats::CompressionRatio() const
+{
+    return packedBytes > 0 ? double(packedRawBytes) / double(packedBytes) : 0.0;
+}
+
+void CellStore::SetMemoryBudget(
+    size_t bytes)
+{
+    _memoryBudget = bytes;
+}
+
+void CellStore::Compact(
+    size_t maxPackBytes)
+{
+    // Compaction is a writer too, but not worth waiting for one
+    std::unique_lock<std::mutex> writeLock(_writeMutex, std::try_to_lock);
+    if (!writeLock.owns_lock())
+    {
+        return;
+    }
+
+    std::shared_ptr<const CellTable> current;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        current = _current;
+    }
+
+    auto epoch = _epoch.load();
+
+    struct Candidate
+    {
+        size_t band;
+        size_t col;
+        uint32_t touched;
+    };
+
+    std::vector<Candidate> cold;
+    std::map<std::pair<size_t, size_t>, std::shared_ptr<const CellChunk>> replaced;
+    CellStoreStats stats;
+
+    for (size_t b = 0; b < current->bands.size(); b++)
+    {
+        if (current->bands[b] == nullptr)
+        {
+            continue;
+        }
+
+        auto const &chunks = current->bands[b]->chunks;
+        for (size_t c = 0; c < chunks.size(); c++)
+        {
+            auto const &chunk = chunks[c];
+            if (chunk == nullptr)
+            {
+                continue;
+            }
+
+            auto touched = chunk->touched.load(std::memory_order_relaxed);
+            auto hot = epoch - touched <= HotEpochs;
+            stats.chunks++;
+
+            if (chunk->IsPacked() && hot)
+            {
+                auto unpacked = UnpackChunk(*chunk);
+                unpacked->touched = touched;
+                stats.unpackedBytes += unpacked->bytes;
+                replaced[{b, c}] = unpacked;
+            }
+            else if (chunk->IsPacked())
+            {
+                stats.packedChunks++;
+                stats.packedBytes += chunk->bytes;
+                stats.packedRawBytes += chunk->unpackedSize;
+            }
+            else
+            {
+                stats.unpackedBytes += chunk->bytes;
+                if (!hot)
+                {
+                    cold.push_back(Candidate{b, c, touched});
+                }
+            }
+        }
+    }
+
+    // Least recently read first
+    if (_memoryBudget > 0 && stats.unpackedBytes + stats.packedBytes > _memoryBudget)
+    {
+        std::sort(cold.begin(), cold.end(), [](const Candidate &a, const Candidate &b) { return a.touched < b.touched; });
+
+        size_t packedNow = 0;
+        for (auto const &candidate : cold)
+        {
+            if (stats.unpackedBytes + stats.packedBytes <= _memoryBudget || packedNow >= maxPackBytes)
+            {
+                break;
+            }
+
+            auto const &chunk = current->bands[candidate.band]->chunks[candidate.col];
+            auto packed = PackChunk(*chunk);
+            packed->touched = candidate.touched;
+
+            packedNow += chunk->bytes;
+            stats.unpackedBytes -= chunk->bytes;
+            stats.packedChunks++;
+            stats.packedBytes += packed->bytes;
+            stats.packedRawBytes += packed->unpackedSize;
+            replaced[{candidate.band, candidate.col}] = packed;
+        }
+    }
+
+    if (!replaced.empty())
+    {
+        auto table = std::make_shared<CellTable>(*current);
+
+        // Replacements are ordered by band, so every band is copied once
+        std::shared_ptr<CellBand> band;
+        size_t bandIndex = 0;
+
+        for (auto const &replacement : replaced)
+        {
+            if (band == nullptr || replacement.first.first != bandIndex)
+            {
+                bandIndex = replacement.first.first;
+                band = std::make_shared<CellBand>(*table->bands[bandIndex]);
+                table->bands[bandIndex] = band;
+            }
+
+            band->chunks[replacement.first.second] = replacement.second;
+        }
+
+        Publish(table);
+    }
+
+    _stats = stats;
+    _epoch++;
+}
+
+CellStoreStats CellStore::Stats() const
+{
+    auto stats = _stats;
+
+    stats.unpacks = _unpacks.load();
+    stats.unpackMicroseconds = stats.unpacks > 0 ? double(_unpackNanoseconds.load()) / double(stats.unpacks) / 1000.0 : 0.0;
+
+    return stats;
+}
@@ -0,0 +1,609 @@
+#include "corerenderer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+#ifndef GL_NUM_EXTENSIONS
+#define GL_NUM_EXTENSIONS 0x821D
+#endif
+
+typedef const GLubyte *(APIENTRYP GetStringiProc)(GLenum name, GLuint index);
+
+static const char *quadVertexShader = R"(
+#version 330 core
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec4 rect;
+layout(location = 2) in vec4 uv;
+layout(location = 3) in vec4 color;
+layout(location = 4) in vec2 params;
+uniform mat4 projection;
+out vec2 texCoord;
+out vec4 quadColor;
+out float kind;
+out float smoothing;
+void main()
+{
+    texCoord = mix(uv.xy, uv.zw, corner);
+    quadColor = color;
+    kind = params.x;
+    smoothing = params.y;
+    gl_Position = projection * vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);
+}
+)";
+
+static const char *quadFragmentShader = R"(
+#version 330 core
+uniform sampler2D image;
+in vec2 texCoord;
+in vec4 quadColor;
+in float kind;
+in float smoothing;
+out vec4 fragColor;
+void main()
+{
+    if (kind < 0.5)
+    {
+        fragColor = quadColor;
+    }
+    else if (kind < 1.5)
+    {
+        fragColor = vec4(texture(image, texCoord).rgb, 1.0);
+    }
+    else
+    {
+        float value = texture(image, texCoord).r;
+        float alpha = smoothstep(0.5 - smoothing, 0.5 + smoothing, value);
+        fragColor = vec4(quadColor.rgb, quadColor.a * alpha);
+    }
+}
+)";
+
+static const char *geometryVertexShader = R"(
+#version 330 core
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec4 color;
+uniform mat4 projection;
+out vec4 vertexColor;
+void main()
+{
+    vertexColor = color;
+    gl_Position = projection * vec4(position, 0.0, 1.0);
+}
+)";
+
+static const char *geometryFragmentShader = R"(
+#version 330 core
+in vec4 vertexColor;
+out vec4 fragColor;
+void main()
+{
+    fragColor = vertexColor;
+}
+)";
+
+// glad is generated for OpenGL 2.1 and reads extensions with glGetString,
+// which fails in a core profile context. The 3.x functions used here are
+// loaded by hand into glad's pointers, including the framebuffer object
+// functions the tile cache relies on.
+static bool LoadCoreFunctions(
+    GLADloadproc load,
+    bool &bufferStorage)
+{
+    glad_glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)load("glGenVertexArrays");
+    glad_glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)load("glBindVertexArray");
+    glad_glDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSPROC)load("glDeleteVertexArrays");
+    glad_glDrawArraysInstancedARB = (PFNGLDRAWARRAYSINSTANCEDARBPROC)load("glDrawArraysInstanced");
+    glad_glVertexAttribDivisorARB = (PFNGLVERTEXATTRIBDIVISORARBPROC)load("glVertexAttribDivisor");
+    glad_glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)load("glMapBufferRange");
+    glad_glFenceSync = (PFNGLFENCESYNCPROC)load("glFenceSync");
+    glad_glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)load("glClientWaitSync");
+    glad_glDeleteSync = (PFNGLDELETESYNCPROC)load("glDeleteSync");
+    glad_glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)load("glGenFramebuffers");
+    glad_glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)load("glDeleteFramebuffers");
+    glad_glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)load("glBindFramebuffer");
+    glad_glFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC)load("glFramebufferTexture2D");
+
+    if (glad_glGenVertexArrays == nullptr || glad_glBindVertexArray == nullptr || glad_glDeleteVertexArrays == nullptr ||
+        glad_glDrawArraysInstancedARB == nullptr || glad_glVertexAttribDivisorARB == nullptr || glad_glMapBufferRange == nullptr ||
+        glad_glFenceSync == nullptr || glad_glClientWaitSync == nullptr || glad_glDeleteSync == nullptr ||
+        glad_glGenFramebuffers == nullptr || glad_glDeleteFramebuffers == nullptr || glad_glBindFramebuffer == nullptr ||
+        glad_glFramebufferTexture2D == nullptr)
+    {
+        return false;
+    }
+
+    GLAD_GL_ARB_framebuffer_object = 1;
+
+    // Buffer storage is core in 4.4 and an extension before
+    bufferStorage = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+
+    auto getStringi = (GetStringiProc)load("glGetStringi");
+    if (!bufferStorage && getStringi != nullptr)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count && !bufferStorage; i++)
+        {
+            auto name = reinterpret_cast<const char *>(getStringi(GL_EXTENSIONS, GLuint(i)));
+            bufferStorage = name != nullptr && std::strcmp(name, "GL_ARB_buffer_storage") == 0;
+        }
+    }
+
+    if (bufferStorage)
+    {
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+        bufferStorage = glad_glBufferStorage != nullptr;
+    }
+
+    return true;
+}
+
+CoreRenderer::CoreRenderer()
+    : _quadProgram(0),
+      _geometryProgram(0),
+      _quadProjectionLocation(-1),
+      _geometryProjectionLocation(-1),
+      _quadVao(0),
+      _geometryVao(0),
+      _cornerBuffer(0),
+      _instanceBuffer(0),
+      _mapped(nullptr),
+      _persistent(false),
+      _fences{},
+      _segment(0),
+      _used(0),
+      _batchStart(0),
+      _batchTexture(0)
+{}
+
+RendererKind CoreRenderer::Kind() const
+{
+    return RendererKind::Core;
+}
+
+const char *CoreRenderer::Name() const
+{
+    return "core";
+}
+
+bool CoreRenderer::Init(
+    GLADloadproc load)
+{
+    if (GLVersion.major < 3 || (GLVersion.major == 3 && GLVersion.minor < 3))
+    {
+        spdlog::error("core renderer needs OpenGL 3.3, the context is {}.{}", GLVersion.major, GLVersion.minor);
+        return false;
+    }
+
+    bool bufferStorage = false;
+    if (!LoadCoreFunctions(load, bufferStorage))
+    {
+        spdlog::error("core renderer could not load the OpenGL 3.3 functions");
+        return false;
+    }
+
+    _quadProgram = CompileProgram(quadVertexShader, quadFragmentShader, "quad");
+    _geometryProgram = CompileProgram(geometryVertexShader, geometryFragmentShader, "geometry");
+    if (_quadProgram == 0 || _geometryProgram == 0)
+    {
+        Release();
+        return false;
+    }
+
+    _quadProjectionLocation = glGetUniformLocation(_quadProgram, "projection");
+    _geometryProjectionLocation = glGetUniformLocation(_geometryProgram, "projection");
+
+    glUseProgram(_quadProgram);
+    glUniform1i(glGetUniformLocation(_quadProgram, "image"), 0);
+
+    // Corners of the unit quad, as a triangle strip
+    const GLfloat corners[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+
+    glGenVertexArrays(1, &_quadVao);
+    glBindVertexArray(_quadVao);
+
+    glGenBuffers(1, &_cornerBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _cornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    // The instance attribute pointers are set per draw, at the batch offset
+    for (GLuint attribute = 1; attribute <= 4; attribute++)
+    {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisorARB(attribute, 1);
+    }
+
+    auto size = GLsizeiptr(SegmentInstances * SegmentCount * sizeof(QuadInstance));
+    glGenBuffers(1, &_instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+
+    if (bufferStorage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        _mapped = static_cast<QuadInstance *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+        _persistent = _mapped != nullptr;
+    }
+
+    if (!_persistent)
+    {
+        if (bufferStorage)
+        {
+            // Storage is immutable, the staging path needs a new buffer
+            glDeleteBuffers(1, &_instanceBuffer);
+            glGenBuffers(1, &_instanceBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+        }
+
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        _staging.resize(SegmentInstances * SegmentCount);
+        _mapped = _staging.data();
+    }
+
+    glGenVertexArrays(1, &_geometryVao);
+    glBindVertexArray(_geometryVao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    spdlog::info("core renderer, OpenGL {}.{}, {} instance buffer", GLVersion.major, GLVersion.minor, _persistent ? "persistently mapped" : "streamed");
+
+    return true;
+}
+
+void CoreRenderer::Release()
+{
+    for (auto &fence : _fences)
+    {
+        if (fence != nullptr)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    if (_instanceBuffer != 0)
+    {
+        if (_persistent)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &_instanceBuffer);
+        _instanceBuffer = 0;
+    }
+
+    if (_cornerBuffer != 0)
+    {
+        glDeleteBuffers(1, &_cornerBuffer);
+        _cornerBuffer = 0;
+    }
+
+    if (_quadVao != 0)
+    {
+        glDeleteVertexArrays(1, &_quadVao);
+        _quadVao = 0;
+    }
+
+    if (_geometryVao != 0)
+    {
+        glDeleteVertexArrays(1, &_geometryVao);
+        _geometryVao = 0;
+    }
+
+    if (_quadProgram != 0)
+    {
+        glDeleteProgram(_quadProgram);
+        _quadProgram = 0;
+    }
+
+    if (_geometryProgram != 0)
+    {
+        glDeleteProgram(_geometryProgram);
+        _geometryProgram = 0;
+    }
+
+    _mapped = nullptr;
+    _staging = std::vector<QuadInstance>();
+    _persistent = false;
+    _segment = _used = _batchStart = 0;
+}
+
+bool CoreRenderer::IsPersistentlyMapped() const
+{
+    return _persistent;
+}
+
+void CoreRenderer::Projection(
+    bool withTransform,
+    GLfloat matrix[16]) const
+{
+    auto const &target = _targets.back();
+    auto transform = withTransform ? CurrentTransform() : Transform{0.0f, 0.0f, 1.0f};
+
+    std::fill(matrix, matrix + 16, 0.0f);
+    matrix[0] = 2.0f * transform.scale / target.width;
+    matrix[5] = -2.0f * transform.scale / target.height;
+    matrix[10] = -1.0f;
+    matrix[12] = 2.0f * transform.x / target.width - 1.0f;
+    matrix[13] = 1.0f - 2.0f * transform.y / target.height;
+    matrix[15] = 1.0f;
+}
+
+void CoreRenderer::ApplyTarget()
+{
+    GLfloat projection[16];
+    Projection(false, projection);
+
+    glUseProgram(_quadProgram);
+    glUniformMatrix4fv(_quadProjectionLocation, 1, GL_FALSE, projection);
+}
+
+void CoreRenderer::ApplyTransform()
+{
+    // Quads are transformed as they are added, retained geometry gets the
+    // transform in its projection when drawn
+}
+
+CoreRenderer::QuadInstance &CoreRenderer::AddInstance(
+    QuadKind kind,
+    GLuint texture,
+    const glm::vec4 &color)
+{
+    // Solid quads draw with whatever texture is bound
+    if (kind != Solid && texture != _batchTexture)
+    {
+        if (_batchTexture != 0)
+        {
+            Flush();
+        }
+        _batchTexture = texture;
+    }
+
+    if (_used == SegmentInstances)
+    {
+        auto batchTexture = _batchTexture;
+        Flush();
+        NextSegment();
+        _batchTexture = batchTexture;
+    }
+
+    auto &instance = _mapped[_segment * SegmentInstances + _used++];
+    instance.color[0] = GLubyte(std::clamp(color.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+    instance.color[1] = GLubyte(std::clamp(color.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+    instance.color[2] = GLubyte(std::clamp(color.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+    instance.color[3] = GLubyte(std::clamp(color.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+    instance.kind = GLfloat(kind);
+    instance.smoothing = 0.0f;
+
+    _quadCount++;
+
+    return instance;
+}
+
+void CoreRenderer::Flush()
+{
+    if (_used == _batchStart)
+    {
+        _batchTexture = 0;
+        return;
+    }
+
+    auto first = _segment * SegmentInstances + _batchStart;
+    auto count = _used - _batchStart;
+
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+    if (!_persistent)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(first * sizeof(QuadInstance)), GLsizeiptr(count * sizeof(QuadInstance)), &_mapped[first]);
+    }
+
+    auto offset = [first](size_t member) { return reinterpret_cast<const GLvoid *>(first * sizeof(QuadInstance) + member); };
+
+    glUseProgram(_quadProgram);
+    glBindVertexArray(_quadVao);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), offset(offsetof(QuadInstance, rect)));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), offset(offsetof(QuadInstance, uv)));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuadInstance), offset(offsetof(QuadInstance, color)));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), offset(offsetof(QuadInstance, kind)));
+
+    if (_batchTexture != 0)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, _batchTexture);
+    }
+
+    glDrawArraysInstancedARB(GL_TRIANGLE_STRIP, 0, 4, GLsizei(count));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    _drawCallCount++;
+    _batchStart = _used;
+    _batchTexture = 0;
+}
+
+void CoreRenderer::NextSegment()
+{
+    if (_persistent)
+    {
+        _fences[_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    _segment = (_segment + 1) % SegmentCount;
+    _used = _batchStart = 0;
+
+    // The GPU may still read the segment from SegmentCount - 1 segments ago
+    auto &fence = _fences[_segment];
+    if (fence != nullptr)
+    {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED)
+        {
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // Without persistent mapping the buffer is orphaned once per round, so
+    // uploads never wait for draws still reading the old storage
+    if (!_persistent && _segment == 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(SegmentInstances * SegmentCount * sizeof(QuadInstance)), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void CoreRenderer::EndFrame()
+{
+    Flush();
+
+    // Every frame starts on a fresh segment
+    if (_used > 0)
+    {
+        NextSegment();
+    }
+
+    Renderer::EndFrame();
+}
+
+void CoreRenderer::FillRect(
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    const glm::vec4 &color)
+{
+    auto const &t = CurrentTransform();
+
+    auto &instance = AddInstance(Solid, 0, color);
+    instance.rect[0] = t.x + x0 * t.scale;
+    instance.rect[1] = t.y + y0 * t.scale;
+    instance.rect[2] = t.x + x1 * t.scale;
+    instance.rect[3] = t.y + y1 * t.scale;
+    std::fill(instance.uv, instance.uv + 4, 0.0f);
+}
+
+void CoreRenderer::DrawLine(
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    const glm::vec4 &color)
+{
+    auto const &t = CurrentTransform();
+
+    // Lines are one target pixel wide, right of or below their coordinates
+    auto left = t.x + std::min(x0, x1) * t.scale, right = t.x + std::max(x0, x1) * t.scale;
+    auto top = t.y + std::min(y0, y1) * t.scale, bottom = t.y + std::max(y0, y1) * t.scale;
+    if (x0 == x1)
+    {
+        right = left + 1.0f;
+    }
+    if (y0 == y1)
+    {
+        bottom = top + 1.0f;
+    }
+
+    auto &instance = AddInstance(Solid, 0, color);
+    instance.rect[0] = left;
+    instance.rect[1] = top;
+    instance.rect[2] = right;
+    instance.rect[3] = bottom;
+    std::fill(instance.uv, instance.uv + 4, 0.0f);
+}
+
+void CoreRenderer::DrawTexture(
+    GLuint texture,
+    const TexturedQuad &quad)
+{
+    auto const &t = CurrentTransform();
+
+    auto &instance = AddInstance(Image, texture, glm::vec4(1.0f));
+    instance.rect[0] = t.x + quad.x0 * t.scale;
+    instance.rect[1] = t.y + quad.y0 * t.scale;
+    instance.rect[2] = t.x + quad.x1 * t.scale;
+    instance.rect[3] = t.y + quad.y1 * t.scale;
+    instance.uv[0] = quad.s0;
+    instance.uv[1] = quad.t0;
+    instance.uv[2] = quad.s1;
+    instance.uv[3] = quad.t1;
+}
+
+void CoreRenderer::DrawGlyphs(
+    GLuint texture,
+    const TexturedQuad *quads,
+    size_t count,
+    const glm::vec4 &color,
+    float smoothing)
+{
+    auto const &t = CurrentTransform();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto const &quad = quads[i];
+
+        auto &instance = AddInstance(Glyph, texture, color);
+        instance.rect[0] = t.x + quad.x0 * t.scale;
+        instance.rect[1] = t.y + quad.y0 * t.scale;
+        instance.rect[2] = t.x + quad.x1 * t.scale;
+        instance.rect[3] = t.y + quad.y1 * t.scale;
+        instance.uv[0] = quad.s0;
+        instance.uv[1] = quad.t0;
+        instance.uv[2] = quad.s1;
+        instance.uv[3] = quad.t1;
+        instance.smoothing = smoothing;
+    }
+}
+
+void CoreRenderer::DrawGeometry(
+    GLenum mode,
+    GLuint buffer,
+    const ColorVertex *vertices,
+    size_t count)
+{
+    (void)vertices;
+
+    // Core profiles have no client side arrays
+    if (buffer == 0 || count == 0)
+    {
+        return;
+    }
+
+    Flush();
+
+    GLfloat projection[16];
+    Projection(true, projection);
+
+    glUseProgram(_geometryProgram);
+    glUniformMatrix4fv(_geometryProjectionLocation, 1, GL_FALSE, projection);
+
+    glBindVertexArray(_geometryVao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ColorVertex), reinterpret_cast<const GLvoid *>(offsetof(ColorVertex, x)));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ColorVertex), reinterpret_cast<const GLvoid *>(offsetof(ColorVertex, color)));
+
+    glDrawArrays(mode, 0, GLsizei(count));
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    _drawCallCount++;
+}
+
+GLenum CoreRenderer::GlyphTextureFormat() const
+{
+    return GL_RED;
+}
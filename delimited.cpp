@@ -0,0 +1,202 @@
+#include "delimited.h"
+
+#include <cstring>
+
+DelimitedWriter::DelimitedWriter(
+    char separator)
+    : _separator(separator),
+      _lineStart(true)
+{}
+
+bool DelimitedWriter::NeedsQuotes(
+    const std::string &value) const
+{
+    for (auto c : value)
+    {
+        if (c == _separator || c == '"' || c == '\n' || c == '\r')
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t DelimitedWriter::FieldSize(
+    const std::string &value) const
+{
+    if (!NeedsQuotes(value))
+    {
+        return value.size();
+    }
+
+    size_t size = value.size() + 2;
+    for (auto c : value)
+    {
+        if (c == '"')
+        {
+            size++;
+        }
+    }
+
+    return size;
+}
+
+void DelimitedWriter::Reserve(
+    size_t bytes)
+{
+    _buffer.reserve(bytes);
+}
+
+void DelimitedWriter::Field(
+    const std::string &value)
+{
+    if (!_lineStart)
+    {
+        _buffer.push_back(_separator);
+    }
+    _lineStart = false;
+
+    if (!NeedsQuotes(value))
+    {
+        _buffer.append(value);
+        return;
+    }
+
+    _buffer.push_back('"');
+    for (auto c : value)
+    {
+        if (c == '"')
+        {
+            _buffer.push_back('"');
+        }
+        _buffer.push_back(c);
+    }
+    _buffer.push_back('"');
+}
+
+void DelimitedWriter::EndLine()
+{
+    _buffer.push_back('\n');
+    _lineStart = true;
+}
+
+const std::string &DelimitedWriter::Text() const
+{
+    return _buffer;
+}
+
+size_t DelimitedWriter::Size() const
+{
+    return _buffer.size();
+}
+
+void DelimitedWriter::Clear()
+{
+    _buffer.clear();
+}
+
+DelimitedReader::DelimitedReader(
+    char separator)
+    : _separator(separator)
+{}
+
+int DelimitedReader::Parse(
+    const char *text,
+    size_t size,
+    const Callback &callback)
+{
+    const char *pos = text;
+    const char *end = text + size;
+    int row = 0, col = 0;
+
+    while (pos < end)
+    {
+        _field.clear();
+
+        if (*pos == '"')
+        {
+            // Quoted: runs up to the next single quote, doubled quotes are one
+            pos++;
+            while (pos < end)
+            {
+                auto quote = static_cast<const char *>(memchr(pos, '"', size_t(end - pos)));
+                if (quote == nullptr)
+                {
+                    _field.append(pos, size_t(end - pos));
+                    pos = end;
+                    break;
+                }
+
+                _field.append(pos, size_t(quote - pos));
+                pos = quote + 1;
+
+                if (pos < end && *pos == '"')
+                {
+                    _field.push_back('"');
+                    pos++;
+                    continue;
+                }
+
+                break;
+            }
+
+            // Anything between the closing quote and the separator is kept
+            while (pos < end && *pos != _separator && *pos != '\n' && *pos != '\r')
+            {
+                _field.push_back(*pos++);
+            }
+        }
+        else
+        {
+            auto start = pos;
+            while (pos < end && *pos != _separator && *pos != '\n' && *pos != '\r')
+            {
+                pos++;
+            }
+            _field.assign(start, size_t(pos - start));
+        }
+
+        callback(row, col, _field);
+
+        if (pos == end)
+        {
+            break;
+        }
+
+        if (*pos == _separator)
+        {
+            pos++;
+            col++;
+
+            // A separator at the very end still ends in an empty field
+            if (pos == end)
+            {
+                _field.clear();
+                callback(row, col, _field);
+            }
+
+            continue;
+        }
+
+        if (*pos == '\r')
+        {
+            pos++;
+        }
+        if (pos < end && *pos == '\n')
+        {
+            pos++;
+        }
+
+        row++;
+        col = 0;
+    }
+
+    // The last line counts when it has no line end
+    if (size > 0 && text[size - 1] != '\n' && text[size - 1] != '\r')
+    {
+        row++;
+    }
+
+    return row;
+}
@@ -0,0 +1,177 @@
+#include "editjournal.h"
+
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+
+EditJournal::EditJournal(
+    sqlitelib::Sqlite &db,
+    std::chrono::milliseconds flushInterval,
+    size_t maxPending)
+    : _db(db),
+      _flushInterval(flushInterval),
+      _maxPending(maxPending)
+{}
+
+void EditJournal::Add(
+    const EditKey &key,
+    Edit edit)
+{
+    auto found = _positions.find(key);
+    if (found != _positions.end())
+    {
+        _edits[found->second] = std::move(edit);
+        _stats.coalesced++;
+        return;
+    }
+
+    if (_edits.empty())
+    {
+        _oldest = Clock::now();
+    }
+
+    _positions.emplace(key, _edits.size());
+    _edits.push_back(std::move(edit));
+
+    if (_edits.size() >= _maxPending)
+    {
+        Flush();
+    }
+}
+
+void EditJournal::SetCell(
+    int sheet,
+    int col,
+    int storageRow,
+    const std::string &value)
+{
+    Add(EditKey(EditKind::Cell, sheet, col, storageRow), Edit{EditKind::Cell, sheet, col, storageRow, 0, value});
+}
+
+void EditJournal::SetColSize(
+    int sheet,
+    int col,
+    int delta)
+{
+    Add(EditKey(EditKind::ColSize, sheet, col, 0), Edit{EditKind::ColSize, sheet, col, 0, delta, std::string()});
+}
+
+void EditJournal::SetRowSize(
+    int sheet,
+    int row,
+    int delta)
+{
+    Add(EditKey(EditKind::RowSize, sheet, row, 0), Edit{EditKind::RowSize, sheet, row, 0, delta, std::string()});
+}
+
+void EditJournal::Update()
+{
+    if (!_edits.empty() && Clock::now() - _oldest >= _flushInterval)
+    {
+        Flush();
+    }
+}
+
+bool EditJournal::Flush()
+{
+    if (_edits.empty())
+    {
+        return true;
+    }
+
+    try
+    {
+        _db.execute("BEGIN;");
+
+        // Cells go through the upsert, so the fts triggers see an update
+        // instead of a delete and insert. Sizes keep the column headers.
+        auto upsertCell = _db.prepare(R"(
+            INSERT INTO cells (sheet, col, row, function, tmp_value) VALUES (?, ?, ?, ?, ?)
+            ON CONFLICT (sheet, col, row) DO UPDATE SET function = excluded.function, tmp_value = excluded.tmp_value)");
+        auto deleteCell = _db.prepare("DELETE FROM cells WHERE sheet = ? AND col = ? AND row = ?");
+        auto upsertCol = _db.prepare("INSERT INTO cols (sheet, col_index, size) VALUES (?, ?, ?) ON CONFLICT (sheet, col_index) DO UPDATE SET size = excluded.size");
+        auto upsertRow = _db.prepare("INSERT INTO rows (sheet, row_index, size) VALUES (?, ?, ?) ON CONFLICT (sheet, row_index) DO UPDATE SET size = excluded.size");
+
+        for (auto const &edit : _edits)
+        {
+            switch (edit.kind)
+            {
+                case EditKind::Cell:
+                    if (edit.value.empty())
+                    {
+                        deleteCell.execute(edit.sheet, edit.index, edit.row);
+                    }
+                    else
+                    {
+                        upsertCell.execute(edit.sheet, edit.index, edit.row, edit.value, edit.value);
+                    }
+                    break;
+                case EditKind::ColSize:
+                    upsertCol.execute(edit.sheet, edit.index, edit.size);
+                    break;
+                case EditKind::RowSize:
+                    upsertRow.execute(edit.sheet, edit.index, edit.size);
+                    break;
+            }
+        }
+
+        _db.execute("COMMIT;");
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("writing {} edits failed: {}", _edits.size(), _db.errormsg());
+        _stats.failures++;
+
+        try
+        {
+            _db.execute("ROLLBACK;");
+        }
+        catch (const std::exception &rollbackEx)
+        {
+            // BEGIN failed, no transaction was open
+        }
+
+        // Retried whole after another interval
+        _oldest = Clock::now();
+
+        return false;
+    }
+
+    auto now = Clock::now();
+
+    _stats.commits++;
+    _stats.edits += _edits.size();
+    _recentCommits.push_back(now);
+    while (now - _recentCommits.front() > std::chrono::seconds(1))
+    {
+        _recentCommits.pop_front();
+    }
+
+    _edits.clear();
+    _positions.clear();
+
+    return true;
+}
+
+size_t EditJournal::PendingCount() const
+{
+    return _edits.size();
+}
+
+double EditJournal::CommitsPerSecond() const
+{
+    auto since = Clock::now() - std::chrono::seconds(1);
+
+    // Commits are in time order, the ones within the window are at the end
+    size_t count = 0;
+    for (auto it = _recentCommits.rbegin(); it != _recentCommits.rend() && *it >= since; ++it)
+    {
+        count++;
+    }
+
+    return double(count);
+}
+
+const EditJournalStats &EditJournal::Stats() const
+{
+    return _stats;
+}
@@ -0,0 +1,371 @@
+#include "externalsort.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cellnumber.h>
+#include <queue>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+
+void SortProgress::Reset()
+{
+    permille = 0;
+    cancelRequested = false;
+    finished = false;
+    succeeded = false;
+}
+
+ExternalSort::ExternalSort(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const std::vector<SortKey> &keys,
+    size_t memoryBudget)
+    : _db(db),
+      _sheet(sheet),
+      _keys(keys),
+      _memoryBudget(memoryBudget)
+{}
+
+bool ExternalSort::Run(
+    SortProgress &progress,
+    std::vector<int32_t> &permutation)
+{
+    bool result = false;
+
+    try
+    {
+        auto rowCount = _db.execute_value<int>("SELECT IFNULL(MAX(row), -1) + 1 FROM cells WHERE sheet = ?", _sheet);
+
+        result = !_keys.empty() && rowCount > 1 && CreateRuns(rowCount, progress) && MergeRuns(rowCount, progress, permutation);
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("sorting failed: {}, {}", ex.what(), _db.errormsg());
+    }
+
+    CloseRuns();
+
+    progress.permille = 1000;
+    progress.succeeded = result;
+    progress.finished = true;
+
+    return result;
+}
+
+bool ExternalSort::Less(
+    const Record &a,
+    const Record &b) const
+{
+    for (size_t i = 0; i < _keys.size(); i++)
+    {
+        auto const &ka = a.keys[i];
+        auto const &kb = b.keys[i];
+
+        // Empty cells always sort last, regardless of the direction
+        if (ka.type != kb.type)
+        {
+            if (ka.type == Empty || kb.type == Empty)
+            {
+                return kb.type == Empty;
+            }
+
+            return _keys[i].descending ? ka.type > kb.type : ka.type < kb.type;
+        }
+
+        int cmp = 0;
+        if (ka.type == Number)
+        {
+            cmp = ka.number < kb.number ? -1 : (kb.number < ka.number ? 1 : 0);
+        }
+        else if (ka.type == Text)
+        {
+            auto n = std::min(ka.text.size(), kb.text.size());
+            for (size_t c = 0; c < n && cmp == 0; c++)
+            {
+                cmp = std::tolower((unsigned char)ka.text[c]) - std::tolower((unsigned char)kb.text[c]);
+            }
+            if (cmp == 0)
+            {
+                cmp = ka.text.size() < kb.text.size() ? -1 : (ka.text.size() > kb.text.size() ? 1 : 0);
+            }
+        }
+
+        if (cmp != 0)
+        {
+            return _keys[i].descending ? cmp > 0 : cmp < 0;
+        }
+    }
+
+    // Keeps the sort stable
+    return a.row < b.row;
+}
+
+ExternalSort::KeyValue ExternalSort::MakeKey(
+    const std::string &value)
+{
+    KeyValue key;
+
+    if (value.empty())
+    {
+        return key;
+    }
+
+    if (ParseCellNumber(value, key.number))
+    {
+        key.type = Number;
+    }
+    else
+    {
+        key.type = Text;
+        key.text = value;
+    }
+
+    return key;
+}
+
+size_t ExternalSort::RecordSize(
+    const Record &record)
+{
+    auto size = sizeof(Record) + record.keys.size() * sizeof(KeyValue);
+
+    for (auto const &key : record.keys)
+    {
+        size += key.text.capacity();
+    }
+
+    return size;
+}
+
+void ExternalSort::WriteRun(
+    std::vector<Record> &records)
+{
+    std::sort(records.begin(), records.end(), [this](const Record &a, const Record &b) { return Less(a, b); });
+
+    SortedRun run;
+    run.file = std::tmpfile();
+    if (run.file == nullptr)
+    {
+        throw std::runtime_error("failed to create temporary sort run");
+    }
+
+    // Owned by the run list from here on, so CloseRuns closes it when a
+    // write fails
+    run.count = static_cast<long long>(records.size());
+    _runs.push_back(run);
+
+    // A full temporary disk would leave a truncated run, which would merge
+    // into a wrong permutation
+    auto write = [&run](const void *data, size_t size) {
+        if (size > 0 && fwrite(data, size, 1, run.file) != 1)
+        {
+            throw std::runtime_error("writing a temporary sort run failed");
+        }
+    };
+
+    for (auto const &record : records)
+    {
+        write(&record.row, sizeof(record.row));
+        for (auto const &key : record.keys)
+        {
+            write(&key.type, sizeof(key.type));
+            if (key.type == Number)
+            {
+                write(&key.number, sizeof(key.number));
+            }
+            else if (key.type == Text)
+            {
+                auto len = static_cast<unsigned int>(key.text.size());
+                write(&len, sizeof(len));
+                write(key.text.data(), len);
+            }
+        }
+    }
+
+    if (fflush(run.file) != 0)
+    {
+        throw std::runtime_error("writing a temporary sort run failed");
+    }
+    rewind(run.file);
+
+    records.clear();
+}
+
+bool ExternalSort::ReadRecord(
+    FILE *file,
+    size_t keyCount,
+    Record &record)
+{
+    // Only the end of the run may come before a record
+    if (fread(&record.row, sizeof(record.row), 1, file) != 1)
+    {
+        if (ferror(file))
+        {
+            throw std::runtime_error("reading a temporary sort run failed");
+        }
+
+        return false;
+    }
+
+    auto read = [file](void *data, size_t size) {
+        if (size > 0 && fread(data, size, 1, file) != 1)
+        {
+            throw std::runtime_error("reading a temporary sort run failed");
+        }
+    };
+
+    record.keys.resize(keyCount);
+    for (auto &key : record.keys)
+    {
+        read(&key.type, sizeof(key.type));
+
+        if (key.type == Number)
+        {
+            read(&key.number, sizeof(key.number));
+        }
+        else if (key.type == Text)
+        {
+            unsigned int len = 0;
+            read(&len, sizeof(len));
+            key.text.resize(len);
+            read(&key.text[0], len);
+        }
+    }
+
+    return true;
+}
+
+bool ExternalSort::CreateRuns(
+    int rowCount,
+    SortProgress &progress)
+{
+    // One cursor per key column, merge-joined on row so rows without a value
+    // in a key column still get an (empty) key.
+    std::vector<sqlitelib::Cursor<int, std::string>> cursors;
+    std::vector<sqlitelib::Iterator<int, std::string>> iterators;
+    for (auto const &key : _keys)
+    {
+        cursors.push_back(_db.prepare<int, std::string>("SELECT row, tmp_value FROM cells WHERE sheet = ? AND col = ? ORDER BY row").execute_cursor(_sheet, key.col));
+        iterators.push_back(cursors.back().begin());
+    }
+    sqlitelib::Iterator<int, std::string> end;
+
+    std::vector<Record> records;
+    size_t used = 0;
+
+    for (int row = 0; row < rowCount; row++)
+    {
+        if (progress.cancelRequested)
+        {
+            return false;
+        }
+
+        Record record;
+        record.row = row;
+        record.keys.resize(_keys.size());
+
+        for (size_t k = 0; k < _keys.size(); k++)
+        {
+            if (iterators[k] == end)
+            {
+                continue;
+            }
+
+            auto cell = *iterators[k];
+            if (std::get<0>(cell) == row)
+            {
+                record.keys[k] = MakeKey(std::get<1>(cell));
+                ++iterators[k];
+            }
+        }
+
+        used += RecordSize(record);
+        records.push_back(std::move(record));
+
+        if (used >= _memoryBudget)
+        {
+            WriteRun(records);
+            used = 0;
+        }
+
+        if ((row & 0xffff) == 0)
+        {
+            progress.permille = int(500LL * row / rowCount);
+        }
+    }
+
+    if (!records.empty())
+    {
+        WriteRun(records);
+    }
+
+    spdlog::info("sort: {} rows in {} runs", rowCount, _runs.size());
+
+    return true;
+}
+
+bool ExternalSort::MergeRuns(
+    int rowCount,
+    SortProgress &progress,
+    std::vector<int32_t> &permutation)
+{
+    struct Head
+    {
+        Record record;
+        size_t run;
+    };
+
+    auto greater = [this](const Head &a, const Head &b) { return Less(b.record, a.record); };
+    std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+
+    for (size_t r = 0; r < _runs.size(); r++)
+    {
+        Head head;
+        head.run = r;
+        if (ReadRecord(_runs[r].file, _keys.size(), head.record))
+        {
+            heads.push(std::move(head));
+        }
+    }
+
+    permutation.clear();
+    permutation.reserve(rowCount);
+
+    while (!heads.empty())
+    {
+        if (progress.cancelRequested)
+        {
+            return false;
+        }
+
+        auto head = heads.top();
+        heads.pop();
+
+        permutation.push_back(head.record.row);
+
+        if (ReadRecord(_runs[head.run].file, _keys.size(), head.record))
+        {
+            heads.push(std::move(head));
+        }
+
+        if ((permutation.size() & 0xffff) == 0)
+        {
+            progress.permille = 500 + int(500LL * permutation.size() / rowCount);
+        }
+    }
+
+    return true;
+}
+
+void ExternalSort::CloseRuns()
+{
+    for (auto &run : _runs)
+    {
+        if (run.file != nullptr)
+        {
+            fclose(run.file);
+        }
+    }
+
+    _runs.clear();
+}
@@ -0,0 +1,206 @@
+#include "find.h"
+
+#include <algorithm>
+
+static bool IsBefore(
+    const CellPosition &a,
+    int col,
+    int row)
+{
+    return a.row < row || (a.row == row && a.col < col);
+}
+
+static bool IsAfter(
+    const CellPosition &a,
+    int col,
+    int row)
+{
+    return a.row > row || (a.row == row && a.col > col);
+}
+
+static size_t Utf8Length(
+    const std::string &str)
+{
+    return std::count_if(str.begin(), str.end(), [](char c) { return (c & 0xC0) != 0x80; });
+}
+
+FindCursor::FindCursor(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const std::string &query)
+    : _db(db),
+      _sheet(sheet),
+      _query(query),
+      _exhausted(false),
+      _current(-1)
+{
+    Open();
+}
+
+const std::string &FindCursor::Query() const
+{
+    return _query;
+}
+
+bool FindCursor::HasFullTextIndex(
+    sqlitelib::Sqlite &db)
+{
+    return db.execute_value<int>("SELECT COUNT(*) FROM sqlite_master WHERE name = 'cells_fts'") > 0;
+}
+
+void FindCursor::Open()
+{
+    // The trigram tokenizer can only match strings of three or more characters
+    if (Utf8Length(_query) >= 3 && HasFullTextIndex(_db))
+    {
+        std::string match = "\"";
+        for (auto c : _query)
+        {
+            match += c;
+            if (c == '"')
+            {
+                match += '"';
+            }
+        }
+        match += "\"";
+
+        _cursor = std::make_unique<MatchCursor>(
+            _db.prepare<int, int>(R"(
+                SELECT cells.col, cells.row FROM cells_fts
+                JOIN cells ON cells.rowid = cells_fts.rowid
+                WHERE cells_fts MATCH ? AND cells.sheet = ?
+                ORDER BY cells.row, cells.col)")
+                .execute_cursor(match, _sheet));
+    }
+    else
+    {
+        std::string like = "%";
+        for (auto c : _query)
+        {
+            if (c == '%' || c == '_' || c == '\\')
+            {
+                like += '\\';
+            }
+            like += c;
+        }
+        like += "%";
+
+        _cursor = std::make_unique<MatchCursor>(
+            _db.prepare<int, int>(R"(
+                SELECT col, row FROM cells
+                WHERE sheet = ? AND tmp_value LIKE ? ESCAPE '\'
+                ORDER BY row, col)")
+                .execute_cursor(_sheet, like));
+    }
+
+    _iterator = _cursor->begin();
+}
+
+bool FindCursor::FetchNext()
+{
+    if (_exhausted)
+    {
+        return false;
+    }
+
+    if (_iterator == MatchIterator())
+    {
+        _exhausted = true;
+        _cursor.reset();
+        return false;
+    }
+
+    auto match = *_iterator;
+    _matches.push_back(CellPosition{std::get<0>(match), std::get<1>(match)});
+    ++_iterator;
+
+    return true;
+}
+
+bool FindCursor::NextAfter(
+    int col,
+    int row,
+    CellPosition &out)
+{
+    // Fetched matches are sorted, so the first one after the position is a
+    // binary search away
+    auto found = std::partition_point(
+        _matches.begin(),
+        _matches.end(),
+        [col, row](const CellPosition &m) { return !IsAfter(m, col, row); });
+
+    if (found != _matches.end())
+    {
+        _current = int(found - _matches.begin());
+    }
+    else
+    {
+        _current = -1;
+        while (FetchNext())
+        {
+            if (IsAfter(_matches.back(), col, row))
+            {
+                _current = int(_matches.size()) - 1;
+                break;
+            }
+        }
+
+        if (_current < 0)
+        {
+            if (_matches.empty())
+            {
+                return false;
+            }
+
+            _current = 0;
+        }
+    }
+
+    out = _matches[_current];
+
+    return true;
+}
+
+bool FindCursor::PreviousBefore(
+    int col,
+    int row,
+    CellPosition &out)
+{
+    // Make sure the first match at or after the position is fetched, so
+    // everything before it is known
+    while ((_matches.empty() || IsBefore(_matches.back(), col, row)) && FetchNext())
+    {
+    }
+
+    auto found = std::partition_point(
+        _matches.begin(),
+        _matches.end(),
+        [col, row](const CellPosition &m) { return IsBefore(m, col, row); });
+
+    if (found != _matches.begin())
+    {
+        _current = int(found - _matches.begin()) - 1;
+    }
+    else
+    {
+        while (FetchNext())
+        {
+        }
+
+        if (_matches.empty())
+        {
+            return false;
+        }
+
+        _current = int(_matches.size()) - 1;
+    }
+
+    out = _matches[_current];
+
+    return true;
+}
+
+int FindCursor::CurrentIndex() const
+{
+    return _current;
+}
@@ -0,0 +1,59 @@
+#include "framearena.h"
+
+#include <cstdint>
+
+FrameArena::FrameArena(
+    size_t blockSize)
+    : _block(new char[blockSize]),
+      _blockSize(blockSize),
+      _offset(0),
+      _overflowSize(0),
+      _used(0)
+{}
+
+void *FrameArena::Allocate(
+    size_t size,
+    size_t alignment)
+{
+    _used += size;
+
+    auto base = reinterpret_cast<uintptr_t>(_block.get());
+    auto aligned = (base + _offset + alignment - 1) & ~uintptr_t(alignment - 1);
+    if (aligned + size <= base + _blockSize)
+    {
+        _offset = aligned + size - base;
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    // The block is full for this frame; new char[] is aligned for any
+    // fundamental type
+    _overflow.emplace_back(new char[size]);
+    _overflowSize += size;
+
+    return _overflow.back().get();
+}
+
+void FrameArena::Reset()
+{
+    if (!_overflow.empty())
+    {
+        _blockSize += _overflowSize;
+        _block.reset(new char[_blockSize]);
+
+        _overflow.clear();
+        _overflowSize = 0;
+    }
+
+    _offset = 0;
+    _used = 0;
+}
+
+size_t FrameArena::Used() const
+{
+    return _used;
+}
+
+size_t FrameArena::Capacity() const
+{
+    return _blockSize + _overflowSize;
+}
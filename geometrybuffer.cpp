@@ -0,0 +1,173 @@
+#include "geometrybuffer.h"
+
+#include <algorithm>
+
+GeometryBuffer::GeometryBuffer(
+    GLenum mode)
+    : _mode(mode),
+      _buffer(0),
+      _color{255, 255, 255, 255},
+      _clip{0, 0, 0, 0},
+      _clipped(false),
+      _uploaded(false)
+{}
+
+void GeometryBuffer::Clear()
+{
+    _vertices.clear();
+    _uploaded = false;
+}
+
+void GeometryBuffer::SetColor(
+    float r,
+    float g,
+    float b,
+    float a)
+{
+    _color[0] = GLubyte(std::clamp(r, 0.0f, 1.0f) * 255.0f + 0.5f);
+    _color[1] = GLubyte(std::clamp(g, 0.0f, 1.0f) * 255.0f + 0.5f);
+    _color[2] = GLubyte(std::clamp(b, 0.0f, 1.0f) * 255.0f + 0.5f);
+    _color[3] = GLubyte(std::clamp(a, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+void GeometryBuffer::SetClip(
+    float x0,
+    float y0,
+    float x1,
+    float y1)
+{
+    _clip[0] = x0;
+    _clip[1] = y0;
+    _clip[2] = x1;
+    _clip[3] = y1;
+    _clipped = true;
+}
+
+void GeometryBuffer::ResetClip()
+{
+    _clipped = false;
+}
+
+void GeometryBuffer::AddVertex(
+    float x,
+    float y)
+{
+    ColorVertex vertex;
+    vertex.x = x;
+    vertex.y = y;
+    std::copy(_color, _color + 4, vertex.color);
+
+    _vertices.push_back(vertex);
+}
+
+void GeometryBuffer::AddLine(
+    float x0,
+    float y0,
+    float x1,
+    float y1)
+{
+    AddVertex(x0, y0);
+    AddVertex(x1, y1);
+}
+
+void GeometryBuffer::AddTriangle(
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    float x2,
+    float y2)
+{
+    AddVertex(x0, y0);
+    AddVertex(x1, y1);
+    AddVertex(x2, y2);
+}
+
+void GeometryBuffer::AddRect(
+    float x0,
+    float y0,
+    float x1,
+    float y1)
+{
+    auto left = std::min(x0, x1), right = std::max(x0, x1);
+    auto top = std::min(y0, y1), bottom = std::max(y0, y1);
+
+    if (_clipped)
+    {
+        left = std::max(left, _clip[0]);
+        top = std::max(top, _clip[1]);
+        right = std::min(right, _clip[2]);
+        bottom = std::min(bottom, _clip[3]);
+    }
+
+    if (left >= right || top >= bottom)
+    {
+        return;
+    }
+
+    AddTriangle(left, top, right, top, right, bottom);
+    AddTriangle(left, top, right, bottom, left, bottom);
+}
+
+void GeometryBuffer::AddFrame(
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    float thickness)
+{
+    AddRect(x0, y0, x1, y0 + thickness);
+    AddRect(x0, y1 - thickness, x1, y1);
+    AddRect(x0, y0 + thickness, x0 + thickness, y1 - thickness);
+    AddRect(x1 - thickness, y0 + thickness, x1, y1 - thickness);
+}
+
+void GeometryBuffer::Draw(
+    Renderer &renderer)
+{
+    if (_vertices.empty())
+    {
+        return;
+    }
+
+    if (GLAD_GL_VERSION_1_5 && !_uploaded)
+    {
+        if (_buffer == 0)
+        {
+            glGenBuffers(1, &_buffer);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(_vertices.size() * sizeof(ColorVertex)), _vertices.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _uploaded = true;
+    }
+
+    renderer.DrawGeometry(_mode, _buffer, _vertices.data(), _vertices.size());
+}
+
+void GeometryBuffer::Release()
+{
+    if (_buffer != 0)
+    {
+        glDeleteBuffers(1, &_buffer);
+        _buffer = 0;
+    }
+    _uploaded = false;
+}
+
+size_t GeometryBuffer::VertexCount() const
+{
+    return _vertices.size();
+}
+
+size_t GeometryBuffer::MemoryUsage() const
+{
+    auto size = _vertices.capacity() * sizeof(ColorVertex);
+    if (_buffer != 0)
+    {
+        size += _vertices.size() * sizeof(ColorVertex);
+    }
+
+    return size;
+}
@@ -0,0 +1,354 @@
+#include "glyphatlas.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <spdlog/spdlog.h>
+#include <stb_rect_pack.h>
+#include <stb_truetype.h>
+
+uint32_t DecodeUtf8(
+    const char *&it,
+    const char *end)
+{
+    auto c = (unsigned char)*it++;
+    if (c < 0x80)
+    {
+        return c;
+    }
+
+    int length;
+    uint32_t codepoint;
+    if ((c & 0xE0) == 0xC0)
+    {
+        length = 1;
+        codepoint = c & 0x1F;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        length = 2;
+        codepoint = c & 0x0F;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        length = 3;
+        codepoint = c & 0x07;
+    }
+    else
+    {
+        return 0xFFFD;
+    }
+
+    auto next = it;
+    for (int i = 0; i < length; i++)
+    {
+        if (next == end || (*next & 0xC0) != 0x80)
+        {
+            return 0xFFFD;
+        }
+        codepoint = (codepoint << 6) | (*next++ & 0x3F);
+    }
+
+    it = next;
+
+    return codepoint;
+}
+
+struct GlyphAtlas::Font
+{
+    std::vector<unsigned char> data;
+    stbtt_fontinfo info;
+    float scale;
+};
+
+struct GlyphAtlas::Page
+{
+    GLuint texture = 0;
+    stbrp_context context;
+    std::vector<stbrp_node> nodes;
+    unsigned int lastUsed = 0;
+};
+
+// Distance field value at the glyph outline, and how much the value changes
+// per atlas pixel away from it
+static const unsigned char sdfOnEdge = 128;
+static const float sdfDistanceScale = float(sdfOnEdge) / GlyphAtlas::SdfPadding;
+
+GlyphAtlas::GlyphAtlas()
+    : _frame(0),
+      _textureFormat(GL_ALPHA)
+{}
+
+GlyphAtlas::~GlyphAtlas() = default;
+
+bool GlyphAtlas::AddFont(
+    const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    auto font = std::make_unique<Font>();
+    font->data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    // Collections (.ttc) use their first font
+    auto offset = stbtt_GetFontOffsetForIndex(font->data.data(), 0);
+    if (offset < 0 || !stbtt_InitFont(&font->info, font->data.data(), offset))
+    {
+        spdlog::error("failed to read font {}", path);
+        return false;
+    }
+
+    font->scale = stbtt_ScaleForPixelHeight(&font->info, SdfPixelHeight);
+    _fonts.push_back(std::move(font));
+
+    return true;
+}
+
+bool GlyphAtlas::HasFonts() const
+{
+    return !_fonts.empty();
+}
+
+void GlyphAtlas::SetTextureFormat(
+    GLenum format)
+{
+    _textureFormat = format;
+}
+
+void GlyphAtlas::BeginFrame()
+{
+    _frame++;
+}
+
+int GlyphAtlas::AddPage()
+{
+    auto page = std::make_unique<Page>();
+    page->nodes.resize(PageSize);
+    stbrp_init_target(&page->context, PageSize, PageSize, page->nodes.data(), int(page->nodes.size()));
+
+    std::vector<unsigned char> empty(PageSize * PageSize, 0);
+    glGenTextures(1, &page->texture);
+    glBindTexture(GL_TEXTURE_2D, page->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    auto internalFormat = _textureFormat == GL_RED ? GL_R8 : _textureFormat;
+    glTexImage2D(GL_TEXTURE_2D, 0, GLint(internalFormat), PageSize, PageSize, 0, _textureFormat, GL_UNSIGNED_BYTE, empty.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    _pages.push_back(std::move(page));
+
+    return int(_pages.size()) - 1;
+}
+
+void GlyphAtlas::ClearPage(
+    int page)
+{
+    for (auto it = _glyphs.begin(); it != _glyphs.end();)
+    {
+        if (it->second.page == page)
+        {
+            it = _glyphs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    auto &p = *_pages[page];
+    stbrp_init_target(&p.context, PageSize, PageSize, p.nodes.data(), int(p.nodes.size()));
+
+    // Cleared so the padding around new glyphs does not pick up old ones
+    std::vector<unsigned char> empty(PageSize * PageSize, 0);
+    glBindTexture(GL_TEXTURE_2D, p.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, PageSize, PageSize, _textureFormat, GL_UNSIGNED_BYTE, empty.data());
+}
+
+bool GlyphAtlas::Pack(
+    int width,
+    int height,
+    int &page,
+    int &x,
+    int &y)
+{
+    stbrp_rect rect;
+    rect.id = 0;
+    rect.w = stbrp_coord(width);
+    rect.h = stbrp_coord(height);
+
+    auto tryPage = [&](int p) {
+        rect.was_packed = 0;
+        stbrp_pack_rects(&_pages[p]->context, &rect, 1);
+        if (rect.was_packed)
+        {
+            page = p, x = rect.x, y = rect.y;
+        }
+        return rect.was_packed != 0;
+    };
+
+    for (int p = 0; p < int(_pages.size()); p++)
+    {
+        if (tryPage(p))
+        {
+            return true;
+        }
+    }
+
+    if (int(_pages.size()) < MaxPages)
+    {
+        return tryPage(AddPage());
+    }
+
+    // Evict the page that was used longest ago, but never one holding glyphs
+    // of the current frame
+    int oldest = -1;
+    for (int p = 0; p < int(_pages.size()); p++)
+    {
+        if (_pages[p]->lastUsed != _frame && (oldest < 0 || _pages[p]->lastUsed < _pages[oldest]->lastUsed))
+        {
+            oldest = p;
+        }
+    }
+
+    if (oldest < 0)
+    {
+        return false;
+    }
+
+    ClearPage(oldest);
+
+    return tryPage(oldest);
+}
+
+bool GlyphAtlas::Rasterize(
+    uint32_t codepoint,
+    AtlasGlyph &glyph)
+{
+    Font *font = _fonts.front().get();
+    int index = 0;
+    for (auto const &f : _fonts)
+    {
+        index = stbtt_FindGlyphIndex(&f->info, int(codepoint));
+        if (index != 0)
+        {
+            font = f.get();
+            break;
+        }
+    }
+
+    int advance, lsb;
+    stbtt_GetGlyphHMetrics(&font->info, index, &advance, &lsb);
+
+    int width, height, xoff, yoff;
+    auto sdf = stbtt_GetGlyphSDF(&font->info, font->scale, index, SdfPadding, sdfOnEdge, sdfDistanceScale, &width, &height, &xoff, &yoff);
+
+    glyph.advance = advance * font->scale;
+    glyph.page = -1;
+
+    // Glyphs without an outline, like space, only advance
+    if (sdf == nullptr)
+    {
+        return true;
+    }
+
+    // The distance field fades out within its padding, so neighbouring
+    // glyphs can be packed without a gap
+    int page, x, y;
+    if (!Pack(width, height, page, x, y))
+    {
+        stbtt_FreeSDF(sdf, nullptr);
+        return false;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _pages[page]->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, _textureFormat, GL_UNSIGNED_BYTE, sdf);
+    stbtt_FreeSDF(sdf, nullptr);
+
+    glyph.page = page;
+    glyph.xoff = xoff;
+    glyph.yoff = yoff;
+    glyph.width = width;
+    glyph.height = height;
+    glyph.s0 = float(x) / PageSize;
+    glyph.t0 = float(y) / PageSize;
+    glyph.s1 = float(x + width) / PageSize;
+    glyph.t1 = float(y + height) / PageSize;
+
+    return true;
+}
+
+const AtlasGlyph *GlyphAtlas::Get(
+    uint32_t codepoint)
+{
+    if (_fonts.empty())
+    {
+        return nullptr;
+    }
+
+    auto found = _glyphs.find(codepoint);
+    if (found == _glyphs.end())
+    {
+        AtlasGlyph glyph;
+        if (!Rasterize(codepoint, glyph))
+        {
+            return nullptr;
+        }
+        found = _glyphs.emplace(codepoint, glyph).first;
+    }
+
+    found->second.lastUsed = _frame;
+    if (found->second.page >= 0)
+    {
+        _pages[found->second.page]->lastUsed = _frame;
+    }
+
+    return &found->second;
+}
+
+GLuint GlyphAtlas::PageTexture(
+    int page) const
+{
+    return _pages[page]->texture;
+}
+
+float GlyphAtlas::EdgeSmoothing(
+    float screenScale)
+{
+    auto valuePerScreenPixel = (sdfDistanceScale / 255.0f) / std::max(screenScale, 0.01f);
+
+    return std::min(0.5f, 0.7f * valuePerScreenPixel);
+}
+
+void GlyphAtlas::Release()
+{
+    for (auto const &page : _pages)
+    {
+        glDeleteTextures(1, &page->texture);
+    }
+
+    _pages.clear();
+    _glyphs.clear();
+}
+
+size_t GlyphAtlas::GlyphCount() const
+{
+    return _glyphs.size();
+}
+
+size_t GlyphAtlas::MemoryUsage() const
+{
+    size_t size = _pages.size() * (PageSize * PageSize + sizeof(Page) + PageSize * sizeof(stbrp_node));
+    size += _glyphs.size() * (sizeof(uint32_t) + sizeof(AtlasGlyph) + sizeof(void *) * 2);
+
+    for (auto const &font : _fonts)
+    {
+        size += font->data.capacity();
+    }
+
+    return size;
+}
@@ -0,0 +1,129 @@
+#include "headerlabels.h"
+
+#include <algorithm>
+#include <rowview.h>
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+
+std::string columnIndexToLetters(int n)
+{
+    std::string str; // To store result (Excel column name)
+
+    while (n > 0)
+    {
+        // Find remainder
+        int rem = n % 26;
+
+        // If remainder is 0, then a 'Z' must be there in output
+        if (rem == 0)
+        {
+            str += 'Z';
+            n = (n / 26) - 1;
+        }
+        else // If remainder is non-zero
+        {
+            str += (rem - 1) + 'A';
+            n = n / 26;
+        }
+    }
+
+    std::reverse(str.begin(), str.end());
+    return str;
+}
+
+const std::string *LabelRange::Find(
+    int index) const
+{
+    if (index < first || index - first >= int(labels.size()))
+    {
+        return nullptr;
+    }
+
+    return &labels[index - first];
+}
+
+// Whether a range covers [first, last]
+static bool Covers(
+    const std::shared_ptr<const LabelRange> &range,
+    int first,
+    int last)
+{
+    return range != nullptr && first >= range->first && last - range->first < int(range->labels.size());
+}
+
+void HeaderLabels::Load(
+    sqlitelib::Sqlite &db,
+    int sheet)
+{
+    _headers.clear();
+    _cols.reset();
+
+    try
+    {
+        for (auto const &header : db.execute_cursor<int, std::string>("SELECT col_index, header FROM cols WHERE sheet = ? AND header IS NOT NULL AND header <> ''", sheet))
+        {
+            _headers[std::get<0>(header)] = std::get<1>(header);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("reading column headers failed: {}", db.errormsg());
+    }
+}
+
+std::string HeaderLabels::ColLabel(
+    int col) const
+{
+    auto found = _headers.find(col);
+    if (found != _headers.end())
+    {
+        return found->second;
+    }
+
+    return columnIndexToLetters(col + 1);
+}
+
+std::shared_ptr<const LabelRange> HeaderLabels::Cols(
+    int first,
+    int last)
+{
+    if (Covers(_cols, first, last))
+    {
+        return _cols;
+    }
+
+    auto margin = last - first + 1;
+    auto range = std::make_shared<LabelRange>();
+    range->first = std::max(0, first - margin);
+    for (int col = range->first; col <= last + margin; col++)
+    {
+        range->labels.push_back(ColLabel(col));
+    }
+
+    _cols = range;
+    return _cols;
+}
+
+std::shared_ptr<const LabelRange> HeaderLabels::Rows(
+    const std::shared_ptr<const RowView> &view,
+    int first,
+    int last)
+{
+    if (view == _rowsView && Covers(_rows, first, last))
+    {
+        return _rows;
+    }
+
+    auto margin = last - first + 1;
+    auto range = std::make_shared<LabelRange>();
+    range->first = std::max(0, first - margin);
+    for (int row = range->first; row <= last + margin; row++)
+    {
+        auto storageRow = view->ToStorage(row);
+        range->labels.push_back(storageRow < 0 ? std::string() : fmt::format("{}", storageRow + 1));
+    }
+
+    _rows = range;
+    _rowsView = view;
+    return _rows;
+}
@@ -0,0 +1,13 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// Allocations the calling thread made through the global operator new so
+// far. The operators are replaced for the whole program to count them; the
+// count is kept per thread, so a thread can tell what its own work cost by
+// taking the difference around it. Allocations with malloc, like those of
+// SQLite or the GL driver, are not counted.
+uint64_t ThreadAllocationCount();
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,106 @@
+#ifndef AUTOFILTER_H
+#define AUTOFILTER_H
+
+#include <cstdint>
+#include <map>
+#include <rowbitmap.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+// "= x", "<> x", "> n", ">= n", "< n", "<= n"; a bare value means "= value".
+// Numeric operands compare against numeric cells, text operands against text
+// cells, both case-insensitive.
+struct ColumnPredicate
+{
+    enum Operator
+    {
+        Equal,
+        NotEqual,
+        Less,
+        LessOrEqual,
+        Greater,
+        GreaterOrEqual,
+    };
+
+    Operator op = Equal;
+    bool numeric = false;
+    double number = 0.0;
+    std::string text;
+
+    static bool Parse(
+        const std::string &input,
+        ColumnPredicate &out);
+
+    std::string ToString() const;
+};
+
+// Secondary index over one column: a sorted run of numeric values and one of
+// lowercased text values, each entry carrying its storage row. Predicates are
+// answered with a binary search plus a walk over the matching entries.
+class ColumnIndex
+{
+public:
+    void Build(
+        sqlitelib::Sqlite &db,
+        int sheet,
+        int col);
+
+    // Sets the bits of all rows matching the predicate
+    void Evaluate(
+        const ColumnPredicate &predicate,
+        RowBitmap &out) const;
+
+    size_t MemoryUsage() const;
+
+private:
+    std::vector<std::pair<double, int32_t>> _numbers;
+    std::vector<std::pair<std::string, int32_t>> _texts;
+};
+
+class AutoFilter
+{
+public:
+    void SetPredicate(
+        int col,
+        const ColumnPredicate &predicate);
+
+    void ClearPredicate(
+        int col);
+
+    void ClearPredicates();
+
+    bool HasPredicate(
+        int col) const;
+
+    bool IsEmpty() const;
+
+    const std::map<int, ColumnPredicate> &Predicates() const;
+
+    // ANDs the bitmaps of all column predicates over rows [0, rowCount) of
+    // a sheet
+    RowBitmap Evaluate(
+        sqlitelib::Sqlite &db,
+        int sheet,
+        int rowCount);
+
+    // Indexes are built on first use per column and must be dropped when the
+    // column data changes
+    void InvalidateIndex(
+        int col);
+
+    void InvalidateIndexes();
+
+    size_t MemoryUsage() const;
+
+private:
+    std::map<int, ColumnPredicate> _predicates;
+    std::map<int, ColumnIndex> _indexes;
+};
+
+#endif // AUTOFILTER_H
@@ -0,0 +1,25 @@
+#ifndef BLOCKCODEC_H
+#define BLOCKCODEC_H
+
+#include <cstddef>
+#include <vector>
+
+// LZ77 block compression in the LZ4 block layout: sequences of a token,
+// literals and a 16 bit back reference, found with a single hash probe.
+// Fast in both directions and good on repeated text, at a lower ratio than
+// entropy coders. The decompressor needs the original size.
+
+// Replaces 'out' with the compressed block
+void BlockCompress(
+    const char *data,
+    size_t size,
+    std::vector<char> &out);
+
+// Fills exactly 'outSize' bytes; false for a damaged block
+bool BlockDecompress(
+    const char *data,
+    size_t size,
+    char *out,
+    size_t outSize);
+
+#endif // BLOCKCODEC_H
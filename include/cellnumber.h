@@ -0,0 +1,14 @@
+#ifndef CELLNUMBER_H
+#define CELLNUMBER_H
+
+#include <string>
+
+// Whether a cell value is a number as a whole, like "12", "-0.5" or "1e3".
+// Values that parse to infinity or NaN, like "inf", "nan" or "1e999", are
+// text: they would break the ordering of sorts and filter indexes and turn
+// every sum they are part of into inf or nan.
+bool ParseCellNumber(
+    const std::string &value,
+    double &out);
+
+#endif // CELLNUMBER_H
@@ -0,0 +1,248 @@
+#ifndef CELLSTORE_H
+#define CELLSTORE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+// Stored cells of a block of ChunkRows rows by ChunkCols columns, sorted by
+// their offset within the block. A chunk is never changed once it is part of
+// a published version; writers copy it.
+struct CellChunk
+{
+    struct Entry
+    {
+        // Row within the chunk times ChunkCols plus the column within it
+        uint16_t offset;
+        std::string value;
+    };
+
+    CellChunk() = default;
+
+    // Copies everything but the read mark
+    CellChunk(
+        const CellChunk &other);
+
+    // Version of the commit that last wrote the chunk
+    uint64_t version = 0;
+    std::vector<Entry> entries;
+
+    // A cold chunk holds its entries block compressed here instead, and
+    // 'entries' is empty. See CellStore::Compact.
+    std::vector<char> packed;
+    uint32_t packedEntries = 0;
+    uint32_t unpackedSize = 0;
+
+    // Heap and object bytes, measured when the chunk is published
+    size_t bytes = 0;
+
+    // Compaction epoch of the last read. Readers update it on a published
+    // chunk; it does not change what the chunk holds.
+    mutable std::atomic<uint32_t> touched{0};
+
+    bool IsPacked() const;
+
+    size_t MeasureBytes() const;
+};
+
+// One row of chunks, null where nothing is stored
+struct CellBand
+{
+    std::vector<std::shared_ptr<const CellChunk>> chunks;
+};
+
+class CellStore;
+
+// A committed version of all cells, bands indexed by row chunk
+struct CellTable
+{
+    uint64_t version = 0;
+    std::vector<std::shared_ptr<const CellBand>> bands;
+    const CellStore *store = nullptr;
+};
+
+// Read only view of one committed version. Taking one copies a pointer;
+// later commits never change what it shows, and it keeps the chunks it
+// references alive for as long as it exists.
+class CellSnapshot
+{
+public:
+    CellSnapshot();
+
+    uint64_t Version() const;
+
+    // nullptr for empty cells. Valid while the snapshot exists.
+    const std::string *Find(
+        int col,
+        int row) const;
+
+    // Version that last changed the chunk holding the cell, 0 if never
+    uint64_t ChunkVersion(
+        int col,
+        int row) const;
+
+    // Stored cells of an inclusive range, row by row
+    void ForEach(
+        int fromCol,
+        int fromRow,
+        int toCol,
+        int toRow,
+        const std::function<void(int col, int row, const std::string &value)> &callback) const;
+
+private:
+    friend class CellStore;
+
+    // Packed chunks this snapshot has read, unpacked once and kept for as
+    // long as the snapshot, so values found in them stay valid
+    struct UnpackedChunks
+    {
+        std::mutex mutex;
+        std::map<const CellChunk *, std::shared_ptr<const CellChunk>> chunks;
+    };
+
+    std::shared_ptr<const CellTable> _table;
+    std::shared_ptr<UnpackedChunks> _unpacked;
+
+    const CellChunk *Chunk(
+        int chunkCol,
+        int chunkRow) const;
+
+    const CellChunk *Unpacked(
+        const CellChunk &chunk) const;
+};
+
+// Changes made by one writer, invisible to readers until Commit publishes
+// them as a new version. Only the chunks that are written are copied. One
+// transaction is open at a time; beginning another waits for it.
+class CellTransaction
+{
+public:
+    CellTransaction(
+        CellTransaction &&) = default;
+
+    // Starts from an empty table instead of the current version
+    void Clear();
+
+    // An empty value removes the cell
+    void Set(
+        int col,
+        int row,
+        const std::string &value);
+
+    // Publishes the changes and ends the transaction. Dropping a transaction
+    // without committing discards its changes.
+    uint64_t Commit();
+
+private:
+    friend class CellStore;
+
+    using ChunkKey = std::pair<int, int>; // row chunk, column chunk
+
+    CellStore *_store;
+    std::unique_lock<std::mutex> _lock;
+    std::shared_ptr<const CellTable> _base;
+    std::map<ChunkKey, std::shared_ptr<CellChunk>> _dirty;
+    bool _cleared;
+
+    explicit CellTransaction(
+        CellStore &store);
+};
+
+struct CellStoreStats
+{
+    size_t chunks = 0;
+    size_t packedChunks = 0;
+
+    // Memory of the chunks kept as entries and of the packed ones
+    size_t unpackedBytes = 0;
+    size_t packedBytes = 0;
+
+    // What the packed chunks were before compression
+    size_t packedRawBytes = 0;
+
+    uint64_t unpacks = 0;
+    double unpackMicroseconds = 0.0;
+
+    double CompressionRatio() const;
+};
+
+// Multi version cell storage. Readers take snapshots without waiting for
+// writers; a commit builds the next version from copies of the chunks it
+// changed and the unchanged chunks of the previous version, then swaps it in.
+//
+// Over the memory budget, Compact packs the chunks read longest ago with
+// the block codec. Reading a packed chunk unpacks it for that snapshot and
+// marks it, and the next Compact keeps it unpacked again.
+class CellStore
+{
+public:
+    static constexpr int ChunkCols = 16;
+    static constexpr int ChunkRows = 256;
+
+    // Chunks read within this many epochs are hot
+    static constexpr uint32_t HotEpochs = 2;
+
+    CellStore();
+
+    CellSnapshot Snapshot() const;
+
+    CellTransaction Begin();
+
+    // Replaces the contents with the cells of one sheet
+    void Load(
+        sqlitelib::Sqlite &db,
+        int sheet);
+
+    // Adds the cells of storage rows [fromRow, toRow] of a sheet in one
+    // commit, read through the cells_by_row index
+    void LoadRows(
+        sqlitelib::Sqlite &db,
+        int sheet,
+        int fromRow,
+        int toRow);
+
+    // Bytes of unpacked and packed chunks together; 0 never packs
+    void SetMemoryBudget(
+        size_t bytes);
+
+    // Unpacks the chunks read since the last call and packs cold ones while
+    // over budget, at most 'maxPackBytes' of them per call, then starts the
+    // next epoch. Publishes a table with the same version and contents.
+    // Skipped while a transaction is open. Call regularly, e.g. each second.
+    void Compact(
+        size_t maxPackBytes = 32 * 1024 * 1024);
+
+    // As of the last Compact, plus the unpacks by readers since
+    CellStoreStats Stats() const;
+
+private:
+    friend class CellTransaction;
+    friend class CellSnapshot;
+
+    mutable std::mutex _mutex;
+    std::mutex _writeMutex;
+    std::shared_ptr<const CellTable> _current;
+
+    size_t _memoryBudget;
+    CellStoreStats _stats;
+    std::atomic<uint32_t> _epoch;
+    mutable std::atomic<uint64_t> _unpacks;
+    mutable std::atomic<uint64_t> _unpackNanoseconds;
+
+    void Publish(
+        std::shared_ptr<const CellTable> table);
+};
+
+#endif // CELLSTORE_H
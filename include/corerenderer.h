@@ -0,0 +1,126 @@
+#ifndef CORERENDERER_H
+#define CORERENDERER_H
+
+#include "renderer.h"
+
+#include <cstddef>
+#include <vector>
+
+// Renderer for OpenGL 3.3 core profile contexts. Rectangles, lines, glyphs
+// and tile copies are all instances of one unit quad, written into a ring
+// of instance buffer segments and drawn with one instanced draw call per
+// texture change, clip change or retained geometry draw. The instance buffer
+// is mapped persistently when the context supports buffer storage; each
+// segment is fenced after use and waited for before it is written again.
+// Without buffer storage instances are staged in memory and uploaded on
+// flush instead.
+class CoreRenderer : public Renderer
+{
+public:
+    CoreRenderer();
+
+    RendererKind Kind() const override;
+
+    const char *Name() const override;
+
+    bool Init(
+        GLADloadproc load) override;
+
+    void Release() override;
+
+    void EndFrame() override;
+
+    void FillRect(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        const glm::vec4 &color) override;
+
+    void DrawLine(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        const glm::vec4 &color) override;
+
+    void DrawTexture(
+        GLuint texture,
+        const TexturedQuad &quad) override;
+
+    void DrawGlyphs(
+        GLuint texture,
+        const TexturedQuad *quads,
+        size_t count,
+        const glm::vec4 &color,
+        float smoothing) override;
+
+    void DrawGeometry(
+        GLenum mode,
+        GLuint buffer,
+        const ColorVertex *vertices,
+        size_t count) override;
+
+    GLenum GlyphTextureFormat() const override;
+
+    void Flush() override;
+
+    bool IsPersistentlyMapped() const;
+
+protected:
+    void ApplyTarget() override;
+
+    void ApplyTransform() override;
+
+private:
+    enum QuadKind
+    {
+        Solid = 0,
+        Image = 1,
+        Glyph = 2,
+    };
+
+    struct QuadInstance
+    {
+        GLfloat rect[4];
+        GLfloat uv[4];
+        GLubyte color[4];
+        GLfloat kind;
+        GLfloat smoothing;
+    };
+
+    static constexpr size_t SegmentInstances = 16384;
+    static constexpr size_t SegmentCount = 3;
+
+    GLuint _quadProgram;
+    GLuint _geometryProgram;
+    GLint _quadProjectionLocation;
+    GLint _geometryProjectionLocation;
+    GLuint _quadVao;
+    GLuint _geometryVao;
+    GLuint _cornerBuffer;
+    GLuint _instanceBuffer;
+    QuadInstance *_mapped;
+    std::vector<QuadInstance> _staging;
+    bool _persistent;
+    GLsync _fences[SegmentCount];
+    size_t _segment;
+    size_t _used;
+    size_t _batchStart;
+    GLuint _batchTexture;
+
+    QuadInstance &AddInstance(
+        QuadKind kind,
+        GLuint texture,
+        const glm::vec4 &color);
+
+    void NextSegment();
+
+    // Pixel to clip space matrix of the current target, including the
+    // current transform when requested
+    void Projection(
+        bool withTransform,
+        GLfloat matrix[16]) const;
+};
+
+#endif // CORERENDERER_H
@@ -0,0 +1,69 @@
+#ifndef DELIMITED_H
+#define DELIMITED_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Writes delimited text (TSV, CSV) into one buffer. Fields holding the
+// separator, a quote or a line break are quoted with the quotes doubled.
+// Size a large output with FieldSize and Reserve first, so the buffer
+// grows once; streaming writers take Text and Clear it as it fills.
+class DelimitedWriter
+{
+public:
+    explicit DelimitedWriter(
+        char separator);
+
+    // Bytes Field adds for a value, without the separator before it
+    size_t FieldSize(
+        const std::string &value) const;
+
+    void Reserve(
+        size_t bytes);
+
+    void Field(
+        const std::string &value);
+
+    void EndLine();
+
+    const std::string &Text() const;
+
+    size_t Size() const;
+
+    // Keeps the capacity
+    void Clear();
+
+private:
+    char _separator;
+    std::string _buffer;
+    bool _lineStart;
+
+    bool NeedsQuotes(
+        const std::string &value) const;
+};
+
+// Splits delimited text into fields in one pass over the input. Fields are
+// handed out in a reused string, so parsing does not allocate once it has
+// seen the longest field. Takes \n and \r\n line ends; a line end at the
+// very end does not start another row.
+class DelimitedReader
+{
+public:
+    using Callback = std::function<void(int row, int col, const std::string &value)>;
+
+    explicit DelimitedReader(
+        char separator);
+
+    // Returns the number of rows
+    int Parse(
+        const char *text,
+        size_t size,
+        const Callback &callback);
+
+private:
+    char _separator;
+    std::string _field;
+};
+
+#endif // DELIMITED_H
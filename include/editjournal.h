@@ -0,0 +1,113 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+struct EditJournalStats
+{
+    uint64_t commits = 0;
+    uint64_t edits = 0;
+    uint64_t coalesced = 0;
+    uint64_t failures = 0;
+};
+
+// Collects writes to the cells, cols and rows tables in memory and flushes
+// them as one transaction once the oldest has waited for the flush interval
+// or enough have piled up. Writes to the same cell or size coalesce into one.
+//
+// Groups are committed in the order they were collected and every group is
+// all or nothing, so the database always holds a prefix of the edits in
+// order. Edits leave the journal only after their group committed; a failed
+// group is rolled back and retried whole.
+class EditJournal
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit EditJournal(
+        sqlitelib::Sqlite &db,
+        std::chrono::milliseconds flushInterval = std::chrono::milliseconds(250),
+        size_t maxPending = 4096);
+
+    // An empty value removes the cell
+    void SetCell(
+        int sheet,
+        int col,
+        int storageRow,
+        const std::string &value);
+
+    void SetColSize(
+        int sheet,
+        int col,
+        int delta);
+
+    void SetRowSize(
+        int sheet,
+        int row,
+        int delta);
+
+    // Flushes when the interval passed; call regularly
+    void Update();
+
+    // Writes everything pending now. Call before reading the tables with
+    // SQL; returns false when the group failed and stays pending.
+    bool Flush();
+
+    size_t PendingCount() const;
+
+    // Committed groups during the last second
+    double CommitsPerSecond() const;
+
+    const EditJournalStats &Stats() const;
+
+private:
+    enum class EditKind
+    {
+        Cell,
+        ColSize,
+        RowSize,
+    };
+
+    struct Edit
+    {
+        EditKind kind;
+        int sheet;
+        int index;
+        int row;
+        int size;
+        std::string value;
+    };
+
+    using EditKey = std::tuple<EditKind, int, int, int>;
+
+    sqlitelib::Sqlite &_db;
+    std::chrono::milliseconds _flushInterval;
+    size_t _maxPending;
+
+    // Each key is in the group once, at the place of its first write. Its
+    // position does not change the result, because a group commits at once.
+    std::vector<Edit> _edits;
+    std::map<EditKey, size_t> _positions;
+    Clock::time_point _oldest;
+
+    EditJournalStats _stats;
+    std::deque<Clock::time_point> _recentCommits;
+
+    void Add(
+        const EditKey &key,
+        Edit edit);
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,113 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+struct SortKey
+{
+    int col = 0;
+    bool descending = false;
+};
+
+// Shared between the sorting thread and the UI thread
+struct SortProgress
+{
+    std::atomic<int> permille{0};
+    std::atomic<bool> cancelRequested{false};
+    std::atomic<bool> finished{false};
+    std::atomic<bool> succeeded{false};
+
+    void Reset();
+};
+
+// Sorts the rows of one sheet by one or more columns with bounded
+// memory: rows are read in runs that fit the memory budget, each run is
+// sorted and spilled to a temporary file, and the runs are k-way merged into
+// a permutation of storage rows that backs a RowView. The cells table itself
+// is never rewritten.
+class ExternalSort
+{
+public:
+    ExternalSort(
+        sqlitelib::Sqlite &db,
+        int sheet,
+        const std::vector<SortKey> &keys,
+        size_t memoryBudget = 64 * 1024 * 1024);
+
+    bool Run(
+        SortProgress &progress,
+        std::vector<int32_t> &permutation);
+
+private:
+    enum KeyType : char
+    {
+        Number = 0,
+        Text = 1,
+        Empty = 2,
+    };
+
+    struct KeyValue
+    {
+        KeyType type = Empty;
+        double number = 0.0;
+        std::string text;
+    };
+
+    struct Record
+    {
+        int row = 0;
+        std::vector<KeyValue> keys;
+    };
+
+    struct SortedRun
+    {
+        FILE *file = nullptr;
+        long long count = 0;
+    };
+
+    sqlitelib::Sqlite &_db;
+    int _sheet;
+    std::vector<SortKey> _keys;
+    size_t _memoryBudget;
+    std::vector<SortedRun> _runs;
+
+    bool Less(
+        const Record &a,
+        const Record &b) const;
+
+    static KeyValue MakeKey(
+        const std::string &value);
+
+    static size_t RecordSize(
+        const Record &record);
+
+    void WriteRun(
+        std::vector<Record> &records);
+
+    static bool ReadRecord(
+        FILE *file,
+        size_t keyCount,
+        Record &record);
+
+    bool CreateRuns(
+        int rowCount,
+        SortProgress &progress);
+
+    bool MergeRuns(
+        int rowCount,
+        SortProgress &progress,
+        std::vector<int32_t> &permutation);
+
+    void CloseRuns();
+};
+
+#endif // EXTERNALSORT_H
@@ -0,0 +1,65 @@
+#ifndef FIND_H
+#define FIND_H
+
+#include <memory>
+#include <sqlitelib.h>
+#include <string>
+#include <vector>
+
+struct CellPosition
+{
+    int col = 0;
+    int row = 0;
+};
+
+// Ordered cursor over the cells of one sheet containing a search string, in
+// storage row-major order. Matches come from the cells_fts trigram index; queries
+// shorter than a trigram fall back to a LIKE scan. Results are stepped
+// lazily, visited results are kept so the cursor can also move backwards.
+class FindCursor
+{
+public:
+    FindCursor(
+        sqlitelib::Sqlite &db,
+        int sheet,
+        const std::string &query);
+
+    const std::string &Query() const;
+
+    // Moves to the first match after the given cell, wrapping around
+    bool NextAfter(
+        int col,
+        int row,
+        CellPosition &out);
+
+    // Moves to the last match before the given cell, wrapping around
+    bool PreviousBefore(
+        int col,
+        int row,
+        CellPosition &out);
+
+    // Index of the current match, counted from the first match
+    int CurrentIndex() const;
+
+    static bool HasFullTextIndex(
+        sqlitelib::Sqlite &db);
+
+private:
+    using MatchCursor = sqlitelib::Cursor<int, int>;
+    using MatchIterator = sqlitelib::Iterator<int, int>;
+
+    sqlitelib::Sqlite &_db;
+    int _sheet;
+    std::string _query;
+    std::unique_ptr<MatchCursor> _cursor;
+    MatchIterator _iterator;
+    bool _exhausted;
+    std::vector<CellPosition> _matches;
+    int _current;
+
+    void Open();
+
+    bool FetchNext();
+};
+
+#endif // FIND_H
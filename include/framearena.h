@@ -0,0 +1,95 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for temporaries that live for one frame. Allocations are
+// carved from one block and never freed on their own; Reset at the end of
+// the frame hands out the block from the start again. A frame that needs
+// more takes extra blocks from the heap, and the next Reset replaces them
+// all by a single block of the combined size, so a frame like the previous
+// one does not touch the heap.
+class FrameArena
+{
+public:
+    explicit FrameArena(
+        size_t blockSize = 64 * 1024);
+
+    FrameArena(const FrameArena &) = delete;
+
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *Allocate(
+        size_t size,
+        size_t alignment = alignof(std::max_align_t));
+
+    // Everything allocated since the last Reset becomes invalid
+    void Reset();
+
+    // Bytes handed out since the last Reset
+    size_t Used() const;
+
+    size_t Capacity() const;
+
+private:
+    std::unique_ptr<char[]> _block;
+    size_t _blockSize;
+    size_t _offset;
+    std::vector<std::unique_ptr<char[]>> _overflow;
+    size_t _overflowSize;
+    size_t _used;
+};
+
+// Standard allocator over a frame arena; deallocation is a no-op. Containers
+// using it must not outlive the frame.
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(
+        FrameArena &arena)
+        : arena(&arena)
+    {}
+
+    template <typename U>
+    ArenaAllocator(
+        const ArenaAllocator<U> &other)
+        : arena(other.arena)
+    {}
+
+    T *allocate(
+        size_t n)
+    {
+        return static_cast<T *>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(
+        T *,
+        size_t)
+    {}
+
+    template <typename U>
+    bool operator==(
+        const ArenaAllocator<U> &other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(
+        const ArenaAllocator<U> &other) const
+    {
+        return arena != other.arena;
+    }
+
+    FrameArena *arena;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // FRAMEARENA_H
@@ -0,0 +1,90 @@
+#ifndef GEOMETRYBUFFER_H
+#define GEOMETRYBUFFER_H
+
+#include "renderer.h"
+
+#include <cstddef>
+#include <vector>
+
+// Colored lines or triangles kept in a vertex buffer object. Vertices are
+// collected between Clear and the next Draw, which uploads them once; later
+// draws reuse the buffer with a single draw call until it is rebuilt.
+// Without vertex buffer objects the vertices are drawn from client memory,
+// where the renderer supports it.
+class GeometryBuffer
+{
+public:
+    // GL_LINES or GL_TRIANGLES
+    explicit GeometryBuffer(
+        GLenum mode);
+
+    void Clear();
+
+    void SetColor(
+        float r,
+        float g,
+        float b,
+        float a = 1.0f);
+
+    // Rectangles are cut to the clip rectangle, lines and triangles are not
+    void SetClip(
+        float x0,
+        float y0,
+        float x1,
+        float y1);
+
+    void ResetClip();
+
+    void AddLine(
+        float x0,
+        float y0,
+        float x1,
+        float y1);
+
+    // Vertices are given clockwise on screen, like the quads drawn elsewhere
+    void AddTriangle(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float x2,
+        float y2);
+
+    void AddRect(
+        float x0,
+        float y0,
+        float x1,
+        float y1);
+
+    // The border of a rectangle, 'thickness' pixels wide on the inside
+    void AddFrame(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        float thickness);
+
+    void Draw(
+        Renderer &renderer);
+
+    void Release();
+
+    size_t VertexCount() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    GLenum _mode;
+    GLuint _buffer;
+    std::vector<ColorVertex> _vertices;
+    GLubyte _color[4];
+    float _clip[4];
+    bool _clipped;
+    bool _uploaded;
+
+    void AddVertex(
+        float x,
+        float y);
+};
+
+#endif // GEOMETRYBUFFER_H
@@ -0,0 +1,112 @@
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Decodes one code point and advances 'it'. Invalid sequences decode to
+// U+FFFD, one byte at a time.
+uint32_t DecodeUtf8(
+    const char *&it,
+    const char *end);
+
+struct AtlasGlyph
+{
+    int page = -1; // -1 for glyphs without pixels, like space
+    float s0 = 0, t0 = 0, s1 = 0, t1 = 0;
+    int xoff = 0, yoff = 0;
+    int width = 0, height = 0;
+    float advance = 0;
+    unsigned int lastUsed = 0;
+};
+
+// Glyph cache over one or more fonts. Glyphs are rasterized as signed
+// distance fields with stb_truetype the first time they are asked for and
+// packed with stb_rect_pack into atlas pages, new pages are added as they
+// fill up. When the last page is full, the least recently used page is
+// cleared and its glyphs are rasterized again on their next use. Code points
+// missing from the first font are looked up in the fallback fonts.
+//
+// Glyph metrics are in atlas pixels at SdfPixelHeight. Text of any size is
+// drawn by scaling the quads; only the edge smoothing of the renderer's text
+// shader depends on the final scale.
+class GlyphAtlas
+{
+public:
+    static constexpr int PageSize = 512;
+    static constexpr int MaxPages = 8;
+    static constexpr float SdfPixelHeight = 32.0f;
+    static constexpr int SdfPadding = 4;
+
+    GlyphAtlas();
+
+    ~GlyphAtlas();
+
+    // The first font added is the primary one, later ones are fallbacks
+    bool AddFont(
+        const std::string &path);
+
+    bool HasFonts() const;
+
+    // Single channel pages are GL_ALPHA for fixed function drawing and
+    // GL_RED for core profiles. Call before the first glyph is added.
+    void SetTextureFormat(
+        GLenum format);
+
+    // Glyphs used since the last BeginFrame are never evicted
+    void BeginFrame();
+
+    // Needs a current GL context, as missing glyphs are uploaded right away.
+    // Returns nullptr when no font is loaded or no page could be freed.
+    const AtlasGlyph *Get(
+        uint32_t codepoint);
+
+    GLuint PageTexture(
+        int page) const;
+
+    // Width of the glyph edge in distance field values, smoothing it over
+    // about one screen pixel for glyphs drawn at the given number of screen
+    // pixels per atlas pixel
+    static float EdgeSmoothing(
+        float screenScale);
+
+    void Release();
+
+    size_t GlyphCount() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    struct Font;
+    struct Page;
+
+    std::vector<std::unique_ptr<Font>> _fonts;
+    std::vector<std::unique_ptr<Page>> _pages;
+    std::unordered_map<uint32_t, AtlasGlyph> _glyphs;
+    unsigned int _frame;
+    GLenum _textureFormat;
+
+    bool Pack(
+        int width,
+        int height,
+        int &page,
+        int &x,
+        int &y);
+
+    int AddPage();
+
+    void ClearPage(
+        int page);
+
+    bool Rasterize(
+        uint32_t codepoint,
+        AtlasGlyph &glyph);
+};
+
+#endif // GLYPHATLAS_H
@@ -0,0 +1,70 @@
+#ifndef HEADERLABELS_H
+#define HEADERLABELS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+class RowView;
+
+// Excel style letters of a 1 based column number: A, B, ..., Z, AA, ...
+std::string columnIndexToLetters(int n);
+
+// Labels of consecutive columns or rows, from 'first' on. Never changed once
+// built, so snapshots share it.
+struct LabelRange
+{
+    int first = 0;
+    std::vector<std::string> labels;
+
+    // nullptr outside the range
+    const std::string *Find(
+        int index) const;
+};
+
+// Column headers and row numbers around the visible part of the sheet.
+// Stored headers are read once per Load instead of per column and frame.
+// Ranges are built with a screen of margin on both sides and kept until a
+// request falls outside them, the headers are loaded again or the row view
+// changes, so a scroll of a few columns or rows builds nothing.
+class HeaderLabels
+{
+public:
+    // Reads the stored column headers of a sheet; call whenever the cols
+    // table is replaced
+    void Load(
+        sqlitelib::Sqlite &db,
+        int sheet);
+
+    // Stored header of a column, or its letters
+    std::string ColLabel(
+        int col) const;
+
+    // Covers at least columns [first, last]
+    std::shared_ptr<const LabelRange> Cols(
+        int first,
+        int last);
+
+    // Covers at least display rows [first, last] of the view. Rows show
+    // their storage row number, empty past the end of the view.
+    std::shared_ptr<const LabelRange> Rows(
+        const std::shared_ptr<const RowView> &view,
+        int first,
+        int last);
+
+private:
+    // By column, only columns with a non empty header
+    std::map<int, std::string> _headers;
+
+    std::shared_ptr<const LabelRange> _cols;
+    std::shared_ptr<const LabelRange> _rows;
+    std::shared_ptr<const RowView> _rowsView;
+};
+
+#endif // HEADERLABELS_H
@@ -0,0 +1,66 @@
+#ifndef LEGACYRENDERER_H
+#define LEGACYRENDERER_H
+
+#include "renderer.h"
+
+// Renderer for OpenGL 2.1 contexts, drawing with the fixed function
+// pipeline in immediate mode. Text uses a GLSL 1.20 distance field shader
+// when available and alpha testing otherwise.
+class LegacyRenderer : public Renderer
+{
+public:
+    LegacyRenderer();
+
+    RendererKind Kind() const override;
+
+    const char *Name() const override;
+
+    bool Init(
+        GLADloadproc load) override;
+
+    void Release() override;
+
+    void FillRect(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        const glm::vec4 &color) override;
+
+    void DrawLine(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        const glm::vec4 &color) override;
+
+    void DrawTexture(
+        GLuint texture,
+        const TexturedQuad &quad) override;
+
+    void DrawGlyphs(
+        GLuint texture,
+        const TexturedQuad *quads,
+        size_t count,
+        const glm::vec4 &color,
+        float smoothing) override;
+
+    void DrawGeometry(
+        GLenum mode,
+        GLuint buffer,
+        const ColorVertex *vertices,
+        size_t count) override;
+
+    GLenum GlyphTextureFormat() const override;
+
+protected:
+    void ApplyTarget() override;
+
+    void ApplyTransform() override;
+
+private:
+    GLuint _textProgram;
+    GLint _smoothingLocation;
+};
+
+#endif // LEGACYRENDERER_H
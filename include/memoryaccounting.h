@@ -0,0 +1,80 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Bytes held per category of data, as measured by callbacks of the owners.
+// Above the soft limit, Update evicts categories that can give memory back,
+// in the order they were registered, until the total is an eighth under the
+// limit, so caches growing back do not reach it again right away. Evicting
+// drops caches only; what they held is built again on use. When the
+// categories that cannot be evicted are over the limit by themselves,
+// nothing is evicted, as dropping the caches would not get under it and
+// they would only be rebuilt.
+class MemoryAccounting
+{
+public:
+    using Measure = std::function<size_t()>;
+    using Evict = std::function<void()>;
+
+    struct Category
+    {
+        std::string name;
+        size_t bytes = 0;
+        size_t peakBytes = 0;
+        size_t evictions = 0;
+        bool evictable = false;
+    };
+
+    MemoryAccounting();
+
+    // 0 never evicts
+    void SetSoftLimit(
+        size_t bytes);
+
+    size_t SoftLimit() const;
+
+    // Categories without an evict callback are only measured
+    void Register(
+        const std::string &name,
+        Measure measure,
+        Evict evict = nullptr);
+
+    // Measures every category, then evicts if over the soft limit. An
+    // evicted category counts as freed; an eviction that completes later,
+    // e.g. on another thread, shows in the measurements of the next Update.
+    // Returns the number of categories evicted.
+    int Update();
+
+    // As of the last Update
+    const std::vector<Category> &Categories() const;
+
+    size_t Total() const;
+
+    size_t PeakTotal() const;
+
+    // One line per category and a total, largest first
+    std::vector<std::string> Dump() const;
+
+private:
+    struct Source
+    {
+        Measure measure;
+        Evict evict;
+    };
+
+    size_t _softLimit;
+    std::vector<Category> _categories;
+    std::vector<Source> _sources;
+    size_t _total;
+    size_t _peakTotal;
+    bool _overLimit;
+
+    void MeasureCategory(
+        size_t i);
+};
+
+#endif // MEMORYACCOUNTING_H
@@ -0,0 +1,109 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+// Half open interval [begin, end) of occupied cells
+struct OccupancyRun
+{
+    int32_t begin;
+    int32_t end;
+};
+
+// Sorted, non-adjacent runs of occupied cells along one column or row. Data
+// edges are found with a binary search over the runs, so a dense column of
+// millions of rows costs one run.
+class OccupancyRuns
+{
+public:
+    // Adds a cell after all existing ones, used while building
+    void Append(
+        int32_t i);
+
+    void Set(
+        int32_t i);
+
+    void Reset(
+        int32_t i);
+
+    bool Test(
+        int32_t i) const;
+
+    // Ctrl+arrow target: the end of the run 'i' is in when its neighbour is
+    // occupied, otherwise the start of the next run. -1 when there is none.
+    int32_t NextEdge(
+        int32_t i) const;
+
+    int32_t PreviousEdge(
+        int32_t i) const;
+
+    // Last occupied cell, or -1
+    int32_t Last() const;
+
+    bool IsEmpty() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    std::vector<OccupancyRun> _runs;
+
+    // First run starting after 'i'
+    std::vector<OccupancyRun>::iterator UpperBound(
+        int32_t i);
+
+    std::vector<OccupancyRun>::const_iterator UpperBound(
+        int32_t i) const;
+};
+
+// Occupancy of one sheet of the cells table by column and by row, in storage
+// rows. Columns are built in one pass over the primary key; rows are built
+// when first asked for from the cells_by_row index and a bounded number is
+// cached.
+class OccupancyIndex
+{
+public:
+    void Build(
+        sqlitelib::Sqlite &db,
+        int sheet);
+
+    // Empties the index; rows asked for afterwards are read from 'sheet'
+    void Clear(
+        int sheet);
+
+    // Keeps the index in sync with a cell edit
+    void Update(
+        int col,
+        int row,
+        bool occupied);
+
+    const OccupancyRuns &Column(
+        int col) const;
+
+    const OccupancyRuns &Row(
+        sqlitelib::Sqlite &db,
+        int row);
+
+    // Last column or row holding data, or -1
+    int LastCol() const;
+
+    int LastRow() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    static constexpr size_t MaxCachedRows = 4096;
+
+    int _sheet = 0;
+    std::vector<OccupancyRuns> _cols;
+    std::map<int, OccupancyRuns> _rows;
+};
+
+#endif // OCCUPANCY_H
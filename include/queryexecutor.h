@@ -0,0 +1,149 @@
+#ifndef QUERYEXECUTOR_H
+#define QUERYEXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+// Thrown by the future of a query that was cancelled before it finished
+class QueryCancelled : public std::runtime_error
+{
+public:
+    QueryCancelled();
+};
+
+template <typename T>
+struct QueryHandle
+{
+    uint64_t id = 0;
+    std::future<T> result;
+
+    // Submitted and its result not taken yet
+    bool IsPending() const
+    {
+        return result.valid();
+    }
+
+    bool IsReady() const
+    {
+        return result.valid() && result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+};
+
+// Runs read queries on a pool of connections to the workbook, one worker
+// thread per connection, so long scans never block the input thread or each
+// other. The connections use shared cache with read_uncommitted, which
+// keeps them from taking table locks: they neither wait for the main
+// connection's writes nor block them, at the price of seeing uncommitted
+// rows of an import in progress.
+class QueryExecutor
+{
+public:
+    QueryExecutor();
+
+    ~QueryExecutor();
+
+    // 'uri' names a shared cache database, opened read only
+    bool Start(
+        const std::string &uri,
+        int connections);
+
+    // Cancels everything queued or running and joins the workers
+    void Stop();
+
+    template <typename T>
+    QueryHandle<T> Submit(
+        std::function<T(sqlitelib::Sqlite &db)> query);
+
+    // A queued query is dropped, a running one is interrupted with
+    // sqlite3_interrupt; either way its future throws QueryCancelled.
+    // Queries that already finished are not affected.
+    void Cancel(
+        uint64_t id);
+
+private:
+    // Called with nullptr when the query is cancelled before it starts
+    using Job = std::function<void(sqlitelib::Sqlite *db, const std::atomic<bool> &cancelled)>;
+
+    struct QueuedJob
+    {
+        uint64_t id;
+        Job run;
+    };
+
+    struct Worker
+    {
+        std::unique_ptr<sqlitelib::Sqlite> db;
+        std::thread thread;
+        uint64_t current = 0;
+        std::atomic<bool> cancelled{false};
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<QueuedJob> _queue;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    uint64_t _nextId;
+    bool _stopping;
+
+    uint64_t Enqueue(
+        Job job);
+
+    void Run(
+        Worker &worker);
+};
+
+template <typename T>
+QueryHandle<T> QueryExecutor::Submit(
+    std::function<T(sqlitelib::Sqlite &db)> query)
+{
+    auto promise = std::make_shared<std::promise<T>>();
+
+    QueryHandle<T> handle;
+    handle.result = promise->get_future();
+    handle.id = Enqueue([promise, query](sqlitelib::Sqlite *db, const std::atomic<bool> &cancelled) {
+        try
+        {
+            if (db == nullptr || cancelled)
+            {
+                throw QueryCancelled();
+            }
+
+            if constexpr (std::is_void<T>::value)
+            {
+                query(*db);
+                promise->set_value();
+            }
+            else
+            {
+                promise->set_value(query(*db));
+            }
+        }
+        catch (...)
+        {
+            // An interrupted statement throws whatever sqlitelib throws
+            promise->set_exception(cancelled ? std::make_exception_ptr(QueryCancelled()) : std::current_exception());
+        }
+    });
+
+    return handle;
+}
+
+#endif // QUERYEXECUTOR_H
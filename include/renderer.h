@@ -0,0 +1,165 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+// Vertex of retained lines and triangles, see GeometryBuffer
+struct ColorVertex
+{
+    GLfloat x, y;
+    GLubyte color[4];
+};
+
+// Screen rectangle with the texture rectangle mapped onto it
+struct TexturedQuad
+{
+    float x0, y0, x1, y1;
+    float s0, t0, s1, t1;
+};
+
+enum class RendererKind
+{
+    Legacy, // OpenGL 2.1 fixed function pipeline
+    Core,   // OpenGL 3.3 core profile
+};
+
+// Everything the application draws goes through a renderer. Coordinates are
+// pixels of the current target with y pointing down, transformed by the
+// current offset and scale. Renderers may batch draws, so direct GL calls in
+// between need a Flush first.
+class Renderer
+{
+public:
+    virtual ~Renderer();
+
+    virtual RendererKind Kind() const = 0;
+
+    virtual const char *Name() const = 0;
+
+    // Needs a current GL context of the kind the renderer was made for.
+    // Returns false when the context lacks what the renderer needs.
+    virtual bool Init(
+        GLADloadproc load) = 0;
+
+    virtual void Release() = 0;
+
+    // Draws into a framebuffer (0 for the window) until the matching
+    // EndTarget, which restores the previous target
+    void BeginTarget(
+        GLuint framebuffer,
+        int width,
+        int height);
+
+    void EndTarget();
+
+    // Ends the frame after the last EndTarget, before swapping buffers
+    virtual void EndFrame();
+
+    // Moves the origin to (x, y) of the current transform and scales
+    // everything drawn after it, until PopTransform
+    void PushTransform(
+        float x,
+        float y,
+        float scale);
+
+    void PopTransform();
+
+    // Pixels on the target per unit drawn
+    float Scale() const;
+
+    // Clip rectangle in target pixels, not affected by the transform
+    void SetClip(
+        int x,
+        int y,
+        int width,
+        int height);
+
+    void ResetClip();
+
+    virtual void FillRect(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        const glm::vec4 &color) = 0;
+
+    // Horizontal or vertical lines only
+    virtual void DrawLine(
+        float x0,
+        float y0,
+        float x1,
+        float y1,
+        const glm::vec4 &color) = 0;
+
+    // Copies an opaque RGBA texture, without blending
+    virtual void DrawTexture(
+        GLuint texture,
+        const TexturedQuad &quad) = 0;
+
+    // Draws glyphs from a distance field atlas page, 'smoothing' is the width
+    // of the edge in distance field values
+    virtual void DrawGlyphs(
+        GLuint texture,
+        const TexturedQuad *quads,
+        size_t count,
+        const glm::vec4 &color,
+        float smoothing) = 0;
+
+    // Draws retained lines or triangles from a vertex buffer, or from client
+    // memory when 'buffer' is 0 and the renderer supports it
+    virtual void DrawGeometry(
+        GLenum mode,
+        GLuint buffer,
+        const ColorVertex *vertices,
+        size_t count) = 0;
+
+    // Format of single channel glyph textures
+    virtual GLenum GlyphTextureFormat() const = 0;
+
+    virtual void Flush();
+
+    // Quads drawn since the last EndFrame, and the draw calls they took
+    size_t QuadCount() const;
+
+    size_t DrawCallCount() const;
+
+protected:
+    struct Target
+    {
+        GLuint framebuffer;
+        int width, height;
+    };
+
+    struct Transform
+    {
+        float x, y, scale;
+    };
+
+    std::vector<Target> _targets;
+    std::vector<Transform> _transforms;
+    size_t _quadCount = 0;
+    size_t _drawCallCount = 0;
+
+    const Transform &CurrentTransform() const;
+
+    // Called after the target or transform changed, pending draws are
+    // flushed before
+    virtual void ApplyTarget() = 0;
+
+    virtual void ApplyTransform() = 0;
+
+    static GLuint CompileProgram(
+        const char *vertexSource,
+        const char *fragmentSource,
+        const char *name);
+};
+
+std::unique_ptr<Renderer> CreateRenderer(
+    RendererKind kind);
+
+#endif // RENDERER_H
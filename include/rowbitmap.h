@@ -0,0 +1,64 @@
+#ifndef ROWBITMAP_H
+#define ROWBITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One bit per storage row, with a small rank directory so the n-th set row
+// (select) and the number of set rows before a row (rank) are found in
+// O(log n) without expanding the bitmap into a row list.
+class RowBitmap
+{
+public:
+    RowBitmap();
+
+    explicit RowBitmap(
+        int size,
+        bool value = false);
+
+    int Size() const;
+
+    void Set(
+        int row);
+
+    void Reset(
+        int row);
+
+    bool Test(
+        int row) const;
+
+    void And(
+        const RowBitmap &other);
+
+    void Invert();
+
+    // Builds the rank directory, call after the last modification
+    void Seal();
+
+    int Count() const;
+
+    int Rank(
+        int row) const;
+
+    int Select(
+        int n) const;
+
+    // Next set row at or after 'row', or -1
+    int NextSet(
+        int row) const;
+
+    size_t MemoryUsage() const;
+
+private:
+    static constexpr int WordsPerBlock = 8;
+
+    int _size;
+    std::vector<uint64_t> _words;
+    std::vector<int> _blockRanks;
+    int _count;
+
+    void ClearTail();
+};
+
+#endif // ROWBITMAP_H
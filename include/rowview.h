@@ -0,0 +1,59 @@
+#ifndef ROWVIEW_H
+#define ROWVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <rowbitmap.h>
+#include <string>
+#include <vector>
+
+// Maps display rows to storage rows. The identity view maps every row onto
+// itself and costs nothing; sorted views hold one 32 bit storage row index per
+// row they show, and filters over the natural order are a row bitmap that is
+// walked with rank/select. Any number of them can exist over the same cells
+// table without touching it.
+class RowView
+{
+public:
+    RowView();
+
+    RowView(
+        std::vector<int32_t> rows,
+        const std::string &description);
+
+    RowView(
+        RowBitmap filter,
+        const std::string &description);
+
+    bool IsIdentity() const;
+
+    // Filter bitmap for bitmap backed views, nullptr otherwise
+    const RowBitmap *Filter() const;
+
+    // Number of display rows, or -1 for the (unbounded) identity view
+    int RowCount() const;
+
+    // Returns -1 when the display row is past the end of the view
+    int ToStorage(
+        int displayRow) const;
+
+    // Returns -1 when the storage row is not part of the view
+    int ToDisplay(
+        int storageRow) const;
+
+    const std::vector<int32_t> &Rows() const;
+
+    const std::string &Description() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    bool _identity;
+    bool _isFilter;
+    RowBitmap _filter;
+    std::vector<int32_t> _rows;
+    mutable std::vector<int32_t> _inverse;
+    std::string _description;
+};
+
+#endif // ROWVIEW_H
@@ -0,0 +1,135 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+class RowView;
+
+// Inclusive rectangle of cells. Entire columns/rows are expressed by using
+// MaxCellIndex as the far edge, so selecting a whole column costs the same as
+// selecting a single cell.
+struct CellRange
+{
+    static constexpr int MaxCellIndex = std::numeric_limits<int>::max();
+
+    int fromCol = 0;
+    int fromRow = 0;
+    int toCol = 0;
+    int toRow = 0;
+
+    static CellRange FromCorners(
+        int col1,
+        int row1,
+        int col2,
+        int row2);
+
+    bool Contains(
+        int col,
+        int row) const;
+
+    bool Intersects(
+        const CellRange &other) const;
+
+    bool IntersectWith(
+        const CellRange &other,
+        CellRange &out) const;
+
+    bool IsEntireColumn() const;
+
+    bool IsEntireRow() const;
+};
+
+struct SelectionAggregate
+{
+    long long count = 0;
+    long long numericCount = 0;
+    double sum = 0.0;
+};
+
+// The selection is a short list of rectangles plus an anchor, never a set of
+// cells. The last range is the one shift+arrow/shift+click extends.
+class Selection
+{
+public:
+    Selection();
+
+    void Set(
+        int col,
+        int row);
+
+    void ExtendTo(
+        int col,
+        int row);
+
+    void Add(
+        int col,
+        int row);
+
+    void SelectColumns(
+        int fromCol,
+        int toCol,
+        bool add);
+
+    void SelectRows(
+        int fromRow,
+        int toRow,
+        bool add);
+
+    bool Contains(
+        int col,
+        int row) const;
+
+    bool IsSingleCell() const;
+
+    CellRange Bounds() const;
+
+    const std::vector<CellRange> &Ranges() const;
+
+    // Ranges split into non-overlapping pieces, so streaming consumers never
+    // visit a cell twice.
+    std::vector<CellRange> DisjointRanges() const;
+
+    // Ranges clipped to the visible window; cost depends on the number of
+    // ranges, not on their size.
+    std::vector<CellRange> Clip(
+        const CellRange &visible) const;
+
+    int AnchorCol() const;
+
+    int AnchorRow() const;
+
+    unsigned int Version() const;
+
+private:
+    std::vector<CellRange> _ranges;
+    int _anchorCol = 0;
+    int _anchorRow = 0;
+    unsigned int _version = 0;
+};
+
+// Streams all stored cells inside the selection in row-major order per range,
+// without materializing them. Selection rows are display rows of the view and
+// are reported as such. Each range is one scan over the storage rows it
+// spans; in sorted views its cells therefore come in storage row order.
+void StreamSelection(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const Selection &selection,
+    const RowView &view,
+    std::function<void(int col, int row, const std::string &value)> callback);
+
+SelectionAggregate AggregateSelection(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const Selection &selection,
+    const RowView &view);
+
+#endif // SELECTION_H
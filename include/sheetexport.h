@@ -0,0 +1,41 @@
+#ifndef SHEETEXPORT_H
+#define SHEETEXPORT_H
+
+#include <cstdint>
+#include <string>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+struct ExportStats
+{
+    int64_t rows = 0;
+    int64_t cells = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+
+    double MegabytesPerSecond() const;
+};
+
+// Writes one sheet as delimited text in row-major order, read from one
+// ordered cursor over the cells_by_row index. Missing cells become empty
+// fields and every row is padded to the widest column; the column headers
+// of an imported file are the first line. Memory use is the write buffer,
+// whatever the size of the sheet.
+//
+// The text goes to '<filename>.part' first and replaces the file only when
+// complete. Errors of the database, like an interrupt, are thrown.
+bool ExportDelimited(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const std::string &filename,
+    char separator,
+    ExportStats &stats);
+
+// Tab for .tsv and .tab files, comma otherwise
+char SeparatorForFile(
+    const std::string &filename);
+
+#endif // SHEETEXPORT_H
@@ -0,0 +1,78 @@
+#ifndef SHEETLAYOUT_H
+#define SHEETLAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+// Pixel positions along one axis of the sheet. Every column or row has the
+// default size unless it has a size delta, as stored in the cols and rows
+// tables. Only the deltas are kept, with their prefix sums, so positions and
+// hit tests are a binary search over the resized columns or rows instead of
+// a walk from the first one.
+class AxisLayout
+{
+public:
+    explicit AxisLayout(
+        int defaultSize);
+
+    void Clear();
+
+    // Replaces all deltas at once; 'deltas' must be sorted by index
+    void Assign(
+        std::vector<std::pair<int, int>> deltas);
+
+    void SetDelta(
+        int index,
+        int delta);
+
+    int Size(
+        int index) const;
+
+    // Pixel offset of the start of a column or row
+    int64_t Start(
+        int index) const;
+
+    // Column or row under a pixel offset
+    int IndexAt(
+        int64_t pixel) const;
+
+    // Changes whenever a size changes
+    unsigned int Version() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    int _defaultSize;
+    unsigned int _version;
+    std::vector<std::pair<int, int>> _deltas;
+    std::vector<int64_t> _prefix;
+
+    void UpdatePrefix();
+};
+
+class SheetLayout
+{
+public:
+    SheetLayout(
+        int defaultColWidth,
+        int defaultRowHeight);
+
+    // Reads the sizes of one sheet
+    void Load(
+        sqlitelib::Sqlite &db,
+        int sheet);
+
+    size_t MemoryUsage() const;
+
+    AxisLayout cols;
+    AxisLayout rows;
+};
+
+#endif // SHEETLAYOUT_H
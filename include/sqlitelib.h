@@ -284,6 +284,14 @@ class Sqlite {
     }
   }
 
+  Sqlite(const char* path, int flags) : db_(nullptr) {
+    auto rc = sqlite3_open_v2(path, &db_, flags, nullptr);
+    if (rc) {
+      sqlite3_close(db_);
+      db_ = nullptr;
+    }
+  }
+
   Sqlite(Sqlite&& rhs) : db_(rhs.db_) {}
 
   ~Sqlite() {
@@ -331,6 +339,18 @@ class Sqlite {
       return sqlite3_errmsg(db_);
   }
 
+  // Safe to call from another thread
+  void interrupt() {
+      sqlite3_interrupt(db_);
+  }
+
+  // Heap held by SQLite for the whole process, page caches included
+  static sqlite3_int64 memory_used() {
+      sqlite3_int64 current = 0, highwater = 0;
+      sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &current, &highwater, 0);
+      return current;
+  }
+
  private:
   sqlite3* db_;
 };
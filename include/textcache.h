@@ -0,0 +1,72 @@
+#ifndef TEXTCACHE_H
+#define TEXTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GlyphAtlas;
+
+// A string laid out at one font size: the code point of every glyph and the
+// pen position before it, with one extra position holding the total width.
+// Code point 0 marks glyphs that only advance, like tabs.
+struct TextRun
+{
+    std::vector<uint32_t> codepoints;
+    std::vector<float> positions;
+    float width = 0;
+
+    // Number of leading glyphs that fit within maxWidth
+    size_t Fit(
+        float maxWidth) const;
+};
+
+// Least recently used cache of laid out strings, keyed by string and font
+// size, so headers, row numbers and cell values are measured once instead
+// of on every frame.
+class TextCache
+{
+public:
+    TextCache(
+        GlyphAtlas &atlas,
+        size_t capacity = 8192);
+
+    const TextRun &Get(
+        const std::string &text,
+        float size);
+
+    void Clear();
+
+    size_t Count() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    struct Entry
+    {
+        std::string key;
+        TextRun run;
+    };
+
+    GlyphAtlas &_atlas;
+    size_t _capacity;
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+
+    // Reused for lookups, so a hit allocates nothing
+    std::string _key;
+
+    const std::string &Key(
+        const std::string &text,
+        float size);
+
+    bool Layout(
+        const std::string &text,
+        float size,
+        TextRun &run);
+};
+
+#endif // TEXTCACHE_H
@@ -0,0 +1,100 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include "renderer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Fixed size tiles of the cell area, rasterized once into offscreen textures
+// and composited with the scroll offset every frame. Tiles are re-rendered
+// only after they are invalidated. Without framebuffer objects the tiles are
+// drawn directly each frame, clipped to their rectangle.
+class TileCache
+{
+public:
+    static constexpr int TileSize = 256;
+
+    // Draws the content of one tile. The origin is the sheet pixel position
+    // of the tile's top left corner, content is drawn relative to it.
+    using RenderFunction = std::function<void(int64_t originX, int64_t originY, int size)>;
+
+    // Tile column and row, the tile's origin divided by TileSize
+    using TileKey = std::pair<int64_t, int64_t>;
+
+    // Tiles overlapping a sheet pixel rectangle, the ones Draw uses for the
+    // same rectangle
+    static std::vector<TileKey> TilesOverlapping(
+        int64_t x0,
+        int64_t y0,
+        int64_t x1,
+        int64_t y1);
+
+    TileCache();
+
+    // Call after the renderer is initialized
+    void Init(
+        Renderer &renderer);
+
+    void Release();
+
+    bool IsOffscreen() const;
+
+    // Draws the sheet area starting at sheet pixel (scrollX, scrollY) into the
+    // screen rectangle (x, y, width, height)
+    void Draw(
+        int64_t scrollX,
+        int64_t scrollY,
+        int x,
+        int y,
+        int width,
+        int height,
+        const RenderFunction &render);
+
+    void Invalidate();
+
+    // Invalidates every tile and deletes the textures kept for reuse
+    void Trim();
+
+    // Invalidates the tiles overlapping a sheet pixel rectangle
+    void InvalidateRect(
+        int64_t x0,
+        int64_t y0,
+        int64_t x1,
+        int64_t y1);
+
+    size_t TileCount() const;
+
+    size_t MemoryUsage() const;
+
+private:
+    struct Tile
+    {
+        GLuint texture = 0;
+        unsigned int lastUsed = 0;
+    };
+
+    static constexpr size_t MaxTiles = 96;
+
+    std::map<TileKey, Tile> _tiles;
+    std::vector<GLuint> _freeTextures;
+    Renderer *_renderer;
+    GLuint _framebuffer;
+    unsigned int _frame;
+    bool _offscreen;
+
+    GLuint AcquireTexture();
+
+    void EvictUnused();
+
+    void RenderTile(
+        const TileKey &key,
+        GLuint texture,
+        const RenderFunction &render);
+};
+
+#endif // TILECACHE_H
@@ -0,0 +1,173 @@
+#ifndef UNDOLOG_H
+#define UNDOLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+class RowView;
+
+// The cell changes of one operation, the value before and after for every
+// cell. Positions are stored as differences to the previous cell and all
+// numbers as variable length integers, so a pasted range costs about two
+// bytes per cell on top of its text. Cells are cut into segments that are
+// spilled and loaded one at a time. A cell is added at most once.
+class CellDeltas
+{
+public:
+    static constexpr size_t SegmentCells = 65536;
+
+    using Callback = std::function<void(int col, int row, const std::string &value)>;
+
+    CellDeltas();
+
+    void Add(
+        int col,
+        int row,
+        const std::string &before,
+        const std::string &after);
+
+    size_t Count() const;
+
+    size_t MemoryUsage() const;
+
+    // Calls back with the before or after value of every cell in a segment
+    static void Decode(
+        const std::vector<char> &segment,
+        bool after,
+        const Callback &callback);
+
+private:
+    friend class UndoLog;
+
+    std::vector<std::vector<char>> _segments;
+    size_t _count;
+    size_t _segmentCount;
+    int _previousCol;
+    int _previousRow;
+};
+
+enum class UndoKind
+{
+    Cells,
+    ColSize,
+    RowSize,
+    View,
+};
+
+struct UndoRecord
+{
+    UndoKind kind = UndoKind::Cells;
+    std::string description;
+
+    // Sheet the operation changed
+    int sheet = 0;
+
+    // ColSize and RowSize: the size delta of column or row 'index'
+    int index = 0;
+    int before = 0;
+    int after = 0;
+
+    // View: the view the operation added. A sort is undone by dropping its
+    // view, so the record only references the permutation.
+    std::shared_ptr<const RowView> view;
+};
+
+// Undo and redo lists of operations. Cell deltas are kept in memory up to
+// a budget; beyond it the oldest are spilled to the undo_segments table of
+// the workbook and read back a segment at a time when they are applied.
+class UndoLog
+{
+public:
+    explicit UndoLog(
+        sqlitelib::Sqlite &db,
+        size_t memoryBudget = 64 * 1024 * 1024,
+        size_t maxRecords = 1000);
+
+    // Every new operation clears the redo list
+    void PushCells(
+        int sheet,
+        const std::string &description,
+        CellDeltas deltas);
+
+    void PushSize(
+        int sheet,
+        UndoKind kind,
+        int index,
+        int before,
+        int after);
+
+    void PushView(
+        int sheet,
+        const std::string &description,
+        std::shared_ptr<const RowView> view);
+
+    bool CanUndo() const;
+
+    bool CanRedo() const;
+
+    // Sheet of the operation Undo or Redo applies next, -1 if there is none
+    int NextSheet(
+        bool redo) const;
+
+    // Moves the latest operation to the redo list. Cell records call back
+    // with the values to restore, all records are returned in 'record'.
+    bool Undo(
+        UndoRecord &record,
+        const CellDeltas::Callback &setCell);
+
+    bool Redo(
+        UndoRecord &record,
+        const CellDeltas::Callback &setCell);
+
+    size_t MemoryUsage() const;
+
+    size_t SpilledBytes() const;
+
+private:
+    struct Entry
+    {
+        UndoRecord record;
+        CellDeltas deltas;
+        int id = 0;
+        size_t segmentCount = 0;
+        size_t spilledBytes = 0;
+        bool spilled = false;
+    };
+
+    sqlitelib::Sqlite &_db;
+    size_t _memoryBudget;
+    size_t _maxRecords;
+    std::deque<Entry> _undo;
+    std::vector<Entry> _redo;
+    int _nextId;
+    size_t _memoryUsage;
+    size_t _spilledBytes;
+
+    void Push(
+        Entry entry);
+
+    void Spill(
+        Entry &entry);
+
+    void Drop(
+        Entry &entry);
+
+    void EnforceBudget();
+
+    void Apply(
+        const Entry &entry,
+        bool after,
+        const CellDeltas::Callback &setCell);
+};
+
+#endif // UNDOLOG_H
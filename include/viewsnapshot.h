@@ -0,0 +1,127 @@
+#ifndef VIEWSNAPSHOT_H
+#define VIEWSNAPSHOT_H
+
+#include "headerlabels.h"
+#include "rowview.h"
+#include "selection.h"
+#include "sheetlayout.h"
+#include "tilecache.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Column, display row and value of the stored cells inside one tile
+using TileCells = std::vector<std::tuple<int, int, std::string>>;
+
+// Tiles to render again, in zoomed sheet pixels
+struct TileInvalidations
+{
+    struct Rect
+    {
+        int64_t x0;
+        int64_t y0;
+        int64_t x1;
+        int64_t y1;
+    };
+
+    bool all = false;
+    std::vector<Rect> rects;
+
+    void Merge(
+        const TileInvalidations &other);
+};
+
+// Everything needed to draw one frame, taken from the model by the input
+// thread. Once published it is never changed, so the render thread reads it
+// without locking. Layouts, row views and tile cells are shared between
+// snapshots until they change.
+struct ViewSnapshot
+{
+    int width = 0;
+    int height = 0;
+    double scrollX = 0;
+    double scrollY = 0;
+    double zoom = 1.0;
+    int scrollCols = 0;
+    int scrollRows = 0;
+    int activeCol = 0;
+    int activeRow = 0;
+
+    std::shared_ptr<const SheetLayout> layout;
+    std::shared_ptr<const RowView> rowView;
+    Selection selection;
+    unsigned int autoFilterVersion = 0;
+
+    // Labels covering at least every column and row on screen, shared
+    // between snapshots until the view scrolls past them
+    std::shared_ptr<const LabelRange> colLabels;
+    std::shared_ptr<const LabelRange> rowLabels;
+
+    // Filter state from scrollCols on, for every column on screen
+    std::vector<bool> colFiltered;
+
+    bool inputActive = false;
+    std::string inputPrompt;
+    std::string inputText;
+    std::string activeValue;
+    std::vector<std::string> statusTexts;
+
+    // Titles of the sheet tabs, shared until a sheet is added, and the tab
+    // of the active sheet
+    std::shared_ptr<const std::vector<std::string>> sheetTitles;
+    int activeSheetTab = 0;
+
+    // Memory per category, empty unless the overlay is shown
+    std::vector<std::string> memoryTexts;
+
+    int colDraggingX = -1;
+    int rowDraggingY = -1;
+
+    // Cells of every tile overlapping the cell area
+    std::map<TileCache::TileKey, std::shared_ptr<const TileCells>> tiles;
+};
+
+// Double buffered snapshots. The input thread fills the back snapshot and
+// publishes it as the new front one; the render thread takes the front
+// snapshot at the start of a frame and keeps it alive until the next frame,
+// so publishing never waits for drawing. Tile invalidations are queued with
+// the snapshot holding the new cell values and handed to the render thread
+// together with it, also when it skips snapshots.
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer();
+
+    // Input thread
+    ViewSnapshot &Back();
+
+    void InvalidateAll();
+
+    void InvalidateRect(
+        int64_t x0,
+        int64_t y0,
+        int64_t x1,
+        int64_t y1);
+
+    void Publish();
+
+    // Render thread. Returns nullptr until the first publish; 'invalidations'
+    // receives everything queued since the previous call.
+    std::shared_ptr<const ViewSnapshot> Acquire(
+        TileInvalidations &invalidations);
+
+private:
+    ViewSnapshot _back;
+    TileInvalidations _backInvalidations;
+
+    std::mutex _mutex;
+    std::shared_ptr<const ViewSnapshot> _front;
+    TileInvalidations _pendingInvalidations;
+};
+
+#endif // VIEWSNAPSHOT_H
@@ -0,0 +1,162 @@
+#ifndef WORKBOOKFILE_H
+#define WORKBOOKFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace sqlitelib
+{
+    class Sqlite;
+}
+
+struct ExportStats;
+
+// Native workbook file (.pcw), laid out for memory mapping:
+//
+//   header    magic "PCWB", version
+//   chunks    per column, rows [k * ChunkRows, (k + 1) * ChunkRows): the row
+//             offsets (uint16), value types (uint8) and values (uint64)
+//   strings   offsets (uint64, count + 1) into the bytes of all strings
+//   columns   (sheet, col, chunk count, offset of its chunk entries)
+//   cols/rows the layout tables: index, size, header string, sheet
+//   sheets    id, title string
+//   footer    offsets and counts of the above, version, magic
+//
+// Values are integers and reals when their text is exactly what formatting
+// the number gives, so they read back unchanged; everything else is an
+// index into the string dictionary, which holds each text once. All
+// numbers are little endian and sections are 8 byte aligned.
+class WorkbookFile
+{
+public:
+    static constexpr uint32_t Version = 1;
+    static constexpr int ChunkRows = 65536;
+    static constexpr uint32_t NoString = 0xFFFFFFFF;
+    static constexpr const char *Extension = ".pcw";
+
+    struct LayoutEntry
+    {
+        int32_t index;
+        int32_t size;
+        uint32_t header;
+
+        // Zero in files written before sheets had their own layout, which
+        // is the first sheet
+        int32_t sheet;
+    };
+
+    struct SheetEntry
+    {
+        int32_t id;
+        uint32_t title;
+    };
+
+    using CellCallback = std::function<void(int sheet, int col, int row, const std::string &value)>;
+
+    WorkbookFile();
+
+    ~WorkbookFile();
+
+    WorkbookFile(const WorkbookFile &) = delete;
+
+    WorkbookFile &operator=(const WorkbookFile &) = delete;
+
+    // Maps the file and checks the footer and directories. Cell chunks are
+    // not read, their pages are faulted in when a range reaches them.
+    bool Open(
+        const std::string &path);
+
+    void Close();
+
+    bool IsOpen() const;
+
+    uint64_t CellCount() const;
+
+    // Cells inside the range of one sheet, column by column, each in row
+    // order. Only the chunks overlapping the range are touched.
+    void ForEach(
+        int sheet,
+        int fromCol,
+        int fromRow,
+        int toCol,
+        int toRow,
+        const CellCallback &callback) const;
+
+    // Every cell of every sheet
+    void ForEachCell(
+        const CellCallback &callback) const;
+
+    // Last row holding a cell in the sheet, or -1. Reads the last chunk of
+    // each of its columns.
+    int LastRow(
+        int sheet) const;
+
+    std::string String(
+        uint32_t index) const;
+
+    size_t ColCount() const;
+
+    const LayoutEntry &Col(
+        size_t i) const;
+
+    size_t RowCount() const;
+
+    const LayoutEntry &Row(
+        size_t i) const;
+
+    size_t SheetCount() const;
+
+    const SheetEntry &Sheet(
+        size_t i) const;
+
+    // Replaces the cols, rows and sheets tables with those of the file and
+    // empties the cells table, in one transaction
+    bool LoadLayoutInto(
+        sqlitelib::Sqlite &db) const;
+
+    // Fills the cells table emptied by LoadLayoutInto, in one transaction.
+    // 'progress' gets the number of cells inserted so far now and then.
+    bool LoadCellsInto(
+        sqlitelib::Sqlite &db,
+        const std::function<void(uint64_t cells)> &progress) const;
+
+    // Writes the cells, cols, rows and sheets tables. The file is written as
+    // '<path>.part' and replaces 'path' when complete. Errors of the
+    // database, like an interrupt, are thrown.
+    static bool Save(
+        sqlitelib::Sqlite &db,
+        const std::string &path,
+        ExportStats &stats);
+
+private:
+    struct Footer;
+    struct ColumnEntry;
+    struct ChunkEntry;
+
+    const uint8_t *_data;
+    size_t _size;
+    const Footer *_footer;
+    const ColumnEntry *_columns;
+    const uint64_t *_stringOffsets;
+    const LayoutEntry *_cols;
+    const LayoutEntry *_rows;
+    const SheetEntry *_sheets;
+
+    // Platform handles of the mapping
+    void *_file;
+    void *_mapping;
+
+    bool InBounds(
+        uint64_t offset,
+        uint64_t size) const;
+
+    void ForEachInColumn(
+        const ColumnEntry &column,
+        int fromRow,
+        int toRow,
+        const CellCallback &callback) const;
+};
+
+#endif // WORKBOOKFILE_H
@@ -0,0 +1,250 @@
+#include "legacyrenderer.h"
+
+#include <cstddef>
+
+static const char *textVertexShader = R"(
+#version 120
+void main()
+{
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+    gl_FrontColor = gl_Color;
+    gl_Position = ftransform();
+}
+)";
+
+static const char *textFragmentShader = R"(
+#version 120
+uniform sampler2D atlas;
+uniform float smoothing;
+void main()
+{
+    float value = texture2D(atlas, gl_TexCoord[0].st).a;
+    float alpha = smoothstep(0.5 - smoothing, 0.5 + smoothing, value);
+    gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * alpha);
+}
+)";
+
+LegacyRenderer::LegacyRenderer()
+    : _textProgram(0),
+      _smoothingLocation(-1)
+{}
+
+RendererKind LegacyRenderer::Kind() const
+{
+    return RendererKind::Legacy;
+}
+
+const char *LegacyRenderer::Name() const
+{
+    return "legacy";
+}
+
+bool LegacyRenderer::Init(
+    GLADloadproc load)
+{
+    (void)load;
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    if (GLAD_GL_VERSION_2_0)
+    {
+        _textProgram = CompileProgram(textVertexShader, textFragmentShader, "text");
+    }
+
+    if (_textProgram != 0)
+    {
+        _smoothingLocation = glGetUniformLocation(_textProgram, "smoothing");
+
+        glUseProgram(_textProgram);
+        glUniform1i(glGetUniformLocation(_textProgram, "atlas"), 0);
+        glUseProgram(0);
+    }
+
+    return true;
+}
+
+void LegacyRenderer::Release()
+{
+    if (_textProgram != 0)
+    {
+        glDeleteProgram(_textProgram);
+        _textProgram = 0;
+    }
+}
+
+void LegacyRenderer::ApplyTarget()
+{
+    auto const &target = _targets.back();
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, target.width, target.height, 0, -1.0f, 1.0f);
+
+    glMatrixMode(GL_MODELVIEW);
+}
+
+void LegacyRenderer::ApplyTransform()
+{
+    auto const &transform = CurrentTransform();
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(transform.x, transform.y, 0.0f);
+    glScalef(transform.scale, transform.scale, 1.0f);
+}
+
+void LegacyRenderer::FillRect(
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    const glm::vec4 &color)
+{
+    glBegin(GL_QUADS);
+    glColor4f(color.r, color.g, color.b, color.a);
+    glVertex2f(x0, y0);
+    glVertex2f(x1, y0);
+    glVertex2f(x1, y1);
+    glVertex2f(x0, y1);
+    glEnd();
+
+    _quadCount++;
+    _drawCallCount++;
+}
+
+void LegacyRenderer::DrawLine(
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    const glm::vec4 &color)
+{
+    glBegin(GL_LINES);
+    glColor4f(color.r, color.g, color.b, color.a);
+    glVertex2f(x0, y0);
+    glVertex2f(x1, y1);
+    glEnd();
+
+    _quadCount++;
+    _drawCallCount++;
+}
+
+void LegacyRenderer::DrawTexture(
+    GLuint texture,
+    const TexturedQuad &quad)
+{
+    glDisable(GL_BLEND);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glBegin(GL_QUADS);
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+    glTexCoord2f(quad.s0, quad.t0);
+    glVertex2f(quad.x0, quad.y0);
+    glTexCoord2f(quad.s1, quad.t0);
+    glVertex2f(quad.x1, quad.y0);
+    glTexCoord2f(quad.s1, quad.t1);
+    glVertex2f(quad.x1, quad.y1);
+    glTexCoord2f(quad.s0, quad.t1);
+    glVertex2f(quad.x0, quad.y1);
+    glEnd();
+
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+
+    _quadCount++;
+    _drawCallCount++;
+}
+
+void LegacyRenderer::DrawGlyphs(
+    GLuint texture,
+    const TexturedQuad *quads,
+    size_t count,
+    const glm::vec4 &color,
+    float smoothing)
+{
+    if (_textProgram != 0)
+    {
+        glUseProgram(_textProgram);
+        glUniform1f(_smoothingLocation, smoothing);
+    }
+    else
+    {
+        glEnable(GL_ALPHA_TEST);
+        glAlphaFunc(GL_GEQUAL, 0.5f);
+    }
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glBegin(GL_QUADS);
+    glColor4f(color.r, color.g, color.b, color.a);
+    for (size_t i = 0; i < count; i++)
+    {
+        auto const &quad = quads[i];
+
+        glTexCoord2f(quad.s0, quad.t0);
+        glVertex2f(quad.x0, quad.y0);
+        glTexCoord2f(quad.s1, quad.t0);
+        glVertex2f(quad.x1, quad.y0);
+        glTexCoord2f(quad.s1, quad.t1);
+        glVertex2f(quad.x1, quad.y1);
+        glTexCoord2f(quad.s0, quad.t1);
+        glVertex2f(quad.x0, quad.y1);
+    }
+    glEnd();
+
+    glDisable(GL_TEXTURE_2D);
+
+    if (_textProgram != 0)
+    {
+        glUseProgram(0);
+    }
+    else
+    {
+        glDisable(GL_ALPHA_TEST);
+    }
+
+    _quadCount += count;
+    _drawCallCount++;
+}
+
+void LegacyRenderer::DrawGeometry(
+    GLenum mode,
+    GLuint buffer,
+    const ColorVertex *vertices,
+    size_t count)
+{
+    const GLubyte *base = reinterpret_cast<const GLubyte *>(vertices);
+    if (buffer != 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        base = nullptr;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(ColorVertex), base + offsetof(ColorVertex, x));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ColorVertex), base + offsetof(ColorVertex, color));
+
+    glDrawArrays(mode, 0, GLsizei(count));
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    if (buffer != 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    _drawCallCount++;
+}
+
+GLenum LegacyRenderer::GlyphTextureFormat() const
+{
+    return GL_ALPHA;
+}
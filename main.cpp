@@ -9,85 +9,128 @@
 
 #include <GLFW/glfw3.h>
 
-#include "stb_truetype.h"
-
 #define _USE_MATH_DEFINES
 #include <cmath>
 
+#include <algorithm>
+#include <allocationcounter.h>
+#include <atomic>
+#include <autofilter.h>
+#include <cellstore.h>
 #include <chrono>
+#include <delimited.h>
+#include <editjournal.h>
+#include <externalsort.h>
 #include <filesystem>
+#include <find.h>
+#include <framearena.h>
 #include <fstream>
+#include <geometrybuffer.h>
 #include <glm/glm.hpp>
+#include <glyphatlas.h>
+#include <headerlabels.h>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memoryaccounting.h>
 #include <numeric> // for accumelate
+#include <occupancy.h>
+#include <queryexecutor.h>
+#include <renderer.h>
+#include <rowview.h>
+#include <selection.h>
+#include <sheetexport.h>
+#include <sheetlayout.h>
 #include <spdlog/spdlog.h>
 #include <sqlitelib.h>
 #include <stdlib.h>
 #include <string.h>
+#include <textcache.h>
 #include <thread>
+#include <tilecache.h>
+#include <tuple>
+#include <undolog.h>
+#include <viewsnapshot.h>
+#include <workbookfile.h>
 
 int running = true; // Flag telling if the program is running
 
 static float fontSize = 16.0f;
-unsigned char ttf_buffer[1 << 20];
-unsigned char temp_bitmap[512 * 512];
-
-stbtt_bakedchar cdata[96]; // ASCII 32..126 is 95 glyphs
-GLuint ftex;
+static std::unique_ptr<Renderer> renderer;
+static GlyphAtlas glyphAtlas;
 
 void my_stbtt_initfont()
 {
-    FILE *f = nullptr;
-
-    errno_t err = fopen_s(&f, "c:/windows/fonts/SourceCodePro-Regular.ttf", "rb");
-    if (err)
-    {
-        err = fopen_s(&f, "c:/windows/fonts/consola.ttf", "rb");
-    }
-
-    if (err)
+    if (!glyphAtlas.AddFont("c:/windows/fonts/SourceCodePro-Regular.ttf") && !glyphAtlas.AddFont("c:/windows/fonts/consola.ttf"))
     {
         spdlog::error("loading font failed");
 
         return;
     }
 
-    fread(ttf_buffer, 1, 1 << 20, f);
-    stbtt_BakeFontBitmap(ttf_buffer, 0, fontSize, temp_bitmap, 512, 512, 32, 96, cdata); // no guarantee this fits!
-    // can free ttf_buffer at this point
-    glActiveTextureARB(GL_TEXTURE0);
-    glGenTextures(1, &ftex);
-    glBindTexture(GL_TEXTURE_2D, ftex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 512, 512, 0, GL_ALPHA, GL_UNSIGNED_BYTE, temp_bitmap);
-    // can free temp_bitmap at this point
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-    fclose(f);
+    // Fallbacks for scripts the monospace fonts do not cover
+    glyphAtlas.AddFont("c:/windows/fonts/segoeui.ttf");
+    glyphAtlas.AddFont("c:/windows/fonts/msyh.ttc");
 }
 
-float my_stbtt_print_width(
-    const std::string &text)
+static TextCache textCache(glyphAtlas);
+
+// Draws the first 'count' glyphs of a laid out run
+static void DrawTextRun(
+    float x,
+    float y,
+    const TextRun &run,
+    size_t count,
+    const glm::vec4 &color)
 {
-    const char *txt = text.c_str();
+    const float scale = fontSize / GlyphAtlas::SdfPixelHeight;
 
-    float x = 0;
-    float y = 0;
+    // Glyphs are resolved first, so every page is drawn in one batch even
+    // when a string alternates between pages. The quad lists are reused.
+    static std::vector<std::vector<TexturedQuad>> pages(GlyphAtlas::MaxPages);
+    for (auto &quads : pages)
+    {
+        quads.clear();
+    }
 
-    while (*txt)
+    for (size_t i = 0; i < count; i++)
     {
-        if (*txt == '\n')
+        // Tabs and control characters only advance
+        if (run.codepoints[i] == 0)
         {
-            break;
+            continue;
+        }
+
+        auto g = glyphAtlas.Get(run.codepoints[i]);
+        if (g == nullptr || g->page < 0)
+        {
+            continue;
         }
 
-        stbtt_aligned_quad q;
-        stbtt_GetBakedQuad(cdata, 512, 512, *txt - 32, &x, &y, &q, 1);
+        auto x0 = x + run.positions[i] + g->xoff * scale;
+        auto y0 = y + g->yoff * scale;
+
+        pages[g->page].push_back(TexturedQuad{x0, y0, x0 + g->width * scale, y0 + g->height * scale, g->s0, g->t0, g->s1, g->t1});
+    }
+
+    // Zooming scales the renderer transform, the edge smoothing only needs
+    // to know the resulting size on screen
+    auto smoothing = GlyphAtlas::EdgeSmoothing(scale * renderer->Scale());
 
-        ++txt;
+    for (size_t page = 0; page < pages.size(); page++)
+    {
+        if (!pages[page].empty())
+        {
+            renderer->DrawGlyphs(glyphAtlas.PageTexture(int(page)), pages[page].data(), pages[page].size(), color, smoothing);
+        }
     }
+}
 
-    return x;
+float my_stbtt_print_width(
+    const std::string &text)
+{
+    return textCache.Get(text, fontSize).width;
 }
 
 void my_stbtt_print(
@@ -96,1117 +139,3718 @@ void my_stbtt_print(
     const std::string &text,
     const glm::vec4 &color)
 {
-    const char *txt = text.c_str();
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_ALPHA_TEST);
-
-    glActiveTextureARB(GL_TEXTURE1);
-    glDisable(GL_TEXTURE_2D);
+    auto const &run = textCache.Get(text, fontSize);
 
-    glActiveTextureARB(GL_TEXTURE0);
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, ftex);
+    DrawTextRun(x, y, run, run.codepoints.size(), color);
+}
 
-    glBegin(GL_QUADS);
-    glColor4f(color.r, color.g, color.b, color.a);
+// Draws text cut off at maxWidth, ending in "..." when it does not fit
+void my_stbtt_print_clipped(
+    float x,
+    float y,
+    const std::string &text,
+    const glm::vec4 &color,
+    float maxWidth)
+{
+    // Runs are looked up again instead of copied, a lookup can replace the
+    // previous one
+    auto ellipsisWidth = textCache.Get("...", fontSize).width;
+    auto const &run = textCache.Get(text, fontSize);
 
-    while (*txt)
+    if (run.width <= maxWidth)
     {
-        if (*txt == '\n')
-        {
-            break;
-        }
-
-        stbtt_aligned_quad q;
-
-        if (*txt == '\t')
-        {
-            for (int i = 0; i < 4; i++)
-            {
-                stbtt_GetBakedQuad(cdata, 512, 512, '0' - 32, &x, &y, &q, 1);
-            }
-
-            ++txt;
-            continue;
-        }
-
-        if (*txt < 32)
-        {
-            stbtt_GetBakedQuad(cdata, 512, 512, '0' - 32, &x, &y, &q, 1);
-
-            ++txt;
-            continue;
-        }
-
-        stbtt_GetBakedQuad(cdata, 512, 512, *txt - 32, &x, &y, &q, 1);
-        glTexCoord2f(q.s0, q.t0);
-        glVertex2f(q.x0, q.y0);
-
-        glTexCoord2f(q.s1, q.t0);
-        glVertex2f(q.x1, q.y0);
-
-        glTexCoord2f(q.s1, q.t1);
-        glVertex2f(q.x1, q.y1);
+        DrawTextRun(x, y, run, run.codepoints.size(), color);
+        return;
+    }
 
-        glTexCoord2f(q.s0, q.t1);
-        glVertex2f(q.x0, q.y1);
+    auto count = run.Fit(maxWidth - ellipsisWidth);
+    auto ellipsisX = x + run.positions[count];
+    DrawTextRun(x, y, run, count, color);
 
-        ++txt;
+    if (ellipsisWidth <= maxWidth)
+    {
+        auto const &ellipsis = textCache.Get("...", fontSize);
+        DrawTextRun(ellipsisX, y, ellipsis, ellipsis.codepoints.size(), color);
     }
-    glEnd();
-    glActiveTextureARB(GL_TEXTURE0);
-    glDisable(GL_TEXTURE_2D);
 }
 
-void CharCallback(
-    GLFWwindow *window,
+enum class InputMode
+{
+    None,
+    Filter,
+    Edit,
+    Find,
+    Export,
+};
+
+static InputMode inputMode = InputMode::None;
+static std::string inputText;
+static int inputCol = -1;
+
+void AppendUtf8(
+    std::string &str,
     unsigned int codepoint)
 {
-    (void)window;
-    (void)codepoint;
+    if (codepoint < 0x80)
+    {
+        str += char(codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        str += char(0xC0 | (codepoint >> 6));
+        str += char(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        str += char(0xE0 | (codepoint >> 12));
+        str += char(0x80 | ((codepoint >> 6) & 0x3F));
+        str += char(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        str += char(0xF0 | (codepoint >> 18));
+        str += char(0x80 | ((codepoint >> 12) & 0x3F));
+        str += char(0x80 | ((codepoint >> 6) & 0x3F));
+        str += char(0x80 | (codepoint & 0x3F));
+    }
+}
+
+void PopUtf8(
+    std::string &str)
+{
+    while (!str.empty() && (str.back() & 0xC0) == 0x80)
+    {
+        str.pop_back();
+    }
+
+    if (!str.empty())
+    {
+        str.pop_back();
+    }
 }
 
 int active_cell_col = 0, active_cell_row = 0;
-int scroll_cols = 0, max_visible_col_count = 0, scroll_rows = 0, max_visible_row_count = 0;
+int scroll_cols = 0, scroll_rows = 0;
+double scroll_x = 0, scroll_y = 0, scroll_target_x = 0, scroll_target_y = 0;
+double sheetZoom = 1.0;
 const int defaultcell_w = 100, defaultcell_h = 30;
 const int input_line_h = 50, header_w = 40, header_h = 30;
+const int tab_bar_h = 30, tab_w = 120;
 const float padding = 10.0f;
 const float cell_padding = 2.0f;
+const int filter_button_w = 10;
 
 int w = 1024, h = 768;
 
+// The workbook is an in-memory database in shared cache mode, so the query
+// executor's read connections see the same tables as the main connection
+static const char *WorkbookUri = "file:powercells?mode=memory&cache=shared";
 static std::unique_ptr<sqlitelib::Sqlite> db;
-
-std::string columnIndexToLetters(int n)
+static QueryExecutor queryExecutor;
+
+// Edits are collected and written in groups. Anything that reads the tables
+// with SQL flushes it first.
+static std::unique_ptr<EditJournal> journal;
+static std::unique_ptr<UndoLog> undoLog;
+
+// Sheet the model below belongs to. The other sheets keep theirs in
+// sheetStates and are swapped in when their tab is selected.
+static int activeSheet = 0;
+
+// Cell values for readers that must not wait on edits or imports; every write
+// to the cells table is committed here too
+static std::unique_ptr<CellStore> cellStore = std::make_unique<CellStore>();
+
+// Of each sheet's cell store; cold cells are packed past this, 0 turns it off
+static size_t cellMemoryBudget = size_t(1024) * 1024 * 1024;
+
+static SheetLayout sheetLayout(defaultcell_w, defaultcell_h);
+static HeaderLabels headerLabels;
+static TileCache tileCache;
+
+// The input thread publishes the visible model into snapshots, the render
+// thread draws the latest one. Cell values are fetched per tile and shared
+// between snapshots until their tile is invalidated.
+static SnapshotBuffer snapshots;
+static std::shared_ptr<const SheetLayout> publishedLayout;
+static std::map<TileCache::TileKey, std::shared_ptr<const TileCells>> tileCells;
+static std::atomic<bool> rendering(false);
+
+// Measured by the render thread, used for hit testing the input line
+static std::atomic<float> inputLineOffset(0.0f);
+
+// Sizes of the render thread's caches, measured there each second, and the
+// input thread's request to drop them
+static std::atomic<size_t> textCacheBytes(0);
+static std::atomic<size_t> tileCacheBytes(0);
+static std::atomic<size_t> glyphAtlasBytes(0);
+static std::atomic<size_t> geometryBytes(0);
+static std::atomic<bool> evictRenderCaches(false);
+
+// Header and selection geometry, kept on the GPU until the inputs in their
+// key change
+static GeometryBuffer chromeGeometry(GL_TRIANGLES);
+static GeometryBuffer gridGeometry(GL_LINES);
+static GeometryBuffer overlayGeometry(GL_TRIANGLES);
+static GeometryBuffer memoryGeometry(GL_TRIANGLES);
+static GeometryBuffer tabGeometry(GL_TRIANGLES);
+
+// Temporaries of the frame being drawn, reset after each frame
+static FrameArena frameArena;
+static std::tuple<int, int, float> chromeKey;
+static std::tuple<int, int, size_t, int> tabKey;
+static std::tuple<int64_t, int64_t, double, int, int, unsigned int, unsigned int> gridKey;
+static std::tuple<decltype(gridKey), unsigned int, int, int, const RowView *, unsigned int> overlayKey;
+static Selection selection;
+static std::vector<std::shared_ptr<const RowView>> rowViews = {std::make_shared<RowView>()};
+static size_t activeRowView = 0;
+
+// The model of a sheet while another one is active. Switching swaps it with
+// the globals, so the rest of the input thread only ever works on the
+// globals and nothing is copied. A sheet is opened the first time it is
+// shown: its layout and the rows on screen are read right away, the rest of
+// its cells and its occupancy index load on the query executor.
+struct SheetState
 {
-    std::string str; // To store result (Excel column name)
-
-    while (n > 0)
+    std::string title;
+    bool opened = false;
+    QueryHandle<OccupancyIndex> load;
+    std::shared_ptr<std::atomic<int>> loadPermille;
+
+    std::unique_ptr<CellStore> cellStore;
+    OccupancyIndex occupancy;
+    SheetLayout sheetLayout{defaultcell_w, defaultcell_h};
+    HeaderLabels headerLabels;
+    AutoFilter autoFilter;
+    std::shared_ptr<const RowView> autoFilterBase;
+    std::shared_ptr<const RowView> autoFilterView;
+    std::vector<std::shared_ptr<const RowView>> rowViews = {std::make_shared<RowView>()};
+    size_t activeRowView = 0;
+    Selection selection;
+    int activeCol = 0;
+    int activeRow = 0;
+    double scrollX = 0;
+    double scrollY = 0;
+};
+
+// Rows a sheet loads per cell store commit in the background
+static const int SheetLoadRows = 65536;
+
+static std::map<int, SheetState> sheetStates;
+
+// Sheet ids in tab order, and their titles as the snapshots share them
+static std::vector<int> sheetIds;
+static std::shared_ptr<const std::vector<std::string>> sheetTitles;
+
+// Set while the active sheet's load also fills the cells table from a
+// workbook file. That connection holds the write lock until it commits, so
+// anything reading or writing the tables is refused until then.
+static bool fillingTables = false;
+
+bool RefuseWhileFilling()
+{
+    if (!fillingTables)
     {
-        // Find remainder
-        int rem = n % 26;
-
-        // If remainder is 0, then a 'Z' must be there in output
-        if (rem == 0)
-        {
-            str += 'Z';
-            n = (n / 26) - 1;
-        }
-        else // If remainder is non-zero
-        {
-            str += (rem - 1) + 'A';
-            n = n / 26;
-        }
+        return false;
     }
 
-    std::reverse(str.begin(), str.end());
-    return str;
+    spdlog::warn("the workbook is still loading");
+    return true;
 }
 
-void EnsureSelectionInView()
+const RowView &CurrentRowView()
 {
-    {
-        //        auto width_until_active_cell_col = (active_cell_col * defaultcell_w)
-        //                                           + db->execute_value<int>("SELECT SUM(size) FROM cols WHERE col_index <= ?", active_cell_col);
-        //        auto width_until_scroll_cols = (scroll_cols * defaultcell_w)
-        //                                       + db->execute_value<int>("SELECT SUM(size) FROM cols WHERE col_index <= ?", scroll_cols);
-
-        //        if (active_cell_col < scroll_cols)
-        //        {
-        //            scroll_cols = active_cell_col;
-        //        }
-
-        auto cols = db->execute<int, int>("SELECT col_index, size FROM cols;");
-        std::map<int, int> col_widths;
-        for (auto const &col : cols)
-        {
-            col_widths[std::get<0>(col)] = defaultcell_w + std::get<1>(col);
-        }
-        for (int i = 0; i <= active_cell_col; i++)
-        {
-            if (col_widths.count(i) > 0)
-            {
-                continue;
-            }
-            col_widths[i] = defaultcell_w;
-        }
-
-        auto total_col_width = std::accumulate(
-            col_widths.begin(),
-            col_widths.end(),
-            0,
-            [](int value, const std::map<int, int>::value_type &p) {
-                if (p.first > active_cell_col)
-                {
-                    return value;
-                }
-                return value + p.second;
-            });
-
-        auto min_scroll_cols = 0;
-
-        total_col_width += header_w;
-        while (total_col_width > w)
-        {
-            total_col_width -= col_widths[min_scroll_cols];
-            min_scroll_cols++;
-        }
-
-        std::cout << min_scroll_cols << std::endl;
-        if (scroll_cols < min_scroll_cols)
-        {
-            scroll_cols = min_scroll_cols;
-        }
-        else if (scroll_cols >= active_cell_col)
-        {
-            scroll_cols = active_cell_col;
-        }
-        std::cout << "scroll_cols: " << scroll_cols << std::endl;
-
-        max_visible_col_count = 0;
-        int x = header_w;
-        while (x < w)
-        {
-            if (col_widths.count(scroll_cols + max_visible_col_count) == 1)
-            {
-                x += col_widths[scroll_cols + max_visible_col_count];
-            }
-            else
-            {
-                x += defaultcell_w;
-            }
-            max_visible_col_count++;
-        }
-    }
-
-    {
-        auto rows = db->execute<int, int>("SELECT row_index, size FROM rows");
-        std::map<int, int> row_widths;
-        for (auto const &row : rows)
-        {
-            row_widths[std::get<0>(row)] = defaultcell_h + std::get<1>(row);
-        }
-        for (int i = 0; i <= active_cell_row; i++)
-        {
-            if (row_widths.count(i) > 0)
-            {
-                continue;
-            }
-            row_widths[i] = defaultcell_h;
-        }
-
-        auto total_row_size = std::accumulate(
-            row_widths.begin(),
-            row_widths.end(),
-            0,
-            [](int value, const std::map<int, int>::value_type &p) {
-                if (p.first > active_cell_row)
-                {
-                    return value;
-                }
-                return value + p.second;
-            });
-
-        auto min_scroll_rows = 0;
-
-        total_row_size += input_line_h + header_h;
-        while (total_row_size > h)
-        {
-            total_row_size -= row_widths[min_scroll_rows];
-            min_scroll_rows++;
-        }
-
-        if (scroll_rows < min_scroll_rows)
-        {
-            scroll_rows = min_scroll_rows;
-        }
-        else if (scroll_rows >= active_cell_row)
-        {
-            scroll_rows = active_cell_row;
-        }
-
-        max_visible_row_count = 0;
-        int y = input_line_h + header_h;
-        while (y < h)
-        {
-            if (row_widths.count(scroll_rows + max_visible_row_count) == 1)
-            {
-                y += row_widths[scroll_rows + max_visible_row_count];
-            }
-            else
-            {
-                y += defaultcell_h;
-            }
-            max_visible_row_count++;
-        }
-    }
+    return *rowViews[activeRowView];
 }
 
-void MoveSelectionLeft()
+// Rows show their storage row number, so sorted and filtered views keep
+// telling the user where a row came from.
+std::string RowLabel(
+    int displayRow)
 {
-    active_cell_col--;
-
-    if (active_cell_col < 0)
+    auto storageRow = CurrentRowView().ToStorage(displayRow);
+    if (storageRow < 0)
     {
-        active_cell_col = 0;
+        return std::string();
     }
 
-    EnsureSelectionInView();
+    return fmt::format("{}", storageRow + 1);
 }
 
-void MoveSelectionRight()
+// Scroll position is kept in zoomed sheet pixels; the first (partially)
+// visible column and row follow from it
+void UpdateScrollIndices()
 {
-    active_cell_col++;
-
-    EnsureSelectionInView();
+    scroll_cols = sheetLayout.cols.IndexAt(int64_t(scroll_x / sheetZoom));
+    scroll_rows = sheetLayout.rows.IndexAt(int64_t(scroll_y / sheetZoom));
 }
 
-void MoveSelectionUp()
+void ScrollTo(
+    double x,
+    double y,
+    bool animate)
 {
-    active_cell_row--;
+    scroll_target_x = std::max(0.0, x);
+    scroll_target_y = std::max(0.0, y);
 
-    if (active_cell_row < 0)
+    // Animating over more than a few screens would rasterize every tile on
+    // the way, far jumps snap instead
+    if (!animate || std::abs(scroll_target_x - scroll_x) > 2 * w || std::abs(scroll_target_y - scroll_y) > 2 * h)
     {
-        active_cell_row = 0;
+        scroll_x = scroll_target_x;
+        scroll_y = scroll_target_y;
     }
 
-    EnsureSelectionInView();
+    UpdateScrollIndices();
 }
 
-void MoveSelectionDown()
+void AnimateScroll(
+    double timeDiff)
 {
-    active_cell_row++;
+    auto step = std::min(1.0, timeDiff * 15.0);
 
-    EnsureSelectionInView();
-}
-
-void KeyCallback(
-    GLFWwindow *window,
-    int key,
-    int scancode,
-    int action,
-    int mods)
-{
-    (void)window;
-    (void)scancode;
-    (void)mods;
+    scroll_x += (scroll_target_x - scroll_x) * step;
+    scroll_y += (scroll_target_y - scroll_y) * step;
 
-    if (key == GLFW_KEY_BACKSPACE && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    if (std::abs(scroll_target_x - scroll_x) < 0.5)
     {
+        scroll_x = scroll_target_x;
     }
-    else if (key == GLFW_KEY_ENTER && (action == GLFW_PRESS || action == GLFW_REPEAT))
-    {
-    }
-    else if (key == GLFW_KEY_ESCAPE && action == GLFW_RELEASE)
+
+    if (std::abs(scroll_target_y - scroll_y) < 0.5)
     {
-        running = false;
+        scroll_y = scroll_target_y;
     }
 
-    if ((key == GLFW_KEY_LEFT || (key == GLFW_KEY_TAB && mods & GLFW_MOD_SHIFT)) && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    UpdateScrollIndices();
+}
+
+void EnsureSelectionInView()
+{
+    auto x = scroll_target_x, y = scroll_target_y;
+
+    auto view_w = double(w - header_w);
+    auto col_start = sheetLayout.cols.Start(active_cell_col) * sheetZoom;
+    auto col_end = col_start + sheetLayout.cols.Size(active_cell_col) * sheetZoom;
+
+    if (col_start < x || col_end - col_start > view_w)
     {
-        MoveSelectionLeft();
+        x = col_start;
     }
-    else if ((key == GLFW_KEY_RIGHT || key == GLFW_KEY_TAB) && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    else if (col_end > x + view_w)
     {
-        MoveSelectionRight();
+        x = col_end - view_w;
     }
-    else if (key == GLFW_KEY_UP && (action == GLFW_PRESS || action == GLFW_REPEAT))
+
+    auto view_h = double(h - input_line_h - header_h - tab_bar_h);
+    auto row_start = sheetLayout.rows.Start(active_cell_row) * sheetZoom;
+    auto row_end = row_start + sheetLayout.rows.Size(active_cell_row) * sheetZoom;
+
+    if (row_start < y || row_end - row_start > view_h)
     {
-        MoveSelectionUp();
+        y = row_start;
     }
-    else if (key == GLFW_KEY_DOWN && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    else if (row_end > y + view_h)
     {
-        MoveSelectionDown();
+        y = row_end - view_h;
     }
+
+    ScrollTo(x, y, true);
 }
 
-void ScrollCallback(
-    GLFWwindow *window,
-    double xoffset,
-    double yoffset)
+// Drops the fetched cells of all tiles; the render thread re-renders the
+// tiles with the next snapshot
+void InvalidateTiles()
 {
-    (void)window;
+    tileCells.clear();
+    snapshots.InvalidateAll();
+}
+
+// Marks the tiles showing a cell for re-rendering
+void InvalidateCell(
+    int col,
+    int row)
+{
+    auto x0 = int64_t(sheetLayout.cols.Start(col) * sheetZoom);
+    auto y0 = int64_t(sheetLayout.rows.Start(row) * sheetZoom);
+    auto x1 = x0 + int64_t(sheetLayout.cols.Size(col) * sheetZoom) + 1;
+    auto y1 = y0 + int64_t(sheetLayout.rows.Size(row) * sheetZoom) + 1;
 
-    if (xoffset < 0)
+    for (auto const &key : TileCache::TilesOverlapping(x0, y0, x1, y1))
     {
-        scroll_cols++;
+        tileCells.erase(key);
     }
-    else if (xoffset > 0)
+
+    snapshots.InvalidateRect(x0, y0, x1, y1);
+}
+
+// Zooming keeps the sheet position at the top left corner of the cell area
+// in place. Glyphs are distance fields, so the atlas is unaffected and
+// only the tiles are rasterized again.
+void SetZoom(
+    double zoom)
+{
+    zoom = std::min(4.0, std::max(0.25, zoom));
+    if (zoom == sheetZoom)
     {
-        scroll_cols--;
+        return;
     }
-    else if (yoffset < 0)
+
+    auto factor = zoom / sheetZoom;
+    sheetZoom = zoom;
+
+    scroll_x *= factor;
+    scroll_y *= factor;
+    scroll_target_x *= factor;
+    scroll_target_y *= factor;
+
+    InvalidateTiles();
+    UpdateScrollIndices();
+}
+
+void UpdateSelection(
+    bool extend)
+{
+    if (extend)
     {
-        scroll_rows++;
+        selection.ExtendTo(active_cell_col, active_cell_row);
     }
-    else if (yoffset > 0)
+    else
     {
-        scroll_rows--;
+        selection.Set(active_cell_col, active_cell_row);
     }
 
-    if (scroll_rows < 0)
-    {
-        scroll_rows = 0;
-    }
+    EnsureSelectionInView();
+}
+
+void MoveSelectionLeft(
+    bool extend)
+{
+    active_cell_col--;
 
-    if (scroll_cols < 0)
+    if (active_cell_col < 0)
     {
-        scroll_cols = 0;
+        active_cell_col = 0;
     }
+
+    UpdateSelection(extend);
 }
 
-void ResizeCallback(
-    GLFWwindow *window,
-    int width,
-    int height)
+void MoveSelectionRight(
+    bool extend)
 {
-    (void)window;
+    active_cell_col++;
 
-    w = width;
-    h = height;
+    UpdateSelection(extend);
 }
 
-std::pair<int, int> pair_from_tuple(
-    const std::tuple<int, int> &tuple)
+void MoveSelectionUp(
+    bool extend)
 {
-    return std::make_pair(std::get<0>(tuple), std::get<1>(tuple));
+    active_cell_row--;
+
+    if (active_cell_row < 0)
+    {
+        active_cell_row = 0;
+    }
+
+    UpdateSelection(extend);
 }
 
-std::map<int, int> select_into_map(
-    const char *query)
+void MoveSelectionDown(
+    bool extend)
 {
-    auto cols = db->execute<int, int>(query);
-
-    std::map<int, int> map;
+    active_cell_row++;
 
-    for (auto const &e : cols)
+    auto rowCount = CurrentRowView().RowCount();
+    if (rowCount >= 0 && active_cell_row >= rowCount)
     {
-        map.insert(pair_from_tuple(e));
+        active_cell_row = std::max(0, rowCount - 1);
     }
 
-    return map;
+    UpdateSelection(extend);
 }
 
-bool IsHoveringInputLine(
-    int x,
-    int y)
-{
-    auto strwidth = my_stbtt_print_width(">_");
-    auto input_line_offset = strwidth + padding + padding;
-    if (x < input_line_offset || y < padding || y > input_line_h - padding) return false;
+static OccupancyIndex occupancy;
 
-    return true;
-}
+// Rows a Ctrl+Up/Down scan of a sorted view tests per key press. Past it the
+// cursor stops where the scan got to and the next press carries on.
+static const int JumpScanLimit = 1 << 20;
 
-bool GetColWidthHandle(
-    int x,
-    int y,
-    int &out_col)
+// Ctrl+Up/Down target in a filtered view, as a storage row or -1. Shown rows
+// are found with rank/select on the filter and occupied ones with the column
+// runs, so each step skips a whole run or a whole filtered out gap.
+static int FilteredEdge(
+    const RowBitmap &filter,
+    const OccupancyRuns &runs,
+    int storageRow,
+    bool down)
 {
-    x -= header_w;
+    auto nextShown = [&](int row) { return filter.Select(filter.Rank(row + 1)); };
+    auto previousShown = [&](int row) {
+        auto rank = filter.Rank(row);
+        return rank > 0 ? filter.Select(rank - 1) : -1;
+    };
+    auto occupied = [&](int row) { return row >= 0 && runs.Test(row); };
+
+    auto row = down ? nextShown(storageRow) : previousShown(storageRow);
+
+    // Within a block, go to the last shown row of each run and stop when the
+    // next shown row is empty
+    if (occupied(storageRow) && occupied(row))
+    {
+        while (true)
+        {
+            if (down)
+            {
+                auto runEnd = runs.Test(row + 1) ? runs.NextEdge(row) : row;
+                auto last = filter.Select(filter.Rank(runEnd + 1) - 1);
+                auto next = nextShown(last);
+                if (!occupied(next))
+                {
+                    return last;
+                }
+                row = next;
+            }
+            else
+            {
+                auto runBegin = runs.Test(row - 1) ? runs.PreviousEdge(row) : row;
+                auto first = filter.Select(filter.Rank(runBegin));
+                auto previous = previousShown(first);
+                if (!occupied(previous))
+                {
+                    return first;
+                }
+                row = previous;
+            }
+        }
+    }
 
-    if (x < 0 || y < input_line_h || y > (input_line_h + header_h))
+    // Otherwise go to the next shown row that is occupied, jumping over the
+    // gaps between runs
+    while (row >= 0 && !occupied(row))
     {
-        return false;
+        auto edge = down ? runs.NextEdge(row) : runs.PreviousEdge(row);
+        if (edge < 0)
+        {
+            return -1;
+        }
+        row = occupied(edge) && filter.Test(edge) ? edge : (down ? nextShown(edge) : previousShown(edge));
+    }
+
+    return row;
+}
+
+// Ctrl+Up/Down. The identity view jumps with the column runs directly and
+// filtered views walk the runs together with the filter. Sorted views have no
+// order in common with the runs, so their display rows are tested one by one.
+void JumpVertical(
+    bool down,
+    bool extend)
+{
+    auto const &view = CurrentRowView();
+    auto const &runs = occupancy.Column(active_cell_col);
+    auto last = view.RowCount() - 1;
+
+    if (view.IsIdentity())
+    {
+        auto edge = down ? runs.NextEdge(active_cell_row) : runs.PreviousEdge(active_cell_row);
+        if (edge < 0)
+        {
+            edge = down ? std::max(active_cell_row, occupancy.LastRow()) : 0;
+        }
+        active_cell_row = edge;
+    }
+    else if (auto filter = view.Filter())
+    {
+        // Below the last shown row there is nothing but the end of the view
+        auto storageRow = view.ToStorage(active_cell_row);
+        if (storageRow < 0)
+        {
+            storageRow = filter->Size();
+        }
+
+        auto edge = FilteredEdge(*filter, runs, storageRow, down);
+        if (edge < 0)
+        {
+            active_cell_row = down ? std::max(0, last) : 0;
+        }
+        else
+        {
+            active_cell_row = filter->Rank(edge);
+        }
+    }
+    else
+    {
+        auto step = down ? 1 : -1;
+        auto occupied = [&](int row) {
+            auto storageRow = view.ToStorage(row);
+            return storageRow >= 0 && runs.Test(storageRow);
+        };
+        auto inView = [&](int row) { return row >= 0 && row <= last; };
+
+        auto row = active_cell_row;
+        auto budget = JumpScanLimit;
+        if (occupied(row) && inView(row + step) && occupied(row + step))
+        {
+            while (inView(row + step) && occupied(row + step) && --budget > 0)
+            {
+                row += step;
+            }
+        }
+        else
+        {
+            row += step;
+            while (inView(row) && !occupied(row) && --budget > 0)
+            {
+                row += step;
+            }
+            if (!inView(row))
+            {
+                row = down ? std::max(0, last) : 0;
+            }
+        }
+        active_cell_row = row;
+    }
+
+    UpdateSelection(extend);
+}
+
+// Ctrl+Left/Right, with the runs of the storage row under the active cell
+void JumpHorizontal(
+    bool right,
+    bool extend)
+{
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    auto storageRow = CurrentRowView().ToStorage(active_cell_row);
+    if (storageRow < 0)
+    {
+        return;
+    }
+
+    journal->Flush();
+    auto const &runs = occupancy.Row(*db, storageRow);
+    auto edge = right ? runs.NextEdge(active_cell_col) : runs.PreviousEdge(active_cell_col);
+    if (edge < 0)
+    {
+        edge = right ? std::max(active_cell_col, runs.Last()) : 0;
+    }
+    active_cell_col = edge;
+
+    UpdateSelection(extend);
+}
+
+// Ctrl+Home / Ctrl+End
+void JumpToCorner(
+    bool end,
+    bool extend)
+{
+    if (end)
+    {
+        auto rowCount = CurrentRowView().RowCount();
+        active_cell_col = std::max(0, occupancy.LastCol());
+        active_cell_row = std::max(0, rowCount >= 0 ? rowCount - 1 : occupancy.LastRow());
+    }
+    else
+    {
+        active_cell_col = 0;
+        active_cell_row = 0;
+    }
+
+    UpdateSelection(extend);
+}
+
+// Home / End within the active row
+void JumpToRowEdge(
+    bool end,
+    bool extend)
+{
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    auto storageRow = CurrentRowView().ToStorage(active_cell_row);
+
+    journal->Flush();
+    active_cell_col = end && storageRow >= 0 ? std::max(0, occupancy.Row(*db, storageRow).Last()) : 0;
+
+    UpdateSelection(extend);
+}
+
+void AddRowView(
+    std::shared_ptr<const RowView> view)
+{
+    rowViews.push_back(view);
+    activeRowView = rowViews.size() - 1;
+    InvalidateTiles();
+    EnsureSelectionInView();
+}
+
+// A sort finishing after its sheet was left adds its view to that sheet
+void AddSheetRowView(
+    int sheet,
+    std::shared_ptr<const RowView> view)
+{
+    if (sheet == activeSheet)
+    {
+        AddRowView(view);
+        return;
+    }
+
+    auto &state = sheetStates[sheet];
+    state.rowViews.push_back(view);
+    state.activeRowView = state.rowViews.size() - 1;
+}
+
+void SwitchRowView(
+    int offset)
+{
+    activeRowView = (activeRowView + rowViews.size() + offset) % rowViews.size();
+    InvalidateTiles();
+
+    auto rowCount = CurrentRowView().RowCount();
+    if (rowCount >= 0 && active_cell_row >= rowCount)
+    {
+        active_cell_row = std::max(0, rowCount - 1);
+    }
+
+    selection.Set(active_cell_col, active_cell_row);
+    EnsureSelectionInView();
+}
+
+// The storage order view stays
+void RemoveRowView(
+    const std::shared_ptr<const RowView> &view)
+{
+    auto found = std::find(rowViews.begin() + 1, rowViews.end(), view);
+    if (found == rowViews.end())
+    {
+        return;
+    }
+
+    auto index = size_t(found - rowViews.begin());
+    rowViews.erase(found);
+    if (activeRowView >= index)
+    {
+        activeRowView--;
+    }
+    SwitchRowView(0);
+}
+
+void RemoveCurrentRowView()
+{
+    RemoveRowView(rowViews[activeRowView]);
+}
+
+static QueryHandle<void> sortQuery;
+static SortProgress sortProgress;
+static std::vector<int32_t> sortPermutation;
+static std::string sortDescription;
+static int sortSheet = 0;
+
+bool IsSorting()
+{
+    return sortQuery.IsPending();
+}
+
+// Sorts all rows by the columns spanned by the selection, starting with the
+// active column. Runs on the query executor; the main loop picks up the
+// result.
+void StartSort(
+    bool descending)
+{
+    if (IsSorting() || RefuseWhileFilling())
+    {
+        return;
     }
 
-    auto cols_map = select_into_map("SELECT col_index, size FROM cols");
+    std::vector<SortKey> keys;
+    keys.push_back(SortKey{active_cell_col, descending});
 
-    int col = scroll_cols;
-    int sum_colwidths = 0;
+    auto bounds = selection.Ranges().back();
+    if (!bounds.IsEntireRow())
+    {
+        for (int col = bounds.fromCol; col <= bounds.toCol; col++)
+        {
+            if (col != active_cell_col)
+            {
+                keys.push_back(SortKey{col, descending});
+            }
+        }
+    }
+
+    sortDescription = fmt::format("sorted by {} {}", columnIndexToLetters(active_cell_col + 1), descending ? "desc" : "asc");
+
+    sortProgress.Reset();
+    sortSheet = activeSheet;
+    journal->Flush();
+    sortQuery = queryExecutor.Submit<void>([keys, sheet = activeSheet, base = rowViews[activeRowView]](sqlitelib::Sqlite &db) {
+        ExternalSort sort(db, sheet, keys);
+        if (!sort.Run(sortProgress, sortPermutation) || base->IsIdentity())
+        {
+            return;
+        }
+
+        // Sorting a filtered view keeps only the rows of that view
+        RowBitmap inBase;
+        if (base->Filter() != nullptr)
+        {
+            inBase = *base->Filter();
+        }
+        else
+        {
+            auto maxRow = base->Rows().empty() ? -1 : *std::max_element(base->Rows().begin(), base->Rows().end());
+            inBase = RowBitmap(maxRow + 1);
+            for (auto row : base->Rows())
+            {
+                inBase.Set(row);
+            }
+        }
+
+        sortPermutation.erase(
+            std::remove_if(
+                sortPermutation.begin(),
+                sortPermutation.end(),
+                [&inBase](int32_t row) { return !inBase.Test(row); }),
+            sortPermutation.end());
+    });
+}
+
+void FinishSortIfDone()
+{
+    if (!sortQuery.IsReady())
+    {
+        return;
+    }
+
+    try
+    {
+        sortQuery.result.get();
+    }
+    catch (const std::exception &ex)
+    {
+        sortProgress.succeeded = false;
+    }
+
+    if (!sortProgress.succeeded)
+    {
+        spdlog::warn("sort was cancelled or failed");
+        sortPermutation.clear();
+        return;
+    }
+
+    auto view = std::make_shared<const RowView>(std::move(sortPermutation), sortDescription);
+    undoLog->PushView(sortSheet, sortDescription, view);
+    AddSheetRowView(sortSheet, view);
+    sortPermutation = std::vector<int32_t>();
+}
+
+static QueryHandle<ExportStats> exportQuery;
+static std::string exportFilename;
+static std::string exportResult;
+
+bool IsExporting()
+{
+    return exportQuery.IsPending();
+}
+
+// Exports on a read connection, the journal is flushed first so the file
+// has every edit made so far
+void StartExport(
+    const std::string &filename)
+{
+    if (filename.empty() || IsExporting() || RefuseWhileFilling())
+    {
+        return;
+    }
+
+    journal->Flush();
+    exportFilename = filename;
+    exportResult.clear();
+    exportQuery = queryExecutor.Submit<ExportStats>([filename, sheet = activeSheet](sqlitelib::Sqlite &db) {
+        ExportStats stats;
+        auto written = std::filesystem::path(filename).extension() == WorkbookFile::Extension
+                           ? WorkbookFile::Save(db, filename, stats)
+                           : ExportDelimited(db, sheet, filename, SeparatorForFile(filename), stats);
+        if (!written)
+        {
+            throw std::runtime_error("writing the file failed");
+        }
+
+        return stats;
+    });
+}
+
+void FinishExportIfDone()
+{
+    if (!exportQuery.IsReady())
+    {
+        return;
+    }
+
+    try
+    {
+        auto stats = exportQuery.result.get();
+        exportResult = fmt::format("exported {} rows: {:.1f} MB at {:.0f} MB/s", stats.rows, stats.bytes / (1024.0 * 1024.0), stats.MegabytesPerSecond());
+        spdlog::info("exported {} rows, {} cells to {}: {} bytes in {:.2f} s, {:.1f} MB/s", stats.rows, stats.cells, exportFilename, stats.bytes, stats.seconds, stats.MegabytesPerSecond());
+    }
+    catch (const std::exception &ex)
+    {
+        exportResult = "export failed";
+        spdlog::error("export to {} failed: {}", exportFilename, ex.what());
+    }
+}
+
+static AutoFilter autoFilter;
+static std::shared_ptr<const RowView> autoFilterBase;
+static std::shared_ptr<const RowView> autoFilterView;
+static unsigned int autoFilterVersion = 0;
+
+bool IsAutoFilterActive()
+{
+    return autoFilterView != nullptr && rowViews[activeRowView] == autoFilterView;
+}
+
+bool IsColumnFiltered(
+    int col)
+{
+    return IsAutoFilterActive() && autoFilter.HasPredicate(col);
+}
+
+// Sets or clears (empty input) the filter of one column. The auto filter
+// applies on top of the view that was active when its first column filter
+// was set, and its own view is replaced in place on every change.
+void ApplyAutoFilter(
+    int col,
+    const std::string &input)
+{
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    journal->Flush();
 
-    while (true)
+    if (!IsAutoFilterActive())
     {
-        auto colw = cols_map.find(col);
-        if (colw != cols_map.end())
+        autoFilter.ClearPredicates();
+        autoFilterBase = rowViews[activeRowView];
+        autoFilterView = nullptr;
+    }
+
+    autoFilterVersion++;
+
+    ColumnPredicate predicate;
+    if (input.empty())
+    {
+        autoFilter.ClearPredicate(col);
+    }
+    else if (ColumnPredicate::Parse(input, predicate))
+    {
+        autoFilter.SetPredicate(col, predicate);
+    }
+    else
+    {
+        spdlog::warn("invalid filter: {}", input);
+        return;
+    }
+
+    std::shared_ptr<const RowView> view;
+    if (!autoFilter.IsEmpty())
+    {
+        std::string description = autoFilterBase->IsIdentity() ? "filter" : autoFilterBase->Description() + ", filter";
+        for (auto const &p : autoFilter.Predicates())
+        {
+            description += fmt::format(" {} {}", columnIndexToLetters(p.first + 1), p.second.ToString());
+        }
+
+        auto rowCount = db->execute_value<int>("SELECT IFNULL(MAX(row), -1) + 1 FROM cells WHERE sheet = ?", activeSheet);
+        auto bitmap = autoFilter.Evaluate(*db, activeSheet, rowCount);
+
+        if (autoFilterBase->IsIdentity())
+        {
+            view = std::make_shared<RowView>(std::move(bitmap), description);
+        }
+        else if (autoFilterBase->Filter() != nullptr)
         {
-            sum_colwidths += defaultcell_w + colw->second;
+            bitmap.And(*autoFilterBase->Filter());
+            view = std::make_shared<RowView>(std::move(bitmap), description);
         }
         else
         {
-            sum_colwidths += defaultcell_w;
+            std::vector<int32_t> rows;
+            for (auto row : autoFilterBase->Rows())
+            {
+                if (bitmap.Test(row))
+                {
+                    rows.push_back(row);
+                }
+            }
+            view = std::make_shared<RowView>(std::move(rows), description);
+        }
+    }
+
+    auto existing = std::find(rowViews.begin(), rowViews.end(), autoFilterView);
+    if (existing != rowViews.end() && view != nullptr)
+    {
+        *existing = view;
+    }
+    else if (existing != rowViews.end())
+    {
+        rowViews.erase(existing);
+        auto base = std::find(rowViews.begin(), rowViews.end(), autoFilterBase);
+        activeRowView = base != rowViews.end() ? size_t(base - rowViews.begin()) : 0;
+    }
+    else if (view != nullptr)
+    {
+        rowViews.push_back(view);
+        activeRowView = rowViews.size() - 1;
+    }
+
+    autoFilterView = view;
+    SwitchRowView(0);
+}
+
+static std::unique_ptr<FindCursor> findCursor;
+
+void ResetFind()
+{
+    findCursor.reset();
+}
+
+void PublishSheetTitles()
+{
+    auto titles = std::make_shared<std::vector<std::string>>();
+    for (auto id : sheetIds)
+    {
+        titles->push_back(sheetStates[id].title);
+    }
+
+    sheetTitles = titles;
+}
+
+// Reads the sheet tabs after the tables were replaced. Sheets holding cells
+// without a row in the sheets table get one, and a workbook without any
+// sheet gets its first.
+void LoadSheets()
+{
+    sheetIds.clear();
+
+    try
+    {
+        db->execute("INSERT OR IGNORE INTO sheets (id, title) SELECT DISTINCT sheet, 'Sheet' || (sheet + 1) FROM cells");
+        db->execute("INSERT INTO sheets (id, title) SELECT 0, 'Sheet1' WHERE NOT EXISTS (SELECT 1 FROM sheets)");
+
+        for (auto const &sheet : db->execute_cursor<int, std::string>("SELECT id, COALESCE(title, '') FROM sheets ORDER BY id"))
+        {
+            sheetIds.push_back(std::get<0>(sheet));
+            sheetStates[std::get<0>(sheet)].title = std::get<1>(sheet);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("reading the sheets failed: {}", db->errormsg());
+    }
+
+    if (sheetIds.empty())
+    {
+        sheetIds.push_back(0);
+    }
+
+    if (std::find(sheetIds.begin(), sheetIds.end(), activeSheet) == sheetIds.end())
+    {
+        activeSheet = sheetIds.front();
+    }
+
+    PublishSheetTitles();
+}
+
+// The active sheet's cell store and those of the other opened sheets
+void ForEachCellStore(
+    const std::function<void(CellStore &store)> &callback)
+{
+    callback(*cellStore);
+    for (auto &entry : sheetStates)
+    {
+        if (entry.first != activeSheet && entry.second.cellStore != nullptr)
+        {
+            callback(*entry.second.cellStore);
+        }
+    }
+}
+
+void SwapSheetState(
+    SheetState &state)
+{
+    std::swap(cellStore, state.cellStore);
+    std::swap(occupancy, state.occupancy);
+    std::swap(sheetLayout, state.sheetLayout);
+    std::swap(headerLabels, state.headerLabels);
+    std::swap(autoFilter, state.autoFilter);
+    std::swap(autoFilterBase, state.autoFilterBase);
+    std::swap(autoFilterView, state.autoFilterView);
+    std::swap(rowViews, state.rowViews);
+    std::swap(activeRowView, state.activeRowView);
+    std::swap(selection, state.selection);
+    std::swap(active_cell_col, state.activeCol);
+    std::swap(active_cell_row, state.activeRow);
+    std::swap(scroll_target_x, state.scrollX);
+    std::swap(scroll_target_y, state.scrollY);
+}
+
+// Reads what the first frame of the active sheet needs and submits the load
+// of the rest
+void OpenSheet()
+{
+    auto &state = sheetStates[activeSheet];
+    state.opened = true;
+
+    // The load reads the tables on another connection
+    journal->Flush();
+
+    cellStore = std::make_unique<CellStore>();
+    cellStore->SetMemoryBudget(cellMemoryBudget);
+    occupancy.Clear(activeSheet);
+    sheetLayout.Load(*db, activeSheet);
+    headerLabels.Load(*db, activeSheet);
+    UpdateScrollIndices();
+
+    auto lastRow = sheetLayout.rows.IndexAt(int64_t((scroll_target_y + h) / sheetZoom)) + 1;
+    try
+    {
+        cellStore->LoadRows(*db, activeSheet, scroll_rows, lastRow);
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("reading sheet {} failed: {}", state.title, db->errormsg());
+    }
+
+    auto progress = std::make_shared<std::atomic<int>>(0);
+    state.loadPermille = progress;
+    state.load = queryExecutor.Submit<OccupancyIndex>([sheet = activeSheet, store = cellStore.get(), progress](sqlitelib::Sqlite &db) {
+        auto lastRow = db.execute_value<int>("SELECT IFNULL(MAX(row), -1) FROM cells WHERE sheet = ?", sheet);
+        for (int fromRow = 0; fromRow <= lastRow; fromRow += SheetLoadRows)
+        {
+            store->LoadRows(db, sheet, fromRow, std::min(lastRow, fromRow + SheetLoadRows - 1));
+            *progress = int(int64_t(fromRow + SheetLoadRows) * 1000 / (lastRow + 1));
+        }
+
+        OccupancyIndex index;
+        index.Build(db, sheet);
+        return index;
+    });
+}
+
+bool IsSheetLoading()
+{
+    return sheetStates[activeSheet].load.IsPending();
+}
+
+// Edits and copies need every cell of the sheet in the cell store and the
+// occupancy index, so they are refused until the active sheet has loaded
+bool RefuseWhileLoading()
+{
+    if (!IsSheetLoading())
+    {
+        return false;
+    }
+
+    spdlog::warn("sheet {} is still loading", sheetStates[activeSheet].title);
+    return true;
+}
+
+void FinishSheetLoadsIfDone()
+{
+    for (auto &entry : sheetStates)
+    {
+        auto &state = entry.second;
+        if (!state.load.IsReady())
+        {
+            continue;
+        }
+
+        auto active = entry.first == activeSheet;
+
+        try
+        {
+            (active ? occupancy : state.occupancy) = state.load.result.get();
+        }
+        catch (const std::exception &ex)
+        {
+            // Opened again when it is shown next
+            spdlog::error("loading sheet {} failed: {}", state.title, ex.what());
+            state.opened = false;
+        }
+
+        // Tiles fetched while it loaded may miss cells. Sheets cannot be
+        // switched while the tables fill, so that load is the active one.
+        if (active)
+        {
+            fillingTables = false;
+            InvalidateTiles();
+        }
+    }
+}
+
+void SwitchSheet(
+    int sheet)
+{
+    if (sheet == activeSheet || std::find(sheetIds.begin(), sheetIds.end(), sheet) == sheetIds.end() || RefuseWhileFilling())
+    {
+        return;
+    }
+
+    SwapSheetState(sheetStates[activeSheet]);
+    activeSheet = sheet;
+    SwapSheetState(sheetStates[activeSheet]);
+
+    scroll_x = scroll_target_x;
+    scroll_y = scroll_target_y;
+
+    if (!sheetStates[activeSheet].opened)
+    {
+        OpenSheet();
+    }
+
+    ResetFind();
+    publishedLayout = nullptr;
+    InvalidateTiles();
+    UpdateScrollIndices();
+}
+
+// Ctrl+PageUp / Ctrl+PageDown
+void SwitchSheetTab(
+    int offset)
+{
+    auto tab = int(std::find(sheetIds.begin(), sheetIds.end(), activeSheet) - sheetIds.begin());
+    auto count = int(sheetIds.size());
+
+    SwitchSheet(sheetIds[(tab + count + offset) % count]);
+}
+
+void AddSheet()
+{
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    auto sheet = sheetIds.empty() ? 0 : *std::max_element(sheetIds.begin(), sheetIds.end()) + 1;
+    auto title = fmt::format("Sheet{}", sheet + 1);
+
+    try
+    {
+        db->execute("INSERT INTO sheets (id, title) VALUES (?, ?)", sheet, title);
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("adding a sheet failed: {}", db->errormsg());
+        return;
+    }
+
+    sheetIds.push_back(sheet);
+    sheetStates[sheet].title = title;
+    PublishSheetTitles();
+    SwitchSheet(sheet);
+}
+
+// The cell writes of one operation. The cell store commits once at the
+// end and the undo log gets one record. Past CellEditTileLimit cells all
+// tiles are redrawn instead of each cell's.
+struct CellEdit
+{
+    CellSnapshot before;
+    CellTransaction transaction;
+    bool recordUndo;
+    CellDeltas deltas{};
+    std::vector<std::pair<int, int>> touched{};
+    bool touchedMany = false;
+};
+
+static const size_t CellEditTileLimit = 256;
+
+CellEdit BeginCellEdit(
+    bool recordUndo = true)
+{
+    return CellEdit{cellStore->Snapshot(), cellStore->Begin(), recordUndo};
+}
+
+// The cell store shows the value right away, the cells table once the
+// journal flushes. An empty value removes the cell.
+void WriteCell(
+    CellEdit &edit,
+    int col,
+    int storageRow,
+    const std::string &value)
+{
+    if (col < 0 || storageRow < 0)
+    {
+        return;
+    }
+
+    if (edit.recordUndo)
+    {
+        auto previous = edit.before.Find(col, storageRow);
+        edit.deltas.Add(col, storageRow, previous != nullptr ? *previous : std::string(), value);
+    }
+
+    journal->SetCell(activeSheet, col, storageRow, value);
+    edit.transaction.Set(col, storageRow, value);
+
+    autoFilter.InvalidateIndex(col);
+    occupancy.Update(col, storageRow, !value.empty());
+
+    if (edit.touched.size() < CellEditTileLimit)
+    {
+        edit.touched.emplace_back(col, storageRow);
+    }
+    else
+    {
+        edit.touchedMany = true;
+    }
+}
+
+void EndCellEdit(
+    CellEdit &edit,
+    const std::string &description)
+{
+    edit.transaction.Commit();
+
+    if (edit.recordUndo)
+    {
+        undoLog->PushCells(activeSheet, description, std::move(edit.deltas));
+    }
+
+    if (edit.touchedMany)
+    {
+        InvalidateTiles();
+    }
+    else
+    {
+        for (auto const &cell : edit.touched)
+        {
+            auto displayRow = CurrentRowView().ToDisplay(cell.second);
+            if (displayRow >= 0)
+            {
+                InvalidateCell(cell.first, displayRow);
+            }
+        }
+    }
+
+    ResetFind();
+}
+
+void SetCellValue(
+    int col,
+    int storageRow,
+    const std::string &value,
+    const std::string &description)
+{
+    if (RefuseWhileLoading())
+    {
+        return;
+    }
+
+    auto edit = BeginCellEdit();
+    WriteCell(edit, col, storageRow, value);
+    EndCellEdit(edit, description);
+}
+
+// Copies the bounds of the selection as TSV, whole columns and rows up to
+// the last stored cell. A first pass sizes the text, so it is written into
+// one buffer without growing it or copying values.
+void CopySelection(
+    GLFWwindow *window)
+{
+    if (RefuseWhileLoading())
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto const &view = CurrentRowView();
+    auto bounds = selection.Bounds();
+    auto lastRow = view.RowCount() >= 0 ? view.RowCount() - 1 : occupancy.LastRow();
+    bounds.toCol = std::min(bounds.toCol, std::max(bounds.fromCol, occupancy.LastCol()));
+    bounds.toRow = std::min(bounds.toRow, std::max(bounds.fromRow, lastRow));
+
+    auto cells = cellStore->Snapshot();
+    static const std::string empty;
+
+    auto forEachRow = [&](const std::function<void(const std::string &value)> &field, const std::function<void()> &endLine)
+    {
+        for (int row = bounds.fromRow; row <= bounds.toRow; row++)
+        {
+            auto storageRow = view.ToStorage(row);
+            for (int col = bounds.fromCol; col <= bounds.toCol; col++)
+            {
+                auto value = storageRow >= 0 ? cells.Find(col, storageRow) : nullptr;
+                field(value != nullptr ? *value : empty);
+            }
+            endLine();
+        }
+    };
+
+    DelimitedWriter writer('\t');
+
+    size_t bytes = 0;
+    forEachRow([&](const std::string &value) { bytes += writer.FieldSize(value) + 1; }, []() {});
+    writer.Reserve(bytes);
+    forEachRow([&](const std::string &value) { writer.Field(value); }, [&]() { writer.EndLine(); });
+
+    glfwSetClipboardString(window, writer.Text().c_str());
+
+    auto cellCount = int64_t(bounds.toRow - bounds.fromRow + 1) * (bounds.toCol - bounds.fromCol + 1);
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("copied {} cells, {} bytes in {:.0f} ms", cellCount, writer.Size(), seconds * 1000.0);
+}
+
+// Writes TSV from the clipboard at the active cell as one operation, so it
+// is undone at once. The journal commits it in groups.
+void PasteClipboard(
+    GLFWwindow *window)
+{
+    auto text = glfwGetClipboardString(window);
+    if (text == nullptr)
+    {
+        return;
+    }
+
+    if (RefuseWhileLoading())
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto const &view = CurrentRowView();
+    auto edit = BeginCellEdit();
+    int colCount = 0;
+    int64_t cellCount = 0;
+
+    DelimitedReader reader('\t');
+    auto rowCount = reader.Parse(text, strlen(text), [&](int row, int col, const std::string &value) {
+        WriteCell(edit, active_cell_col + col, view.ToStorage(active_cell_row + row), value);
+        colCount = std::max(colCount, col + 1);
+        cellCount++;
+    });
+
+    EndCellEdit(edit, "paste");
+
+    if (rowCount > 0)
+    {
+        selection.Set(active_cell_col, active_cell_row);
+        selection.ExtendTo(active_cell_col + colCount - 1, active_cell_row + rowCount - 1);
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("pasted {} cells in {:.0f} ms", cellCount, seconds * 1000.0);
+}
+
+void JumpToMatch(
+    const CellPosition &match)
+{
+    auto displayRow = CurrentRowView().ToDisplay(match.row);
+    if (displayRow < 0)
+    {
+        // The match is hidden by the current view
+        return;
+    }
+
+    active_cell_col = match.col;
+    active_cell_row = displayRow;
+    selection.Set(active_cell_col, active_cell_row);
+    EnsureSelectionInView();
+}
+
+// Matches are ordered by storage position, so in a sorted view the cursor
+// walks the rows in their original order. Matches hidden by a filter are
+// skipped.
+void FindNext(
+    bool forward)
+{
+    if (findCursor == nullptr)
+    {
+        return;
+    }
+
+    auto from = CellPosition{active_cell_col, CurrentRowView().ToStorage(active_cell_row)};
+    auto first = -1;
+
+    CellPosition match;
+    while (forward ? findCursor->NextAfter(from.col, from.row, match) : findCursor->PreviousBefore(from.col, from.row, match))
+    {
+        if (findCursor->CurrentIndex() == first)
+        {
+            break;
+        }
+
+        if (first < 0)
+        {
+            first = findCursor->CurrentIndex();
+        }
+
+        if (CurrentRowView().ToDisplay(match.row) >= 0)
+        {
+            JumpToMatch(match);
+            break;
+        }
+
+        from = match;
+    }
+}
+
+void StartFind(
+    const std::string &query)
+{
+    if (query.empty())
+    {
+        ResetFind();
+        return;
+    }
+
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    journal->Flush();
+
+    try
+    {
+        findCursor = std::make_unique<FindCursor>(*db, activeSheet, query);
+    }
+    catch (const std::exception &ex)
+    {
+        std::cout << db->errormsg() << std::endl;
+        ResetFind();
+        return;
+    }
+
+    FindNext(true);
+}
+
+void BeginInput(
+    InputMode mode,
+    int col)
+{
+    inputMode = mode;
+    inputCol = col;
+    inputText.clear();
+
+    if (mode == InputMode::Filter && IsColumnFiltered(col))
+    {
+        inputText = autoFilter.Predicates().at(col).ToString();
+    }
+    else if (mode == InputMode::Find && findCursor != nullptr)
+    {
+        inputText = findCursor->Query();
+    }
+}
+
+void EndInput(
+    bool accept)
+{
+    auto mode = inputMode;
+    auto text = inputText;
+
+    inputMode = InputMode::None;
+    inputText.clear();
+
+    if (accept && mode == InputMode::Filter)
+    {
+        ApplyAutoFilter(inputCol, text);
+    }
+    else if (accept && mode == InputMode::Edit)
+    {
+        SetCellValue(inputCol, CurrentRowView().ToStorage(active_cell_row), text, "edit");
+        MoveSelectionDown(false);
+    }
+    else if (accept && mode == InputMode::Find)
+    {
+        StartFind(text);
+    }
+    else if (accept && mode == InputMode::Export)
+    {
+        StartExport(text);
+    }
+
+    inputCol = -1;
+}
+
+std::string InputPrompt()
+{
+    switch (inputMode)
+    {
+        case InputMode::Filter:
+            return fmt::format("filter {}: ", columnIndexToLetters(inputCol + 1));
+        case InputMode::Edit:
+            return fmt::format("{}{}: ", columnIndexToLetters(inputCol + 1), RowLabel(active_cell_row));
+        case InputMode::Find:
+            return "find: ";
+        case InputMode::Export:
+            return "export to (.csv, .tsv or .pcw): ";
+        default:
+            return std::string();
+    }
+}
+
+void CharCallback(
+    GLFWwindow *window,
+    unsigned int codepoint)
+{
+    (void)window;
+
+    if (inputMode == InputMode::None)
+    {
+        // Typing on a cell starts editing it
+        BeginInput(InputMode::Edit, active_cell_col);
+    }
+
+    AppendUtf8(inputText, codepoint);
+}
+
+void SetColDelta(
+    int col,
+    int delta)
+{
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    journal->SetColSize(activeSheet, col, delta);
+
+    sheetLayout.cols.SetDelta(col, delta);
+    InvalidateTiles();
+}
+
+void SetRowDelta(
+    int row,
+    int delta)
+{
+    if (RefuseWhileFilling())
+    {
+        return;
+    }
+
+    journal->SetRowSize(activeSheet, row, delta);
+
+    sheetLayout.rows.SetDelta(row, delta);
+    InvalidateTiles();
+}
+
+// Undoes or redoes the latest operation, on the sheet it was made on. Cell
+// records are written back as one edit that is not recorded again.
+void UndoOrRedo(
+    bool redo)
+{
+    auto sheet = undoLog->NextSheet(redo);
+    if (sheet >= 0)
+    {
+        SwitchSheet(sheet);
+    }
+
+    if (RefuseWhileLoading())
+    {
+        return;
+    }
+
+    auto edit = BeginCellEdit(false);
+    auto setCell = [&edit](int col, int row, const std::string &value) { WriteCell(edit, col, row, value); };
+
+    UndoRecord record;
+    auto applied = redo ? undoLog->Redo(record, setCell) : undoLog->Undo(record, setCell);
+
+    EndCellEdit(edit, record.description);
+
+    if (!applied)
+    {
+        return;
+    }
+
+    switch (record.kind)
+    {
+        case UndoKind::Cells:
+            break;
+        case UndoKind::ColSize:
+            SetColDelta(record.index, redo ? record.after : record.before);
+            break;
+        case UndoKind::RowSize:
+            SetRowDelta(record.index, redo ? record.after : record.before);
+            break;
+        case UndoKind::View:
+            if (redo)
+            {
+                AddRowView(record.view);
+            }
+            else
+            {
+                RemoveRowView(record.view);
+            }
+            break;
+    }
+
+    spdlog::info("{} {}", redo ? "redo" : "undo", record.description);
+}
+
+// Memory per category. Render thread caches are measured and dropped on the
+// render thread; the rest is measured here, on the input thread.
+static MemoryAccounting memoryAccounting;
+static bool showMemory = false;
+static std::vector<std::string> memoryTexts;
+
+void RegisterMemoryCategories()
+{
+    auto evictRender = [] { evictRenderCaches = true; };
+
+    // Categories that can give memory back come first, cheapest to rebuild
+    // first, as they are evicted in this order
+    memoryAccounting.Register(
+        "tile cells",
+        [] {
+            size_t size = 0;
+            for (auto const &tile : tileCells)
+            {
+                size += sizeof(TileCells) + tile.second->capacity() * sizeof(TileCells::value_type);
+                for (auto const &cell : *tile.second)
+                {
+                    size += std::get<2>(cell).capacity();
+                }
+            }
+            return size;
+        },
+        [] { tileCells.clear(); });
+    memoryAccounting.Register(
+        "text runs",
+        [] { return textCacheBytes.load(); },
+        evictRender);
+    memoryAccounting.Register(
+        "tiles (gpu)",
+        [] { return tileCacheBytes.load(); },
+        evictRender);
+    memoryAccounting.Register(
+        "filter index",
+        [] { return autoFilter.MemoryUsage(); },
+        [] { autoFilter.InvalidateIndexes(); });
+
+    // The workbook is an in-memory database, its pages are the data and
+    // SQLite has nothing to give back
+    memoryAccounting.Register(
+        "sqlite",
+        [] { return size_t(sqlitelib::Sqlite::memory_used()); });
+    memoryAccounting.Register(
+        "cell values",
+        [] {
+            size_t size = 0;
+            ForEachCellStore([&size](CellStore &store) {
+                auto stats = store.Stats();
+                size += stats.unpackedBytes + stats.packedBytes;
+            });
+            return size;
+        });
+    memoryAccounting.Register(
+        "occupancy",
+        [] {
+            auto size = occupancy.MemoryUsage();
+            for (auto const &entry : sheetStates)
+            {
+                size += entry.second.occupancy.MemoryUsage();
+            }
+            return size;
+        });
+    memoryAccounting.Register(
+        "layout",
+        [] { return sheetLayout.MemoryUsage() + (publishedLayout != nullptr ? publishedLayout->MemoryUsage() : 0); });
+    memoryAccounting.Register(
+        "row views",
+        [] {
+            size_t size = 0;
+            for (auto const &view : rowViews)
+            {
+                size += view->MemoryUsage();
+            }
+            return size;
+        });
+    memoryAccounting.Register(
+        "undo",
+        [] { return undoLog->MemoryUsage(); });
+    memoryAccounting.Register(
+        "glyph atlas",
+        [] { return glyphAtlasBytes.load(); });
+    memoryAccounting.Register(
+        "geometry",
+        [] { return geometryBytes.load(); });
+}
+
+void UpdateMemory()
+{
+    memoryAccounting.Update();
+    memoryTexts = showMemory ? memoryAccounting.Dump() : std::vector<std::string>();
+}
+
+void DumpMemory()
+{
+    for (auto const &line : memoryAccounting.Dump())
+    {
+        spdlog::info("memory: {}", line);
+    }
+}
+
+void KeyCallback(
+    GLFWwindow *window,
+    int key,
+    int scancode,
+    int action,
+    int mods)
+{
+    (void)scancode;
+
+    const bool extend = (mods & GLFW_MOD_SHIFT) != 0;
+
+    if (inputMode != InputMode::None)
+    {
+        if (key == GLFW_KEY_BACKSPACE && (action == GLFW_PRESS || action == GLFW_REPEAT))
+        {
+            PopUtf8(inputText);
+        }
+        else if (key == GLFW_KEY_ENTER && action == GLFW_PRESS)
+        {
+            EndInput(true);
+        }
+        else if (key == GLFW_KEY_ESCAPE && action == GLFW_RELEASE)
+        {
+            EndInput(false);
+        }
+
+        return;
+    }
+
+    if ((key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL) && (mods & GLFW_MOD_ALT))
+    {
+        StartSort(key == GLFW_KEY_DOWN);
+        return;
+    }
+    else if ((key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT) && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL) && (mods & GLFW_MOD_ALT))
+    {
+        SwitchRowView(key == GLFW_KEY_LEFT ? -1 : 1);
+        return;
+    }
+    else if (key == GLFW_KEY_BACKSPACE && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL) && (mods & GLFW_MOD_ALT))
+    {
+        RemoveCurrentRowView();
+        return;
+    }
+    else if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) && (action == GLFW_PRESS || action == GLFW_REPEAT) && (mods & GLFW_MOD_CONTROL))
+    {
+        SetZoom(sheetZoom * 1.1);
+        return;
+    }
+    else if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) && (action == GLFW_PRESS || action == GLFW_REPEAT) && (mods & GLFW_MOD_CONTROL))
+    {
+        SetZoom(sheetZoom / 1.1);
+        return;
+    }
+    else if (key == GLFW_KEY_0 && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        SetZoom(1.0);
+        return;
+    }
+    else if (key == GLFW_KEY_Z && (action == GLFW_PRESS || action == GLFW_REPEAT) && (mods & GLFW_MOD_CONTROL))
+    {
+        UndoOrRedo(extend);
+        return;
+    }
+    else if (key == GLFW_KEY_Y && (action == GLFW_PRESS || action == GLFW_REPEAT) && (mods & GLFW_MOD_CONTROL))
+    {
+        UndoOrRedo(true);
+        return;
+    }
+    else if (key == GLFW_KEY_C && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        CopySelection(window);
+        return;
+    }
+    else if (key == GLFW_KEY_V && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        PasteClipboard(window);
+        return;
+    }
+    else if (key == GLFW_KEY_E && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        BeginInput(InputMode::Export, -1);
+        return;
+    }
+    else if (key == GLFW_KEY_M && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        memoryAccounting.Update();
+        DumpMemory();
+        return;
+    }
+    else if ((key == GLFW_KEY_PAGE_UP || key == GLFW_KEY_PAGE_DOWN) && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        SwitchSheetTab(key == GLFW_KEY_PAGE_UP ? -1 : 1);
+        return;
+    }
+    else if (key == GLFW_KEY_F11 && action == GLFW_PRESS && (mods & GLFW_MOD_SHIFT))
+    {
+        AddSheet();
+        return;
+    }
+    else if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+    {
+        showMemory = !showMemory;
+        UpdateMemory();
+        return;
+    }
+    else if (key == GLFW_KEY_F && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        BeginInput(InputMode::Find, -1);
+        return;
+    }
+    else if (key == GLFW_KEY_F3 && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    {
+        FindNext(!extend);
+        return;
+    }
+    else if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+    {
+        auto storageRow = CurrentRowView().ToStorage(active_cell_row);
+        BeginInput(InputMode::Edit, active_cell_col);
+        auto value = cellStore->Snapshot().Find(active_cell_col, storageRow);
+        inputText = value != nullptr ? *value : std::string();
+        return;
+    }
+    else if (key == GLFW_KEY_DELETE && action == GLFW_PRESS)
+    {
+        SetCellValue(active_cell_col, CurrentRowView().ToStorage(active_cell_row), std::string(), "clear");
+        return;
+    }
+    else if (key == GLFW_KEY_ESCAPE && action == GLFW_RELEASE)
+    {
+        if (IsSorting())
+        {
+            sortProgress.cancelRequested = true;
+            queryExecutor.Cancel(sortQuery.id);
+        }
+        else if (IsExporting())
+        {
+            queryExecutor.Cancel(exportQuery.id);
+        }
+        else
+        {
+            running = false;
+        }
+    }
+
+    if ((key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) && (action == GLFW_PRESS || action == GLFW_REPEAT) && (mods & GLFW_MOD_CONTROL))
+    {
+        JumpVertical(key == GLFW_KEY_DOWN, extend);
+    }
+    else if ((key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT) && (action == GLFW_PRESS || action == GLFW_REPEAT) && (mods & GLFW_MOD_CONTROL))
+    {
+        JumpHorizontal(key == GLFW_KEY_RIGHT, extend);
+    }
+    else if ((key == GLFW_KEY_HOME || key == GLFW_KEY_END) && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+    {
+        JumpToCorner(key == GLFW_KEY_END, extend);
+    }
+    else if ((key == GLFW_KEY_HOME || key == GLFW_KEY_END) && action == GLFW_PRESS)
+    {
+        JumpToRowEdge(key == GLFW_KEY_END, extend);
+    }
+    else if ((key == GLFW_KEY_LEFT || (key == GLFW_KEY_TAB && mods & GLFW_MOD_SHIFT)) && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    {
+        MoveSelectionLeft(key == GLFW_KEY_LEFT && extend);
+    }
+    else if ((key == GLFW_KEY_RIGHT || key == GLFW_KEY_TAB) && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    {
+        MoveSelectionRight(key == GLFW_KEY_RIGHT && extend);
+    }
+    else if (key == GLFW_KEY_UP && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    {
+        MoveSelectionUp(extend);
+    }
+    else if (key == GLFW_KEY_DOWN && (action == GLFW_PRESS || action == GLFW_REPEAT))
+    {
+        MoveSelectionDown(extend);
+    }
+}
+
+void ScrollCallback(
+    GLFWwindow *window,
+    double xoffset,
+    double yoffset)
+{
+    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS)
+    {
+        SetZoom(sheetZoom * (yoffset > 0 ? 1.1 : 1.0 / 1.1));
+        return;
+    }
+
+    // Wheel steps scroll by pixels and are eased in by AnimateScroll
+    ScrollTo(
+        scroll_target_x - xoffset * defaultcell_w,
+        scroll_target_y - yoffset * defaultcell_h * 3,
+        true);
+}
+
+void ResizeCallback(
+    GLFWwindow *window,
+    int width,
+    int height)
+{
+    (void)window;
+
+    w = width;
+    h = height;
+}
+
+bool IsHoveringInputLine(
+    int x,
+    int y)
+{
+    if (x < inputLineOffset || y < padding || y > input_line_h - padding) return false;
+
+    return true;
+}
+
+bool GetColWidthHandle(
+    int x,
+    int y,
+    int &out_col)
+{
+    x -= header_w;
+
+    if (x < 0 || y < input_line_h || y > (input_line_h + header_h))
+    {
+        return false;
+    }
+
+    // The handle is the right border of a column
+    auto zoomed_x = scroll_x + x;
+    auto col = sheetLayout.cols.IndexAt(int64_t(zoomed_x / sheetZoom));
+    auto col_start = sheetLayout.cols.Start(col) * sheetZoom;
+    auto col_end = col_start + sheetLayout.cols.Size(col) * sheetZoom;
+
+    if (std::abs(zoomed_x - col_end) < 4)
+    {
+        out_col = col;
+        return true;
+    }
+
+    if (col > 0 && std::abs(zoomed_x - col_start) < 4)
+    {
+        out_col = col - 1;
+        return true;
+    }
+
+    return false;
+}
+
+bool GetRowHeightHandle(
+    int x,
+    int y,
+    int &out_row)
+{
+    y -= input_line_h;
+    y -= header_h;
+
+    if (y < 0 || x < 0 || x > header_w)
+    {
+        return false;
+    }
+
+    auto zoomed_y = scroll_y + y;
+    auto row = sheetLayout.rows.IndexAt(int64_t(zoomed_y / sheetZoom));
+    auto row_start = sheetLayout.rows.Start(row) * sheetZoom;
+    auto row_end = row_start + sheetLayout.rows.Size(row) * sheetZoom;
+
+    if (std::abs(zoomed_y - row_end) < 4)
+    {
+        out_row = row;
+        return true;
+    }
+
+    if (row > 0 && std::abs(zoomed_y - row_start) < 4)
+    {
+        out_row = row - 1;
+        return true;
+    }
+
+    return false;
+}
+
+bool GetCellFromScreenPos(
+    int x,
+    int y,
+    int &out_col,
+    int &out_row)
+{
+    if (y >= h - tab_bar_h)
+    {
+        return false;
+    }
+
+    x -= header_w;
+    y -= input_line_h;
+    y -= header_h;
+
+    if (x < 0 || y < 0)
+    {
+        return false;
+    }
+
+    out_col = sheetLayout.cols.IndexAt(int64_t((scroll_x + x) / sheetZoom));
+    out_row = sheetLayout.rows.IndexAt(int64_t((scroll_y + y) / sheetZoom));
+
+    return true;
+}
+
+// Tab in the bar below the cells; the one after the last sheet adds a sheet
+bool GetSheetTab(
+    int x,
+    int y,
+    int &out_tab)
+{
+    if (x < 0 || y < h - tab_bar_h)
+    {
+        return false;
+    }
+
+    out_tab = x / tab_w;
+    return out_tab <= int(sheetIds.size());
+}
+
+bool GetColFilterButton(
+    int x,
+    int y,
+    int &out_col)
+{
+    if (x < header_w || y < input_line_h || y > (input_line_h + header_h))
+    {
+        return false;
+    }
+
+    auto col = sheetLayout.cols.IndexAt(int64_t((scroll_x + x - header_w) / sheetZoom));
+    auto right = header_w + int((sheetLayout.cols.Start(col) + sheetLayout.cols.Size(col)) * sheetZoom - scroll_x);
+
+    out_col = col;
+    return x >= right - filter_button_w - 6 && x < right - 4;
+}
+
+bool GetColFromHeaderPos(
+    int x,
+    int y,
+    int &out_col)
+{
+    if (x < header_w || y < input_line_h || y > (input_line_h + header_h))
+    {
+        return false;
+    }
+
+    int row;
+    return GetCellFromScreenPos(x, input_line_h + header_h, out_col, row);
+}
+
+bool GetRowFromHeaderPos(
+    int x,
+    int y,
+    int &out_row)
+{
+    if (x < 0 || x > header_w || y < (input_line_h + header_h))
+    {
+        return false;
+    }
+
+    int col;
+    return GetCellFromScreenPos(header_w, y, col, out_row);
+}
+
+void ChangeColWidth(
+    int col,
+    int offset)
+{
+    auto newOffset = sheetLayout.cols.Size(col) - defaultcell_w + offset;
+
+    if (defaultcell_w + newOffset < 0)
+    {
+        newOffset = -(defaultcell_w - 5);
+    }
+
+    undoLog->PushSize(activeSheet, UndoKind::ColSize, col, sheetLayout.cols.Size(col) - defaultcell_w, newOffset);
+    SetColDelta(col, newOffset);
+}
+
+void ChangeRowHeight(
+    int row,
+    int offset)
+{
+    auto newOffset = sheetLayout.rows.Size(row) - defaultcell_h + offset;
+
+    if (defaultcell_h + newOffset < 0)
+    {
+        newOffset = -(defaultcell_h - 5);
+    }
+
+    undoLog->PushSize(activeSheet, UndoKind::RowSize, row, sheetLayout.rows.Size(row) - defaultcell_h, newOffset);
+    SetRowDelta(row, newOffset);
+}
+
+static int colDragging = -1;
+static int colDraggingX = -1;
+static int colDraggingStartX = -1;
+static int rowDragging = -1;
+static int rowDraggingY = -1;
+static int rowDraggingStartY = -1;
+static bool selectionDragging = false;
+
+void MouseButtonCallback(
+    GLFWwindow *window,
+    int button,
+    int action,
+    int mods)
+{
+    (void)button;
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+
+    if (action == GLFW_PRESS)
+    {
+        int col, row, tab;
+        if (GetSheetTab(x, y, tab))
+        {
+            if (tab < int(sheetIds.size()))
+            {
+                SwitchSheet(sheetIds[tab]);
+            }
+            else
+            {
+                AddSheet();
+            }
+            return;
+        }
+        else if (GetCellFromScreenPos(x, y, col, row))
+        {
+            active_cell_col = col;
+            active_cell_row = row;
+
+            if (mods & GLFW_MOD_SHIFT)
+            {
+                selection.ExtendTo(col, row);
+            }
+            else if (mods & GLFW_MOD_CONTROL)
+            {
+                selection.Add(col, row);
+            }
+            else
+            {
+                selection.Set(col, row);
+            }
+
+            selectionDragging = true;
+            return;
+        }
+        else if (GetColWidthHandle(x, y, col))
+        {
+            colDragging = col;
+            colDraggingX = x;
+            colDraggingStartX = x;
+            return;
+        }
+        else if (GetRowHeightHandle(x, y, row))
+        {
+            rowDragging = row;
+            rowDraggingY = y;
+            rowDraggingStartY = y;
+
+            return;
+        }
+        else if (GetColFilterButton(x, y, col))
+        {
+            BeginInput(InputMode::Filter, col);
+            return;
+        }
+        else if (GetColFromHeaderPos(x, y, col))
+        {
+            if (mods & GLFW_MOD_SHIFT)
+            {
+                selection.SelectColumns(selection.AnchorCol(), col, false);
+            }
+            else
+            {
+                selection.SelectColumns(col, col, (mods & GLFW_MOD_CONTROL) != 0);
+            }
+
+            active_cell_col = col;
+            active_cell_row = scroll_rows;
+            return;
+        }
+        else if (GetRowFromHeaderPos(x, y, row))
+        {
+            if (mods & GLFW_MOD_SHIFT)
+            {
+                selection.SelectRows(selection.AnchorRow(), row, false);
+            }
+            else
+            {
+                selection.SelectRows(row, row, (mods & GLFW_MOD_CONTROL) != 0);
+            }
+
+            active_cell_col = scroll_cols;
+            active_cell_row = row;
+            return;
+        }
+    }
+
+    if (action == GLFW_RELEASE)
+    {
+        selectionDragging = false;
+
+        if (colDragging >= 0)
+        {
+            ChangeColWidth(colDragging, int((colDraggingX - colDraggingStartX) / sheetZoom));
+        }
+        colDragging = -1;
+        colDraggingX = -1;
+        colDraggingStartX = -1;
+
+        if (rowDragging >= 0)
+        {
+            ChangeRowHeight(rowDragging, int((rowDraggingY - rowDraggingStartY) / sheetZoom));
+        }
+        rowDragging = -1;
+        rowDraggingY = -1;
+        rowDraggingStartY = -1;
+    }
+}
+
+static GLFWcursor *colSizeCursor = nullptr;
+static GLFWcursor *rowSizeCursor = nullptr;
+static GLFWcursor *inputLineCursor = nullptr;
+
+void CursorPosCallback(
+    GLFWwindow *window,
+    double x,
+    double y)
+{
+    (void)window;
+    (void)x;
+    (void)y;
+
+    if (colDragging >= 0)
+    {
+        colDraggingX = x;
+    }
+    else if (rowDragging >= 0)
+    {
+        rowDraggingY = y;
+    }
+    else if (selectionDragging)
+    {
+        int col, row;
+        if (GetCellFromScreenPos(x, y, col, row) && (col != active_cell_col || row != active_cell_row))
+        {
+            active_cell_col = col;
+            active_cell_row = row;
+            selection.ExtendTo(col, row);
+        }
+    }
+    else
+    {
+        int col, row;
+        if (GetColWidthHandle(x, y, col))
+        {
+            if (colSizeCursor == nullptr)
+            {
+                colSizeCursor = glfwCreateStandardCursor(GLFW_HRESIZE_CURSOR);
+            }
+
+            glfwSetCursor(window, colSizeCursor);
+
+            return;
+        }
+        else if (GetRowHeightHandle(x, y, row))
+        {
+            if (rowSizeCursor == nullptr)
+            {
+                rowSizeCursor = glfwCreateStandardCursor(GLFW_VRESIZE_CURSOR);
+            }
+
+            glfwSetCursor(window, rowSizeCursor);
+
+            return;
+        }
+        else if (IsHoveringInputLine(x, y))
+        {
+            if (inputLineCursor == nullptr)
+            {
+                inputLineCursor = glfwCreateStandardCursor(GLFW_IBEAM_CURSOR);
+            }
+
+            glfwSetCursor(window, inputLineCursor);
+        }
+        else
+        {
+            glfwSetCursor(window, nullptr);
+        }
+    }
+}
+
+std::unique_ptr<sqlitelib::Sqlite> InitDb()
+{
+    auto db = std::make_unique<sqlitelib::Sqlite>(WorkbookUri, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI);
+
+    try
+    {
+        db->execute(R"(
+  CREATE TABLE IF NOT EXISTS cells (
+    col INTEGER,
+    row INTEGER,
+    function TEXT,
+    tmp_value TEXT,
+    sheet INTEGER,
+    PRIMARY KEY (sheet, col, row)
+  )
+)");
+
+        db->execute(R"(
+  CREATE INDEX IF NOT EXISTS cells_by_row ON cells (sheet, row, col)
+)");
+
+        // Trigram index over the cell values for find, kept in sync with the
+        // cells table by triggers
+        db->execute(R"(
+  CREATE VIRTUAL TABLE IF NOT EXISTS cells_fts USING fts5(
+    tmp_value,
+    content='cells',
+    content_rowid='rowid',
+    tokenize='trigram'
+  )
+)");
+
+        db->execute(R"(
+  CREATE TRIGGER IF NOT EXISTS cells_fts_insert AFTER INSERT ON cells BEGIN
+    INSERT INTO cells_fts (rowid, tmp_value) VALUES (new.rowid, new.tmp_value);
+  END
+)");
+
+        db->execute(R"(
+  CREATE TRIGGER IF NOT EXISTS cells_fts_delete AFTER DELETE ON cells BEGIN
+    INSERT INTO cells_fts (cells_fts, rowid, tmp_value) VALUES ('delete', old.rowid, old.tmp_value);
+  END
+)");
+
+        db->execute(R"(
+  CREATE TRIGGER IF NOT EXISTS cells_fts_update AFTER UPDATE OF tmp_value ON cells BEGIN
+    INSERT INTO cells_fts (cells_fts, rowid, tmp_value) VALUES ('delete', old.rowid, old.tmp_value);
+    INSERT INTO cells_fts (rowid, tmp_value) VALUES (new.rowid, new.tmp_value);
+  END
+)");
+
+        db->execute(R"(
+  CREATE TABLE IF NOT EXISTS cols (
+    sheet INTEGER,
+    col_index INTEGER,
+    size INTEGER,
+    header TEXT,
+    PRIMARY KEY (sheet, col_index)
+  )
+)");
+
+        db->execute(R"(
+  CREATE TABLE IF NOT EXISTS rows (
+    sheet INTEGER,
+    row_index INTEGER,
+    size INTEGER,
+    PRIMARY KEY (sheet, row_index)
+  )
+)");
+
+        // Cell deltas of undo records that went over the memory budget
+        db->execute(R"(
+  CREATE TABLE IF NOT EXISTS undo_segments (
+    record INTEGER,
+    seq INTEGER,
+    data BLOB,
+    PRIMARY KEY (record, seq)
+  )
+)");
+
+        db->execute(R"(
+  CREATE TABLE IF NOT EXISTS sheets (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    title TEXT
+  )
+)");
+    }
+    catch (const std::exception &ex)
+    {
+        std::cout << db->errormsg() << std::endl;
+    }
+
+    return db;
+}
+
+#include <rapidcsv.h>
+
+void LoadFileIntoDb(
+    const std::string &filename,
+    bool fileNameFirstLineHeader)
+{
+    if (!std::filesystem::exists(filename))
+    {
+        std::cerr << "Input file does not exists: " << filename << std::endl;
+        return;
+    }
+
+    rapidcsv::Document doc(
+        filename,
+        rapidcsv::LabelParams(fileNameFirstLineHeader ? 0 : -1, -1),
+        rapidcsv::SeparatorParams(','));
+
+    auto columnNames = doc.GetColumnNames();
+
+    // Edits made before the import are written first, it replaces them. The
+    // import goes into the active sheet.
+    journal->Flush();
+
+    db->execute("DELETE FROM cols WHERE sheet = ?;", activeSheet);
+    db->execute("DELETE FROM rows WHERE sheet = ?;", activeSheet);
+    for (size_t c = 0; c < columnNames.size(); c++)
+    {
+        db->execute("INSERT INTO cols (sheet, col_index, size, header) VALUES (?, ?, 0, ?);", activeSheet, int(c), columnNames[c]);
+    }
+
+    db->execute("DELETE FROM cells WHERE sheet = ?;", activeSheet);
+    autoFilter.InvalidateIndexes();
+    ResetFind();
+
+    // One transaction for the whole import, the fts triggers fire per row.
+    // Readers of the cell store keep seeing the previous contents until it
+    // commits too.
+    auto transaction = cellStore->Begin();
+    transaction.Clear();
+
+    db->execute("BEGIN;");
+    for (size_t r = 0; r < doc.GetRowCount(); r++)
+    {
+        auto row = doc.GetRow<std::string>(r);
+
+        for (size_t c = 0; c < row.size(); c++)
+        {
+            db->execute("INSERT INTO cells (col, row, function, tmp_value, sheet) VALUES (?, ?, ?, ?, ?);", int(c), int(r), row[c], row[c], activeSheet);
+            transaction.Set(int(c), int(r), row[c]);
+        }
+    }
+    db->execute("COMMIT;");
+    transaction.Commit();
+
+    occupancy.Build(*db, activeSheet);
+    sheetLayout.Load(*db, activeSheet);
+    headerLabels.Load(*db, activeSheet);
+    InvalidateTiles();
+}
+
+// Opens a native workbook file. Only the layout goes into the tables right
+// away and the first frame is read from the mapped file, so just the rows on
+// screen are touched. The cell store of the first sheet, the cells table and
+// its occupancy index are filled on the query executor like a sheet load,
+// with the file kept mapped until it is done.
+void LoadWorkbookFile(
+    const std::string &filename)
+{
+    auto file = std::make_shared<WorkbookFile>();
+    if (!file->Open(filename))
+    {
+        return;
+    }
+
+    // Edits made before the load are written first, it replaces them
+    journal->Flush();
+
+    if (!file->LoadLayoutInto(*db))
+    {
+        return;
+    }
+
+    autoFilter.InvalidateIndexes();
+    ResetFind();
+
+    // The other sheets are opened from the tables when they are shown
+    LoadSheets();
+    activeSheet = sheetIds.front();
+    auto &state = sheetStates[activeSheet];
+    state.opened = true;
+
+    cellStore = std::make_unique<CellStore>();
+    cellStore->SetMemoryBudget(cellMemoryBudget);
+    occupancy.Clear(activeSheet);
+    sheetLayout.Load(*db, activeSheet);
+    headerLabels.Load(*db, activeSheet);
+    UpdateScrollIndices();
+
+    auto all = std::numeric_limits<int>::max();
+    auto lastRow = sheetLayout.rows.IndexAt(int64_t((scroll_target_y + h) / sheetZoom)) + 1;
+    auto transaction = cellStore->Begin();
+    file->ForEach(activeSheet, 0, scroll_rows, all, lastRow, [&transaction](int sheet, int col, int row, const std::string &value) {
+        (void)sheet;
+        transaction.Set(col, row, value);
+    });
+    transaction.Commit();
+    InvalidateTiles();
+
+    // The first half of the progress is the cell store, the second the table
+    auto progress = std::make_shared<std::atomic<int>>(0);
+    state.loadPermille = progress;
+    fillingTables = true;
+    state.load = queryExecutor.Submit<OccupancyIndex>([file, sheet = activeSheet, store = cellStore.get(), progress, all](sqlitelib::Sqlite &db) {
+        auto lastRow = file->LastRow(sheet);
+        for (int fromRow = 0; fromRow <= lastRow; fromRow += SheetLoadRows)
+        {
+            auto transaction = store->Begin();
+            file->ForEach(sheet, 0, fromRow, all, std::min(lastRow, fromRow + SheetLoadRows - 1), [&transaction](int sheet, int col, int row, const std::string &value) {
+                (void)sheet;
+                transaction.Set(col, row, value);
+            });
+            transaction.Commit();
+            *progress = int(int64_t(fromRow + SheetLoadRows) * 500 / (lastRow + 1));
+        }
+
+        auto cellCount = std::max(uint64_t(1), file->CellCount());
+        auto filled = file->LoadCellsInto(db, [&progress, cellCount](uint64_t cells) {
+            *progress = 500 + int(cells * 500 / cellCount);
+        });
+        if (!filled)
+        {
+            throw std::runtime_error("filling the cells table failed");
+        }
+
+        OccupancyIndex index;
+        index.Build(db, sheet);
+        return index;
+    });
+
+    spdlog::info("opened {}: {} cells", filename, file->CellCount());
+}
+
+// Collects the cell values of one tile, in the rows of the current view. The
+// origin is in zoomed pixels, like the tile cache's.
+std::shared_ptr<const TileCells> FetchTileCells(
+    const CellSnapshot &snapshot,
+    int64_t origin_x,
+    int64_t origin_y,
+    int size)
+{
+    auto const &cols = sheetLayout.cols;
+    auto const &rows = sheetLayout.rows;
+
+    auto sheet_x = origin_x / sheetZoom, sheet_y = origin_y / sheetZoom;
+    auto sheet_size = size / sheetZoom;
+
+    auto from_col = cols.IndexAt(int64_t(sheet_x)), to_col = cols.IndexAt(int64_t(sheet_x + sheet_size));
+    auto from_row = rows.IndexAt(int64_t(sheet_y)), to_row = rows.IndexAt(int64_t(sheet_y + sheet_size));
+
+    auto cells = std::make_shared<TileCells>();
+    const auto &view = CurrentRowView();
+
+    if (view.IsIdentity())
+    {
+        snapshot.ForEach(from_col, from_row, to_col, to_row, [&cells](int col, int row, const std::string &value) {
+            cells->push_back(std::make_tuple(col, row, value));
+        });
+    }
+    else
+    {
+        for (int row = from_row; row <= to_row; row++)
+        {
+            auto storage_row = view.ToStorage(row);
+            if (storage_row < 0)
+            {
+                break;
+            }
+
+            snapshot.ForEach(from_col, storage_row, to_col, storage_row, [&cells, row](int col, int, const std::string &value) {
+                cells->push_back(std::make_tuple(col, row, value));
+            });
+        }
+    }
+
+    return cells;
+}
+
+// Takes everything the next frame shows from the model and hands it to the
+// render thread. Runs on the input thread after each round of events.
+void PublishSnapshot(
+    const std::vector<std::string> &statusTexts)
+{
+    auto &snap = snapshots.Back();
+    auto const &cols = sheetLayout.cols;
+    auto const &rows = sheetLayout.rows;
+
+    // The layout is copied only after a column or row was resized
+    if (publishedLayout == nullptr || publishedLayout->cols.Version() != cols.Version() || publishedLayout->rows.Version() != rows.Version())
+    {
+        publishedLayout = std::make_shared<const SheetLayout>(sheetLayout);
+    }
+
+    snap.width = w;
+    snap.height = h;
+    snap.scrollX = scroll_x;
+    snap.scrollY = scroll_y;
+    snap.zoom = sheetZoom;
+    snap.scrollCols = scroll_cols;
+    snap.scrollRows = scroll_rows;
+    snap.activeCol = active_cell_col;
+    snap.activeRow = active_cell_row;
+    snap.layout = publishedLayout;
+    snap.rowView = rowViews[activeRowView];
+    snap.selection = selection;
+    snap.autoFilterVersion = autoFilterVersion;
+    snap.inputActive = inputMode != InputMode::None;
+    snap.inputPrompt = InputPrompt();
+    snap.inputText = inputText;
+    snap.statusTexts = statusTexts;
+    snap.sheetTitles = sheetTitles;
+    snap.activeSheetTab = int(std::find(sheetIds.begin(), sheetIds.end(), activeSheet) - sheetIds.begin());
+    snap.memoryTexts = memoryTexts;
+    snap.colDraggingX = colDraggingX;
+    snap.rowDraggingY = rowDraggingY;
+
+    auto origin_x = int64_t(std::floor(scroll_x)), origin_y = int64_t(std::floor(scroll_y));
+    const int cells_y = input_line_h + header_h;
+    const int cells_h = h - tab_bar_h - cells_y;
+    auto cells = cellStore->Snapshot();
+
+    try
+    {
+        // One column and row more than the screen edge falls in, rounding of
+        // the zoomed borders can move it into view
+        auto last_col = cols.IndexAt(int64_t((origin_x + w - header_w) / sheetZoom)) + 1;
+        auto last_row = rows.IndexAt(int64_t((origin_y + cells_h) / sheetZoom)) + 1;
+
+        for (int col = scroll_cols; col <= last_col; col++)
+        {
+            snap.colFiltered.push_back(IsColumnFiltered(col));
+        }
+
+        snap.colLabels = headerLabels.Cols(scroll_cols, last_col);
+        snap.rowLabels = headerLabels.Rows(rowViews[activeRowView], scroll_rows, last_row);
+
+        auto value = cells.Find(active_cell_col, CurrentRowView().ToStorage(active_cell_row));
+        if (!snap.inputActive && value != nullptr)
+        {
+            snap.activeValue = *value;
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::cout << db->errormsg() << std::endl;
+    }
+
+    // Cells of the tiles the render thread composites for this scroll
+    // position; tiles scrolled out of view are dropped once the fetched
+    // tiles outnumber the visible ones a few times
+    for (auto const &key : TileCache::TilesOverlapping(origin_x, origin_y, origin_x + w - header_w, origin_y + cells_h))
+    {
+        auto found = tileCells.find(key);
+        if (found == tileCells.end())
+        {
+            found = tileCells.emplace(key, FetchTileCells(cells, key.first * TileCache::TileSize, key.second * TileCache::TileSize, TileCache::TileSize)).first;
+        }
+
+        snap.tiles.insert(*found);
+    }
+
+    if (tileCells.size() > snap.tiles.size() * 4)
+    {
+        for (auto it = tileCells.begin(); it != tileCells.end();)
+        {
+            it = snap.tiles.count(it->first) == 0 ? tileCells.erase(it) : std::next(it);
+        }
+    }
+
+    snapshots.Publish();
+}
+
+// Limits drawing to a rectangle in top down window coordinates
+void ClipTo(
+    int x,
+    int y,
+    int width,
+    int height)
+{
+    renderer->SetClip(x, y, width, height);
+}
+
+// Draws the grid lines and cell values of one tile. The origin is in zoomed
+// pixels; content is drawn in sheet pixels relative to it, scaled by the
+// zoom factor through the renderer transform.
+void RenderTileContent(
+    const ViewSnapshot &snap,
+    int64_t origin_x,
+    int64_t origin_y,
+    int size)
+{
+    auto const &cols = snap.layout->cols;
+    auto const &rows = snap.layout->rows;
+
+    auto sheet_x = origin_x / snap.zoom, sheet_y = origin_y / snap.zoom;
+    auto sheet_size = size / snap.zoom;
+
+    auto from_col = cols.IndexAt(int64_t(sheet_x)), to_col = cols.IndexAt(int64_t(sheet_x + sheet_size));
+    auto from_row = rows.IndexAt(int64_t(sheet_y)), to_row = rows.IndexAt(int64_t(sheet_y + sheet_size));
+
+    renderer->PushTransform(0.0f, 0.0f, float(snap.zoom));
+
+    const glm::vec4 grid_color(0.79f, 0.79f, 0.79f, 1.0f);
+    for (int col = from_col; col <= to_col + 1; col++)
+    {
+        auto x = float(cols.Start(col) - sheet_x);
+        renderer->DrawLine(x, 0.0f, x, float(sheet_size), grid_color);
+    }
+    for (int row = from_row; row <= to_row + 1; row++)
+    {
+        auto y = float(rows.Start(row) - sheet_y);
+        renderer->DrawLine(0.0f, y, float(sheet_size), y, grid_color);
+    }
+
+    // Values are cut off at their cell border
+    auto tile = snap.tiles.find(TileCache::TileKey(origin_x / size, origin_y / size));
+    if (tile != snap.tiles.end())
+    {
+        for (auto const &cell : *tile->second)
+        {
+            auto col = std::get<0>(cell);
+
+            my_stbtt_print_clipped(
+                float(cols.Start(col) - sheet_x) + cell_padding,
+                float(rows.Start(std::get<1>(cell)) - sheet_y) + fontSize * 1.2f,
+                std::get<2>(cell),
+                glm::vec4(0.3f, 0.3f, 0.3f, 1.0f),
+                float(cols.Size(col)) - cell_padding * 2);
+        }
+    }
+
+    renderer->PopTransform();
+}
+
+// Widths of the labels in the last drawn ranges, measured again only when a
+// snapshot brings other ranges
+struct MeasuredLabels
+{
+    std::shared_ptr<const LabelRange> labels;
+    std::vector<float> widths;
+};
+
+static MeasuredLabels colLabelWidths;
+static MeasuredLabels rowLabelWidths;
+
+static const std::vector<float> &LabelWidths(
+    MeasuredLabels &measured,
+    const std::shared_ptr<const LabelRange> &labels)
+{
+    if (measured.labels != labels)
+    {
+        measured.labels = labels;
+        measured.widths.clear();
+        for (auto const &label : labels->labels)
+        {
+            measured.widths.push_back(my_stbtt_print_width(label));
+        }
+    }
+
+    return measured.widths;
+}
+
+void renderSheet(
+    const ViewSnapshot &snap)
+{
+    // The sheet tabs are below the cells
+    auto const w = snap.width, h = snap.height - tab_bar_h;
+    auto const scroll_cols = snap.scrollCols, scroll_rows = snap.scrollRows;
+    auto const active_cell_col = snap.activeCol, active_cell_row = snap.activeRow;
+    auto const &cols = snap.layout->cols;
+    auto const &rows = snap.layout->rows;
+    auto origin_x = int64_t(std::floor(snap.scrollX)), origin_y = int64_t(std::floor(snap.scrollY));
+    const int cells_y = input_line_h + header_h;
+
+    // Render header backgrounds and the input line
+    auto strwidth = my_stbtt_print_width(">_");
+    auto input_line_offset = strwidth + padding + padding;
+    inputLineOffset = input_line_offset;
+
+    auto chrome_key = std::make_tuple(w, h, input_line_offset);
+    if (chrome_key != chromeKey)
+    {
+        chromeKey = chrome_key;
+        chromeGeometry.Clear();
+
+        chromeGeometry.SetColor(0.85f, 0.85f, 0.85f);
+        chromeGeometry.AddRect(0.0f, 0.0f, w, input_line_h + header_h);
+        chromeGeometry.AddRect(0.0f, input_line_h, header_w, input_line_h + h);
+
+        chromeGeometry.SetColor(1.0f, 1.0f, 1.0f);
+        chromeGeometry.AddRect(input_line_offset, padding, w, input_line_h - padding);
+    }
+    chromeGeometry.Draw(*renderer);
+
+    my_stbtt_print(
+        padding,
+        (input_line_h + padding) / 2.0f,
+        ">_",
+        glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+
+    if (snap.inputActive)
+    {
+        my_stbtt_print(
+            input_line_offset + padding,
+            (input_line_h + padding) / 2.0f,
+            snap.inputPrompt,
+            glm::vec4(0.4f, 0.55f, 0.65f, 1.0f));
+
+        auto text_x = input_line_offset + padding + my_stbtt_print_width(snap.inputPrompt);
+
+        my_stbtt_print(
+            text_x,
+            (input_line_h + padding) / 2.0f,
+            snap.inputText,
+            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+
+        my_stbtt_print(
+            text_x + my_stbtt_print_width(snap.inputText),
+            (input_line_h + padding) / 2.0f,
+            "_",
+            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    }
+    else
+    {
+        my_stbtt_print(
+            input_line_offset + padding,
+            (input_line_h + padding) / 2.0f,
+            snap.activeValue,
+            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    }
+
+    // Screen positions of the visible columns and rows, the first one may
+    // start left of or above the cell area
+    auto selected_x = 0, selected_y = 0;
+    auto selected_w = 0, selected_h = 0;
+    FrameVector<int> visible_col_x{ArenaAllocator<int>(frameArena)};
+    FrameVector<int> visible_row_y{ArenaAllocator<int>(frameArena)};
+
+    // Positions are computed from the layout for every border, so zoomed
+    // sizes do not accumulate rounding errors
+    auto col_x = [&](int col) { return header_w + int(std::floor(cols.Start(col) * snap.zoom - origin_x)); };
+    auto row_y = [&](int row) { return cells_y + int(std::floor(rows.Start(row) * snap.zoom - origin_y)); };
+
+    int i = scroll_cols;
+    int x = col_x(i);
+    while (x < w)
+    {
+        visible_col_x.push_back(x);
+
+        if (i == active_cell_col)
+        {
+            selected_x = x;
+            selected_w = col_x(i + 1) - x;
+        }
+
+        x = col_x(++i);
+    }
+    visible_col_x.push_back(x);
+
+    i = scroll_rows;
+    int y = row_y(i);
+    while (y < h)
+    {
+        visible_row_y.push_back(y);
+
+        if (i == active_cell_row)
+        {
+            selected_y = y;
+            selected_h = row_y(i + 1) - y;
         }
 
-        if (std::abs(x - sum_colwidths) < 4)
+        y = row_y(++i);
+    }
+    visible_row_y.push_back(y);
+
+    // Render cells from the tile cache
+    tileCache.Draw(
+        origin_x,
+        origin_y,
+        header_w,
+        cells_y,
+        w - header_w,
+        h - cells_y,
+        [&snap](int64_t tile_x, int64_t tile_y, int size) { RenderTileContent(snap, tile_x, tile_y, size); });
+
+    // Render header lines
+    auto grid_key = std::make_tuple(origin_x, origin_y, snap.zoom, w, h, cols.Version(), rows.Version());
+    if (grid_key != gridKey)
+    {
+        gridKey = grid_key;
+        gridGeometry.Clear();
+
+        gridGeometry.SetColor(0.79f, 0.79f, 0.79f);
+        for (auto col_x : visible_col_x)
         {
-            out_col = col;
-            return true;
+            if (col_x >= header_w)
+            {
+                gridGeometry.AddLine(float(col_x), float(input_line_h), float(col_x), float(cells_y));
+            }
         }
-
-        if (x - sum_colwidths < 0)
+        for (auto row_y : visible_row_y)
         {
-            break;
+            if (row_y >= cells_y)
+            {
+                gridGeometry.AddLine(0.0f, float(row_y), float(header_w), float(row_y));
+            }
         }
-
-        col++;
     }
+    gridGeometry.Draw(*renderer);
 
-    return false;
-}
-
-bool GetRowHeightHandle(
-    int x,
-    int y,
-    int &out_row)
-{
-    y -= input_line_h;
-    y -= header_h;
+    if (snap.colDraggingX >= 0)
+    {
+        renderer->DrawLine(float(snap.colDraggingX), float(input_line_h), float(snap.colDraggingX), float(h), glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    }
 
-    if (y < 0 || x < 0 || x > header_w)
+    if (snap.rowDraggingY >= 0)
     {
-        return false;
+        renderer->DrawLine(0.0f, float(snap.rowDraggingY), float(w), float(snap.rowDraggingY), glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
     }
 
-    auto rows_map = select_into_map("SELECT row_index, size FROM rows");
+    // Render selected ranges, the selected cell and its headers and the
+    // auto filter buttons
+    auto overlay_key = std::make_tuple(grid_key, snap.selection.Version(), active_cell_col, active_cell_row, snap.rowView.get(), snap.autoFilterVersion);
+    if (overlay_key != overlayKey)
+    {
+        overlayKey = overlay_key;
+        overlayGeometry.Clear();
 
-    int row = scroll_rows;
-    int sum_rowheights = 0;
+        // Selected ranges, clipped to the visible window
+        auto last_visible_col = scroll_cols + int(visible_col_x.size()) - 2;
+        auto last_visible_row = scroll_rows + int(visible_row_y.size()) - 2;
+        auto visible_range = CellRange::FromCorners(
+            scroll_cols,
+            scroll_rows,
+            last_visible_col,
+            last_visible_row);
 
-    while (true)
-    {
-        auto size = rows_map.find(row);
-        if (size != rows_map.end())
+        std::vector<CellRange> selected_ranges;
+        if (visible_col_x.size() > 1 && visible_row_y.size() > 1)
         {
-            sum_rowheights += defaultcell_h + size->second;
+            selected_ranges = snap.selection.Clip(visible_range);
         }
-        else
+
+        for (auto const &range : selected_ranges)
         {
-            sum_rowheights += defaultcell_h;
+            auto x0 = float(visible_col_x[range.fromCol - scroll_cols]);
+            auto x1 = float(visible_col_x[range.toCol - scroll_cols + 1]);
+            auto y0 = float(visible_row_y[range.fromRow - scroll_rows]);
+            auto y1 = float(visible_row_y[range.toRow - scroll_rows + 1]);
+
+            overlayGeometry.SetClip(header_w, cells_y, w, h);
+            overlayGeometry.SetColor(0.4f, 0.55f, 0.65f, 0.15f);
+            overlayGeometry.AddRect(x0, y0, x1, y1);
+
+            if (!snap.selection.IsSingleCell())
+            {
+                overlayGeometry.SetColor(0.4f, 0.55f, 0.65f);
+                overlayGeometry.AddFrame(x0, y0, x1 + 1.0f, y1 + 1.0f, 1.0f);
+            }
+
+            overlayGeometry.SetColor(0.4f, 0.55f, 0.65f, 0.35f);
+            overlayGeometry.SetClip(header_w, input_line_h, w, cells_y);
+            overlayGeometry.AddRect(x0, float(input_line_h), x1, float(cells_y));
+            overlayGeometry.SetClip(0.0f, cells_y, header_w, h);
+            overlayGeometry.AddRect(0.0f, y0, float(header_w), y1);
         }
 
-        if (std::abs(y - sum_rowheights) < 4)
+        // Selected col and row header
+        overlayGeometry.SetColor(0.4f, 0.55f, 0.65f);
+        overlayGeometry.SetClip(header_w, input_line_h, w, cells_y);
+        overlayGeometry.AddRect(float(selected_x), float(input_line_h), float(selected_x + selected_w), float(cells_y));
+        overlayGeometry.SetClip(0.0f, cells_y, header_w, h);
+        overlayGeometry.AddRect(0.0f, float(selected_y), float(header_w), float(selected_y + selected_h));
+
+        // Auto filter buttons, highlighted for filtered columns
+        for (size_t c = 0; c + 1 < visible_col_x.size(); c++)
         {
-            out_row = row;
-            return true;
+            auto right = float(visible_col_x[c + 1]) - 6.0f;
+            auto top = float(input_line_h) + (header_h / 2.0f) - 3.0f;
+
+            if (right - filter_button_w < header_w)
+            {
+                continue;
+            }
+
+            if (c < snap.colFiltered.size() && snap.colFiltered[c])
+            {
+                overlayGeometry.SetColor(0.2f, 0.45f, 0.8f);
+            }
+            else
+            {
+                overlayGeometry.SetColor(0.6f, 0.6f, 0.6f);
+            }
+
+            overlayGeometry.AddTriangle(
+                right - filter_button_w,
+                top,
+                right,
+                top,
+                right - (filter_button_w / 2.0f),
+                top + 6.0f);
         }
 
-        if (y - sum_rowheights < 0)
+        // Selected cell
+        if (selected_w > 0 && selected_h > 0)
         {
-            break;
+            overlayGeometry.SetColor(0.4f, 0.55f, 0.65f);
+            overlayGeometry.SetClip(header_w, cells_y, w, h);
+            overlayGeometry.AddFrame(float(selected_x), float(selected_y), float(selected_x + selected_w + 1), float(selected_y + selected_h + 1), 2.0f);
         }
-
-        row++;
+        overlayGeometry.ResetClip();
     }
+    overlayGeometry.Draw(*renderer);
 
-    return false;
-}
-
-bool GetCellFromScreenPos(
-    int x,
-    int y,
-    int &out_col,
-    int &out_row)
-{
-    x -= header_w;
-    y -= input_line_h;
-    y -= header_h;
-
-    if (x < 0 || y < 0)
+    if (snap.colLabels == nullptr || snap.rowLabels == nullptr)
     {
-        return false;
+        renderer->ResetClip();
+        return;
     }
 
-    auto cols_map = select_into_map("SELECT col_index, size FROM cols");
-    auto rows_map = select_into_map("SELECT row_index, size FROM rows");
+    auto const &col_widths = LabelWidths(colLabelWidths, snap.colLabels);
+    auto const &row_widths = LabelWidths(rowLabelWidths, snap.rowLabels);
 
-    int col = scroll_cols;
-    int row = scroll_rows;
-
-    while (true)
+    // Render col names
+    ClipTo(header_w, input_line_h, w - header_w, header_h);
+    for (size_t c = 0; c + 1 < visible_col_x.size(); c++)
     {
-        auto colw = cols_map.find(col);
-        if (colw != cols_map.end())
-        {
-            x -= defaultcell_w + colw->second;
-        }
-        else
+        auto col = scroll_cols + int(c);
+
+        // The selected column is labeled below, over its highlight
+        if (col == active_cell_col)
         {
-            x -= defaultcell_w;
+            continue;
         }
 
-        if (x < 0)
+        auto str = snap.colLabels->Find(col);
+        if (str == nullptr)
         {
             break;
         }
 
-        col++;
+        auto fromx = visible_col_x[c];
+        auto tox = visible_col_x[c + 1];
+
+        // Labels wider than their column are cut off
+        auto maxwidth = float(tox - fromx) - cell_padding * 2;
+        auto strwidth = std::min(col_widths[col - snap.colLabels->first], maxwidth);
+
+        my_stbtt_print_clipped(
+            fromx + ((tox - fromx) / 2.0f) - (strwidth / 2.0f),
+            input_line_h + fontSize * 1.2f,
+            *str,
+            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f),
+            maxwidth);
     }
 
-    while (true)
+    // Render row #
+    ClipTo(0, cells_y, header_w, h - cells_y);
+    for (size_t r = 0; r + 1 < visible_row_y.size(); r++)
     {
-        auto rowh = rows_map.find(row);
-        if (rowh != rows_map.end())
-        {
-            y -= defaultcell_h + rowh->second;
-        }
-        else
+        auto row = scroll_rows + int(r);
+        if (row == active_cell_row)
         {
-            y -= defaultcell_h;
+            continue;
         }
 
-        if (y < 0)
+        auto fpsstr = snap.rowLabels->Find(row);
+        if (fpsstr == nullptr)
         {
             break;
         }
 
-        row++;
-    }
+        auto strwidth = row_widths[row - snap.rowLabels->first];
 
-    out_col = col;
-    out_row = row;
+        my_stbtt_print(
+            (header_w / 2.0f) - (strwidth / 2.0f),
+            visible_row_y[r] + (fontSize * 1.2f),
+            *fpsstr,
+            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    }
 
-    return true;
-}
+    // Render selected col and row labels, when on screen
+    auto active_col_label = snap.colLabels->Find(active_cell_col);
+    if (active_col_label != nullptr && selected_w > 0)
+    {
+        ClipTo(header_w, input_line_h, w - header_w, header_h);
 
-void ChangeColWidth(
-    int col,
-    int offset)
-{
-    auto newOffset = db->execute_value<int>("SELECT size FROM cols WHERE col_index = ?", col) + offset;
+        auto maxwidth = float(selected_w) - cell_padding * 2;
+        auto strwidth = std::min(col_widths[active_cell_col - snap.colLabels->first], maxwidth);
 
-    if (defaultcell_w + newOffset < 0)
-    {
-        newOffset = -(defaultcell_w - 5);
+        my_stbtt_print_clipped(
+            selected_x + (selected_w / 2.0f) - (strwidth / 2.0f),
+            input_line_h + fontSize * 1.2f,
+            *active_col_label,
+            glm::vec4(1.0f, 1.0f, 1.0, 1.0f),
+            maxwidth);
     }
 
-    db->execute(R"(REPLACE INTO cols (col_index, size) VALUES (?, ?);)", col, newOffset);
-}
+    auto active_row_label = snap.rowLabels->Find(active_cell_row);
+    if (active_row_label != nullptr && selected_h > 0)
+    {
+        ClipTo(0, cells_y, header_w, h - cells_y);
 
-void ChangeRowHeight(
-    int row,
-    int offset)
-{
-    auto newOffset = db->execute_value<int>("SELECT size FROM rows WHERE row_index = ?", row) + offset;
+        auto strwidth = row_widths[active_cell_row - snap.rowLabels->first];
 
-    if (defaultcell_h + newOffset < 0)
-    {
-        newOffset = -(defaultcell_h - 5);
+        my_stbtt_print(
+            (header_w / 2.0f) - (strwidth / 2.0f),
+            selected_y + (fontSize * 1.2f),
+            *active_row_label,
+            glm::vec4(1.0f, 1.0f, 1.0, 1.0f));
     }
 
-    db->execute(R"(REPLACE INTO rows (row_index, size) VALUES (?, ?);)", row, newOffset);
+    renderer->ResetClip();
 }
 
-static int colDragging = -1;
-static int colDraggingX = -1;
-static int colDraggingStartX = -1;
-static int rowDragging = -1;
-static int rowDraggingY = -1;
-static int rowDraggingStartY = -1;
-
-void MouseButtonCallback(
-    GLFWwindow *window,
-    int button,
-    int action,
-    int mods)
+static unsigned int aggregateVersion = 0;
+static unsigned int seenSelectionVersion = 0;
+static double seenSelectionTime = 0;
+static SelectionAggregate selectionAggregate;
+static QueryHandle<SelectionAggregate> aggregateQuery;
+static unsigned int aggregateQueryVersion = 0;
+static int aggregateSheet = 0;
+
+// Aggregates stream every selected cell, so they are only computed once the
+// selection has been stable for a moment instead of on every shift+arrow.
+// They run on the query executor; changing the selection cancels the
+// aggregate of the previous one.
+void UpdateSelectionAggregate(
+    double time)
 {
-    (void)button;
-    (void)mods;
+    // Selections of different sheets count their versions separately, so
+    // switching drops the aggregate and the one still running
+    if (aggregateSheet != activeSheet)
+    {
+        if (aggregateQuery.IsPending())
+        {
+            queryExecutor.Cancel(aggregateQuery.id);
+            aggregateQuery = QueryHandle<SelectionAggregate>();
+        }
 
-    double x, y;
-    glfwGetCursorPos(window, &x, &y);
+        aggregateSheet = activeSheet;
+        aggregateVersion = 0;
+        seenSelectionVersion = selection.Version() + 1;
+        selectionAggregate = SelectionAggregate();
+    }
 
-    if (action == GLFW_PRESS)
+    if (aggregateQuery.IsReady())
     {
-        int col, row;
-        if (GetCellFromScreenPos(x, y, col, row))
+        try
         {
-            active_cell_col = col;
-            active_cell_row = row;
-            return;
+            selectionAggregate = aggregateQuery.result.get();
+            aggregateVersion = aggregateQueryVersion;
         }
-        else if (GetColWidthHandle(x, y, col))
+        catch (const QueryCancelled &ex)
         {
-            colDragging = col;
-            colDraggingX = x;
-            colDraggingStartX = x;
-            return;
+            // The selection changed while it ran
         }
-        else if (GetRowHeightHandle(x, y, row))
+        catch (const std::exception &ex)
         {
-            rowDragging = row;
-            rowDraggingY = y;
-            rowDraggingStartY = y;
-
-            return;
+            spdlog::error("aggregating the selection failed: {}", ex.what());
+            aggregateVersion = aggregateQueryVersion;
         }
     }
 
-    if (action == GLFW_RELEASE)
+    if (selection.Version() != seenSelectionVersion)
     {
-        if (colDragging >= 0)
-        {
-            ChangeColWidth(colDragging, colDraggingX - colDraggingStartX);
-        }
-        colDragging = -1;
-        colDraggingX = -1;
-        colDraggingStartX = -1;
+        seenSelectionVersion = selection.Version();
+        seenSelectionTime = time;
 
-        if (rowDragging >= 0)
+        if (aggregateQuery.IsPending())
         {
-            ChangeRowHeight(rowDragging, rowDraggingY - rowDraggingStartY);
+            queryExecutor.Cancel(aggregateQuery.id);
         }
-        rowDragging = -1;
-        rowDraggingY = -1;
-        rowDraggingStartY = -1;
+        return;
     }
-}
 
-static GLFWcursor *colSizeCursor = nullptr;
-static GLFWcursor *rowSizeCursor = nullptr;
-static GLFWcursor *inputLineCursor = nullptr;
+    if (aggregateVersion == seenSelectionVersion || aggregateQuery.IsPending() || fillingTables || (time - seenSelectionTime) < 0.25)
+    {
+        return;
+    }
 
-void CursorPosCallback(
-    GLFWwindow *window,
-    double x,
-    double y)
+    if (selection.IsSingleCell())
+    {
+        aggregateVersion = seenSelectionVersion;
+        selectionAggregate = SelectionAggregate();
+        return;
+    }
+
+    aggregateQueryVersion = seenSelectionVersion;
+    journal->Flush();
+    aggregateQuery = queryExecutor.Submit<SelectionAggregate>([sheet = activeSheet, current = selection, view = rowViews[activeRowView]](sqlitelib::Sqlite &db) {
+        return AggregateSelection(db, sheet, current, *view);
+    });
+}
+
+// Status strings for the top right corner, laid out right to left next to
+// the fps counter
+std::vector<std::string> StatusTexts()
 {
-    (void)window;
-    (void)x;
-    (void)y;
+    std::vector<std::string> statusstrs;
 
-    if (colDragging >= 0)
+    if (IsSorting())
     {
-        colDraggingX = x;
+        statusstrs.push_back(fmt::format("sorting: {}% (esc to cancel)", sortProgress.permille / 10));
     }
-    else if (rowDragging >= 0)
+    else if (!selection.IsSingleCell() && aggregateVersion == selection.Version())
     {
-        rowDraggingY = y;
+        statusstrs.push_back(fmt::format("count: {}  sum: {}", selectionAggregate.count, selectionAggregate.sum));
     }
-    else
-    {
-        int col, row;
-        if (GetColWidthHandle(x, y, col))
-        {
-            if (colSizeCursor == nullptr)
-            {
-                colSizeCursor = glfwCreateStandardCursor(GLFW_HRESIZE_CURSOR);
-            }
 
-            glfwSetCursor(window, colSizeCursor);
+    if (IsExporting())
+    {
+        statusstrs.push_back(fmt::format("exporting to {} (esc to cancel)", exportFilename));
+    }
+    else if (!exportResult.empty())
+    {
+        statusstrs.push_back(exportResult);
+    }
 
-            return;
-        }
-        else if (GetRowHeightHandle(x, y, row))
-        {
-            if (rowSizeCursor == nullptr)
-            {
-                rowSizeCursor = glfwCreateStandardCursor(GLFW_VRESIZE_CURSOR);
-            }
+    if (findCursor != nullptr)
+    {
+        auto current = findCursor->CurrentIndex();
+        statusstrs.push_back(current < 0 ? fmt::format("find \"{}\": no matches", findCursor->Query()) : fmt::format("find \"{}\": match {}", findCursor->Query(), current + 1));
+    }
 
-            glfwSetCursor(window, rowSizeCursor);
+    auto commitRate = journal->CommitsPerSecond();
+    if (journal->PendingCount() > 0 || commitRate > 0)
+    {
+        statusstrs.push_back(fmt::format("edits: {} pending, {:.0f} commits/s", journal->PendingCount(), commitRate));
+    }
 
-            return;
-        }
-        else if (IsHoveringInputLine(x, y))
-        {
-            if (inputLineCursor == nullptr)
-            {
-                inputLineCursor = glfwCreateStandardCursor(GLFW_IBEAM_CURSOR);
-            }
+    auto cellStats = cellStore->Stats();
+    if (cellStats.packedChunks > 0)
+    {
+        statusstrs.push_back(fmt::format(
+            "cells: {:.0f} MB, {} cold chunks packed {:.1f}:1, unpack {:.0f} us",
+            (cellStats.unpackedBytes + cellStats.packedBytes) / (1024.0 * 1024.0),
+            cellStats.packedChunks,
+            cellStats.CompressionRatio(),
+            cellStats.unpackMicroseconds));
+    }
 
-            glfwSetCursor(window, inputLineCursor);
-        }
-        else
-        {
-            glfwSetCursor(window, nullptr);
-        }
+    if (IsSheetLoading())
+    {
+        auto const &state = sheetStates[activeSheet];
+        statusstrs.push_back(fmt::format("loading {}: {}%", state.title, std::min(1000, state.loadPermille->load()) / 10));
     }
-}
 
-std::unique_ptr<sqlitelib::Sqlite> InitDb()
-{
-    auto db = std::make_unique<sqlitelib::Sqlite>(":memory:");
+    if (sheetZoom != 1.0)
+    {
+        statusstrs.push_back(fmt::format("zoom: {:.0f}%", sheetZoom * 100));
+    }
 
-    try
+    if (activeRowView > 0)
     {
-        db->execute(R"(
-  CREATE TABLE IF NOT EXISTS cells (
-    col INTEGER,
-    row INTEGER,
-    function TEXT,
-    tmp_value TEXT,
-    sheet INTEGER,
-    PRIMARY KEY (col, row)
-  )
-)");
+        statusstrs.push_back(fmt::format("view {}/{}: {}", activeRowView, rowViews.size() - 1, CurrentRowView().Description()));
+    }
 
-        db->execute(R"(
-  CREATE TABLE IF NOT EXISTS cols (
-    col_index INTEGER  PRIMARY KEY,
-    size INTEGER,
-    header TEXT
-  )
-)");
+    return statusstrs;
+}
 
-        db->execute(R"(
-  CREATE TABLE IF NOT EXISTS rows (
-    row_index INTEGER PRIMARY KEY,
-    size INTEGER
-  )
-)");
+void RenderStatus(
+    const ViewSnapshot &snap,
+    const std::string &fpsstr)
+{
+    auto fpsx = snap.width - my_stbtt_print_width(fpsstr) - (fontSize * 0.4f) - 30;
 
-        db->execute(R"(
-  CREATE TABLE IF NOT EXISTS sheets (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    title TEXT
-  )
-)");
-    }
-    catch (const std::exception &ex)
+    my_stbtt_print(
+        fpsx,
+        (input_line_h + padding) / 2.0f,
+        fpsstr,
+        glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+
+    auto statusx = fpsx;
+    for (auto const &statusstr : snap.statusTexts)
     {
-        std::cout << db->errormsg() << std::endl;
-    }
+        statusx -= my_stbtt_print_width(statusstr) + 30;
 
-    return db;
+        my_stbtt_print(
+            statusx,
+            (input_line_h + padding) / 2.0f,
+            statusstr,
+            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    }
 }
 
-#include <rapidcsv.h>
-
-void LoadFileIntoDb(
-    const std::string &filename,
-    bool fileNameFirstLineHeader)
+// One fixed width tab per sheet and a last one adding a sheet, so hit tests
+// need no text measurement
+void RenderSheetTabs(
+    const ViewSnapshot &snap)
 {
-    if (!std::filesystem::exists(filename))
+    if (snap.sheetTitles == nullptr)
     {
-        std::cerr << "Input file does not exists: " << filename << std::endl;
         return;
     }
 
-    rapidcsv::Document doc(
-        filename,
-        rapidcsv::LabelParams(fileNameFirstLineHeader ? 0 : -1, -1),
-        rapidcsv::SeparatorParams(','));
-
-    auto columnNames = doc.GetColumnNames();
+    auto const &titles = *snap.sheetTitles;
+    auto y0 = float(snap.height - tab_bar_h), y1 = float(snap.height);
 
-    db->execute("DELETE FROM cols;");
-    db->execute("DELETE FROM rows;");
-    for (size_t c = 0; c < columnNames.size(); c++)
+    auto tab_key = std::make_tuple(snap.width, snap.height, titles.size(), snap.activeSheetTab);
+    if (tab_key != tabKey)
     {
-        db->execute("INSERT INTO cols (col_index, size, header) VALUES (?, 0, ?);", c, columnNames[c]);
-    }
+        tabKey = tab_key;
+        tabGeometry.Clear();
 
-    db->execute("DELETE FROM cells;");
-    for (size_t r = 0; r < doc.GetRowCount(); r++)
-    {
-        auto row = doc.GetRow<std::string>(r);
+        tabGeometry.SetColor(0.85f, 0.85f, 0.85f);
+        tabGeometry.AddRect(0.0f, y0, float(snap.width), y1);
 
-        for (size_t c = 0; c < row.size(); c++)
+        for (int tab = 0; tab <= int(titles.size()); tab++)
         {
-            db->execute("INSERT INTO cells (col, row, function, tmp_value, sheet) VALUES (?, ?, ?, ?, 0);", int(c), int(r), row[c], row[c]);
+            auto x0 = float(tab * tab_w);
+            if (tab == snap.activeSheetTab)
+            {
+                tabGeometry.SetColor(1.0f, 1.0f, 1.0f);
+            }
+            else
+            {
+                tabGeometry.SetColor(0.92f, 0.92f, 0.92f);
+            }
+            tabGeometry.AddRect(x0 + 1.0f, y0, x0 + tab_w - 1.0f, y1 - 4.0f);
         }
     }
-}
+    tabGeometry.Draw(*renderer);
 
-void renderSheet(
-    std::unique_ptr<sqlitelib::Sqlite> &db,
-    int atx,
-    int aty)
-{
-    glDisable(GL_DEPTH_TEST);
-    try
+    for (size_t tab = 0; tab < titles.size(); tab++)
     {
-        glViewport(atx, 0, w - atx, h - aty);
-
-        auto cols_map = select_into_map("SELECT col_index, size FROM cols");
-        auto rows_map = select_into_map("SELECT row_index, size FROM rows");
+        my_stbtt_print_clipped(
+            tab * tab_w + padding,
+            y0 + fontSize * 1.2f,
+            titles[tab],
+            int(tab) == snap.activeSheetTab ? glm::vec4(0.4f, 0.55f, 0.65f, 1.0f) : glm::vec4(0.3f, 0.3f, 0.3f, 1.0f),
+            tab_w - padding * 2);
+    }
 
-        int x = header_w, y = input_line_h + header_h + 1;
-        glBegin(GL_QUADS);
-        glColor3f(0.85f, 0.85f, 0.85f);
+    my_stbtt_print(
+        titles.size() * tab_w + (tab_w - my_stbtt_print_width("+")) / 2.0f,
+        y0 + fontSize * 1.2f,
+        "+",
+        glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+}
 
-        glVertex2f(0.0f, 0.0f);
-        glVertex2f(w, 0.0f);
-        glVertex2f(w, input_line_h + header_h);
-        glVertex2f(0.0f, input_line_h + header_h);
+// Memory per category in a panel at the bottom right, while it is shown
+void RenderMemory(
+    const ViewSnapshot &snap)
+{
+    if (snap.memoryTexts.empty())
+    {
+        return;
+    }
 
-        glVertex2f(0.0f, input_line_h);
-        glVertex2f(header_w, input_line_h);
-        glVertex2f(header_w, input_line_h + h);
-        glVertex2f(0.0f, input_line_h + h);
+    auto lineHeight = fontSize * 1.4f;
+    float width = 0.0f;
+    for (auto const &line : snap.memoryTexts)
+    {
+        width = std::max(width, my_stbtt_print_width(line));
+    }
 
-        glColor3f(1.0f, 1.0f, 1.0f);
+    auto x1 = float(snap.width) - padding * 2, y1 = float(snap.height - tab_bar_h) - padding * 2;
+    auto x0 = x1 - width - padding * 2, y0 = y1 - lineHeight * snap.memoryTexts.size() - padding * 2;
 
-        // Render input line
-        auto strwidth = my_stbtt_print_width(">_");
-        auto input_line_offset = strwidth + padding + padding;
-        glVertex2f(input_line_offset, padding);
-        glVertex2f(w, padding);
-        glVertex2f(w, input_line_h - padding);
-        glVertex2f(input_line_offset, input_line_h - padding);
-        glEnd();
+    memoryGeometry.Clear();
+    memoryGeometry.SetColor(1.0f, 1.0f, 1.0f, 0.9f);
+    memoryGeometry.AddRect(x0, y0, x1, y1);
+    memoryGeometry.SetColor(0.6f, 0.6f, 0.6f);
+    memoryGeometry.AddFrame(x0, y0, x1, y1, 1.0f);
+    memoryGeometry.Draw(*renderer);
 
+    for (size_t i = 0; i < snap.memoryTexts.size(); i++)
+    {
         my_stbtt_print(
-            padding,
-            (input_line_h + padding) / 2.0f,
-            ">_",
+            x0 + padding,
+            y0 + padding + lineHeight * (i + 0.75f),
+            snap.memoryTexts[i],
             glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    }
+}
 
-        auto tmp_value = db->execute_value<std::string>("SELECT tmp_value FROM cells WHERE col = ? and row = ?", active_cell_col, active_cell_row);
+// Draws the latest published snapshot until rendering stops. The thread owns
+// the window's context and every GL resource while it runs, so no query or
+// edit on the input thread delays a frame; it releases them before exiting.
+static void RenderThread(
+    GLFWwindow *window)
+{
+    glfwMakeContextCurrent(window);
+    glClearColor(0.95f, 0.95f, 0.95f, 1.0f);
 
-        my_stbtt_print(
-            input_line_offset + padding,
-            (input_line_h + padding) / 2.0f,
-            tmp_value,
-            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+    double time = glfwGetTime();
+    int fps = 0;
+    uint64_t maxFrameAllocations = 0;
+    std::string fpsText = "fps: 0.00";
 
-        glBegin(GL_LINES);
-        glColor3f(0.79f, 0.79f, 0.79f);
-        auto selected_x = 0, selected_y = 0;
-        auto selected_w = 0, selected_h = 0;
+    while (rendering)
+    {
+        auto allocations = ThreadAllocationCount();
 
-        // Render col lines
-        int i = scroll_cols;
-        while (x < w)
+        fps++;
+        double newTime = glfwGetTime();
+        if ((newTime - time) > 1)
         {
-            if (i == active_cell_col)
-            {
-                selected_x = x;
-                selected_w = defaultcell_w;
-            }
-
-            glVertex2f(float(x), input_line_h);
-            glVertex2f(float(x), float(h));
-
-            auto colw = cols_map.find(i);
-            if (colw != cols_map.end())
-            {
-                if (i == active_cell_col)
-                {
-                    selected_w = defaultcell_w + colw->second;
-                }
+            // Heap allocations of the costliest frame in the last second; a
+            // frame that only draws what is cached makes none
+            fpsText.clear();
+            fmt::format_to(std::back_inserter(fpsText), "fps: {:.2f}, allocs/frame: {}", double(fps) / (newTime - time), maxFrameAllocations);
+            maxFrameAllocations = 0;
 
-                x += defaultcell_w + colw->second;
-            }
-            else
-            {
-                x += defaultcell_w;
-            }
+            fps = 0;
+            time = newTime;
 
-            i++;
+            textCacheBytes = textCache.MemoryUsage();
+            tileCacheBytes = tileCache.MemoryUsage();
+            glyphAtlasBytes = glyphAtlas.MemoryUsage();
+            geometryBytes = chromeGeometry.MemoryUsage() + gridGeometry.MemoryUsage() + overlayGeometry.MemoryUsage() + memoryGeometry.MemoryUsage() + tabGeometry.MemoryUsage();
         }
 
-        if (colDraggingX >= 0)
+        // Over the memory limit; both are built again as the frame needs them
+        if (evictRenderCaches.exchange(false))
         {
-            glColor3f(0.3f, 0.3f, 0.3f);
-            glVertex2f(float(colDraggingX), input_line_h);
-            glVertex2f(float(colDraggingX), float(h));
-            glColor3f(0.79f, 0.79f, 0.79f);
+            textCache.Clear();
+            tileCache.Trim();
+            textCacheBytes = 0;
+            tileCacheBytes = 0;
         }
 
-        // Render row lines
-        i = scroll_rows;
-        while (y < h)
-        {
-            if (i == active_cell_row)
-            {
-                selected_y = y;
-                selected_h = defaultcell_h;
-            }
-
-            glVertex2f(0.0f, float(y));
-            glVertex2f(float(w), float(y));
-
-            auto rowh = rows_map.find(i);
-            if (rowh != rows_map.end())
-            {
-                if (i == active_cell_row)
-                {
-                    selected_h = defaultcell_h + rowh->second;
-                }
-
-                y += defaultcell_h + rowh->second;
-            }
-            else
-            {
-                y += defaultcell_h;
-            }
+        TileInvalidations invalidations;
+        auto snap = snapshots.Acquire(invalidations);
 
-            i++;
+        if (invalidations.all)
+        {
+            tileCache.Invalidate();
         }
-
-        if (rowDraggingY >= 0)
+        for (auto const &rect : invalidations.rects)
         {
-            glColor3f(0.3f, 0.3f, 0.3f);
-            glVertex2f(0.0f, float(rowDraggingY));
-            glVertex2f(float(w), float(rowDraggingY));
-            glColor3f(0.79f, 0.79f, 0.79f);
+            tileCache.InvalidateRect(rect.x0, rect.y0, rect.x1, rect.y1);
         }
 
-        glEnd();
+        glyphAtlas.BeginFrame();
 
-        // Render col names
-        i = scroll_cols, x = header_w, y = input_line_h;
-        while (x < w)
-        {
-            auto fromx = x;
+        renderer->BeginTarget(0, snap->width, snap->height);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-            auto colw = cols_map.find(i);
-            if (colw != cols_map.end())
-            {
-                x += defaultcell_w + colw->second;
-            }
-            else
-            {
-                x += defaultcell_w;
-            }
+        renderSheet(*snap);
+        RenderSheetTabs(*snap);
+        RenderStatus(*snap, fpsText);
+        RenderMemory(*snap);
 
-            i++;
+        renderer->EndTarget();
+        renderer->EndFrame();
 
-            auto str = db->execute_value<std::string>("SELECT header FROM cols WHERE col_index = ?;", i);
-            if (str.empty())
-            {
-                str = columnIndexToLetters(i);
-            }
+        frameArena.Reset();
+        maxFrameAllocations = std::max(maxFrameAllocations, ThreadAllocationCount() - allocations);
+
+        // Swap front and back buffers (we use a double buffered display)
+        glfwSwapBuffers(window);
 
-            auto strwidth = my_stbtt_print_width(str);
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(5ms);
+    }
 
-            my_stbtt_print(
-                fromx + ((x - fromx) / 2.0f) - (strwidth / 2.0f),
-                input_line_h + fontSize * 1.2f,
-                str,
-                glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
-        }
+    tileCache.Release();
+    chromeGeometry.Release();
+    gridGeometry.Release();
+    overlayGeometry.Release();
+    memoryGeometry.Release();
+    tabGeometry.Release();
+    glyphAtlas.Release();
+    renderer->Release();
 
-        // Render row #
-        i = scroll_rows, y = input_line_h + header_h;
-        while (y < h)
-        {
-            glVertex2f(0.0f, float(y));
-            glVertex2f(float(w), float(y));
+    glfwMakeContextCurrent(nullptr);
+}
 
-            auto fromy = y;
-            auto rowh = rows_map.find(i);
-            if (rowh != rows_map.end())
-            {
-                y += defaultcell_h + rowh->second;
-            }
-            else
-            {
-                y += defaultcell_h;
-            }
+// Creates the window with a context for the renderer and initializes it.
+// When no OpenGL 3.3 core profile context can be made, the legacy renderer
+// is used instead.
+static GLFWwindow *CreateRendererWindow(
+    RendererKind kind,
+    const char *title)
+{
+    glfwDefaultWindowHints();
 
-            i++;
+    if (kind == RendererKind::Core)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+    }
+    else
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    }
 
-            auto fpsstr = fmt::format("{}", i);
-            auto strwidth = my_stbtt_print_width(fpsstr);
+    auto window = glfwCreateWindow(
+        w, h,
+        title,
+        nullptr,
+        nullptr);
 
-            my_stbtt_print(
-                (header_w / 2.0f) - (strwidth / 2.0f),
-                fromy + (fontSize * 1.2f),
-                fpsstr,
-                glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
-        }
+    if (window != nullptr)
+    {
+        glfwMakeContextCurrent(window);
 
-        // Select all cells in view
-        auto cells = db->execute<int, int, std::string>(
-            "SELECT col, row, tmp_value FROM cells WHERE col BETWEEN ? AND ? AND row BETWEEN ? AND ?",
-            scroll_cols,
-            scroll_cols + max_visible_col_count,
-            scroll_rows,
-            scroll_rows + max_visible_row_count);
+        gladLoadGL();
 
-        // Render all cells in view
-        for (auto const &cell : cells)
+        renderer = CreateRenderer(kind);
+        if (renderer->Init((GLADloadproc)glfwGetProcAddress))
         {
-            const int col = std::get<0>(cell);
-            const int row = std::get<1>(cell);
-            const std::string value = std::get<2>(cell);
-
-            int cell_x = (col * defaultcell_w) + db->execute_value<int>("SELECT SUM(size) FROM cols WHERE col_index < ?", col);
-            int scroll_x = (scroll_cols * defaultcell_w) + db->execute_value<int>("SELECT SUM(size) FROM cols WHERE col_index < ?", scroll_cols);
-            int cell_y = (row * defaultcell_h) + db->execute_value<int>("SELECT SUM(size) FROM rows WHERE row_index < ?", row);
-            int scroll_y = (scroll_rows * defaultcell_h) + db->execute_value<int>("SELECT SUM(size) FROM rows WHERE row_index < ?", scroll_rows);
+            glyphAtlas.SetTextureFormat(renderer->GlyphTextureFormat());
 
-            my_stbtt_print(
-                header_w + cell_x - scroll_x + cell_padding,
-                input_line_h + header_h + cell_y - scroll_y + fontSize * 1.2f,
-                value,
-                glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
+            return window;
         }
 
-        // Render selected col header
-        glBegin(GL_TRIANGLE_FAN);
-        glColor3f(0.4f, 0.55f, 0.65f);
-        glVertex2f(float(selected_x), float(input_line_h));
-        glVertex2f(float(selected_x) + float(selected_w), float(input_line_h));
-        glVertex2f(float(selected_x) + float(selected_w), float(input_line_h) + float(header_h));
-        glVertex2f(float(selected_x), float(input_line_h) + float(header_h));
-        glEnd();
+        renderer.reset();
+        glfwDestroyWindow(window);
+    }
 
-        {
-            auto str = db->execute_value<std::string>("SELECT header FROM cols WHERE col_index = ?;", active_cell_col + 1);
-            if (str.empty())
-            {
-                str = columnIndexToLetters(active_cell_col + 1);
-            }
+    if (kind == RendererKind::Core)
+    {
+        spdlog::warn("no OpenGL 3.3 core profile context, falling back to the legacy renderer");
 
-            auto strwidth = my_stbtt_print_width(str);
+        return CreateRendererWindow(RendererKind::Legacy, title);
+    }
 
-            my_stbtt_print(
-                selected_x + (selected_w / 2.0f) - (strwidth / 2.0f),
-                input_line_h + fontSize * 1.2f,
-                str,
-                glm::vec4(1.0f, 1.0f, 1.0, 1.0f));
-        }
+    return nullptr;
+}
+
+// Draws a window full of dense cell text for a fixed number of frames with
+// each renderer, without vsync and waiting for the GPU to finish each frame,
+// and prints the frame times.
+static void RunBenchmark(
+    const std::vector<RendererKind> &kinds)
+{
+    const int warmupFrames = 30;
+    const int measuredFrames = 300;
+
+    // Rows packed at the text height, cells at the default column width
+    const float line_h = fontSize * 1.25f;
+    const int text_rows = int(h / line_h) + 1;
+    const int text_cols = w / defaultcell_w + 1;
+
+    std::vector<std::string> texts;
+    for (int i = 0; i < text_rows * text_cols; i++)
+    {
+        texts.push_back(fmt::format("{:.3f}", (i * 7919 % 100003) * 1.37));
+    }
 
-        // Render selected row header
-        glBegin(GL_TRIANGLE_FAN);
-        glColor3f(0.4f, 0.55f, 0.65f);
-        glVertex2f(0, selected_y);
-        glVertex2f(header_w, selected_y);
-        glVertex2f(header_w, selected_y + selected_h);
-        glVertex2f(0, selected_y + selected_h);
-        glEnd();
+    std::cout << "renderer   frames  mean ms  median ms  p95 ms  max ms  quads/frame  draw calls/frame  allocs/frame" << std::endl;
 
+    for (auto kind : kinds)
+    {
+        auto window = CreateRendererWindow(kind, "Power Cells benchmark");
+        if (window == nullptr)
         {
-            auto fpsstr = fmt::format("{}", active_cell_row + 1);
-            auto strwidth = my_stbtt_print_width(fpsstr);
+            continue;
+        }
 
-            my_stbtt_print(
-                (header_w / 2.0f) - (strwidth / 2.0f),
-                selected_y + (fontSize * 1.2f),
-                fpsstr,
-                glm::vec4(1.0f, 1.0f, 1.0, 1.0f));
+        if (renderer->Kind() != kind)
+        {
+            std::cout << fmt::format("{:<10} not available", kind == RendererKind::Core ? "core" : "legacy") << std::endl;
+            renderer->Release();
+            renderer.reset();
+            glfwDestroyWindow(window);
+            continue;
         }
 
-        // Render selected cell
-        glLineWidth(1.0f);
-        glBegin(GL_LINES);
-        glColor3f(0.4f, 0.55f, 0.65f);
+        glfwSwapInterval(0);
+        glClearColor(0.95f, 0.95f, 0.95f, 1.0f);
+
+        std::vector<double> times;
+        times.reserve(measuredFrames);
+        size_t quads = 0, drawCalls = 0;
+        uint64_t allocations = 0;
 
-        glVertex2i(selected_x, selected_y);
-        glVertex2f(selected_x + selected_w, selected_y);
+        for (int frame = 0; frame < warmupFrames + measuredFrames && !glfwWindowShouldClose(window); frame++)
+        {
+            glfwPollEvents();
 
-        glVertex2f(selected_x + selected_w, selected_y);
-        glVertex2f(selected_x + selected_w, selected_y + selected_h);
+            auto start = glfwGetTime();
+            auto frameAllocations = ThreadAllocationCount();
 
-        glVertex2f(selected_x + selected_w, selected_y + selected_h);
-        glVertex2f(selected_x, selected_y + selected_h);
+            glyphAtlas.BeginFrame();
+            renderer->BeginTarget(0, w, h);
+            glClear(GL_COLOR_BUFFER_BIT);
 
-        glVertex2f(selected_x, selected_y + selected_h);
-        glVertex2f(selected_x, selected_y);
+            for (int row = 0; row < text_rows; row++)
+            {
+                for (int col = 0; col < text_cols; col++)
+                {
+                    my_stbtt_print_clipped(
+                        col * defaultcell_w + cell_padding,
+                        row * line_h + fontSize,
+                        texts[row * text_cols + col],
+                        glm::vec4(0.3f, 0.3f, 0.3f, 1.0f),
+                        defaultcell_w - cell_padding * 2);
+                }
+            }
 
-        glVertex2f(selected_x + 1, selected_y + 1);
-        glVertex2f(selected_x + selected_w - 1, selected_y + 1);
+            renderer->EndTarget();
+            quads = renderer->QuadCount();
+            drawCalls = renderer->DrawCallCount();
+            renderer->EndFrame();
 
-        glVertex2f(selected_x + selected_w - 1, selected_y + 1);
-        glVertex2f(selected_x + selected_w - 1, selected_y + selected_h - 1);
+            glFinish();
+            frameArena.Reset();
 
-        glVertex2f(selected_x + selected_w - 1, selected_y + selected_h - 1);
-        glVertex2f(selected_x + 1, selected_y + selected_h - 1);
+            // After the warmup every frame draws the same cached text
+            if (frame >= warmupFrames)
+            {
+                times.push_back((glfwGetTime() - start) * 1000.0);
+                allocations += ThreadAllocationCount() - frameAllocations;
+            }
 
-        glVertex2f(selected_x + 1, selected_y + selected_h - 1);
-        glVertex2f(selected_x + 1, selected_y + 1);
+            glfwSwapBuffers(window);
+        }
 
-        glEnd();
-    }
-    catch (const std::exception &ex)
-    {
-        std::cout << db->errormsg() << std::endl;
+        if (!times.empty())
+        {
+            auto mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+            std::sort(times.begin(), times.end());
+
+            std::cout << fmt::format(
+                             "{:<10} {:>6}  {:>7.3f}  {:>9.3f}  {:>6.3f}  {:>6.3f}  {:>11}  {:>16}  {:>12.2f}",
+                             renderer->Name(),
+                             times.size(),
+                             mean,
+                             times[times.size() / 2],
+                             times[std::min(times.size() - 1, times.size() * 95 / 100)],
+                             times.back(),
+                             quads,
+                             drawCalls,
+                             double(allocations) / times.size())
+                      << std::endl;
+
+            if (allocations > 0)
+            {
+                std::cout << fmt::format("{:<10} steady state frames made {} heap allocations, expected none", renderer->Name(), allocations) << std::endl;
+            }
+        }
+
+        glyphAtlas.Release();
+        renderer->Release();
+        renderer.reset();
+        glfwDestroyWindow(window);
     }
 }
 
@@ -1219,6 +3863,11 @@ int main(
 
     std::string fileNameToOpen;
     bool fileNameFirstLineHeader = false;
+    std::vector<RendererKind> rendererKinds;
+    bool benchmark = false;
+
+    // Caches are dropped past this, --memory-limit-mb 0 turns it off
+    memoryAccounting.SetSoftLimit(size_t(2048) * 1024 * 1024);
 
     if (argc > 1)
     {
@@ -1247,6 +3896,61 @@ int main(
 
                 continue;
             }
+            else if (arg == "--renderer")
+            {
+                if (i + 1 >= argc)
+                {
+                    std::cerr << "Found --renderer, but missing legacy or core argument" << std::endl;
+                    return 1;
+                }
+
+                std::string name(argv[++i]);
+                if (name == "legacy")
+                {
+                    rendererKinds = {RendererKind::Legacy};
+                }
+                else if (name == "core")
+                {
+                    rendererKinds = {RendererKind::Core};
+                }
+                else
+                {
+                    std::cerr << "Unknown renderer " << name << ", expected legacy or core" << std::endl;
+                    return 1;
+                }
+
+                continue;
+            }
+            else if (arg == "--benchmark")
+            {
+                benchmark = true;
+
+                continue;
+            }
+            else if (arg == "--cell-memory-mb")
+            {
+                if (i + 1 >= argc)
+                {
+                    std::cerr << "Found --cell-memory-mb, but missing size argument" << std::endl;
+                    return 1;
+                }
+
+                cellMemoryBudget = size_t(std::max(0, atoi(argv[++i]))) * 1024 * 1024;
+
+                continue;
+            }
+            else if (arg == "--memory-limit-mb")
+            {
+                if (i + 1 >= argc)
+                {
+                    std::cerr << "Found --memory-limit-mb, but missing size argument" << std::endl;
+                    return 1;
+                }
+
+                memoryAccounting.SetSoftLimit(size_t(std::max(0, atoi(argv[++i]))) * 1024 * 1024);
+
+                continue;
+            }
             else
             {
                 if (std::filesystem::exists(arg))
@@ -1258,23 +3962,49 @@ int main(
         }
     }
 
-    db = InitDb();
+    if (benchmark)
+    {
+        glfwInit();
+        my_stbtt_initfont();
+
+        // Without a renderer argument both are measured, one after the other
+        if (rendererKinds.empty())
+        {
+            rendererKinds = {RendererKind::Legacy, RendererKind::Core};
+        }
+
+        RunBenchmark(rendererKinds);
+
+        glfwTerminate();
 
-    if (!fileNameToOpen.empty())
+        return 0;
+    }
+
+    db = InitDb();
+    journal = std::make_unique<EditJournal>(*db);
+    undoLog = std::make_unique<UndoLog>(*db);
+    cellStore->SetMemoryBudget(cellMemoryBudget);
+    LoadSheets();
+    sheetStates[activeSheet].opened = true;
+    sheetLayout.Load(*db, activeSheet);
+    headerLabels.Load(*db, activeSheet);
+    RegisterMemoryCategories();
+    queryExecutor.Start(WorkbookUri, 2);
+
+    if (!fileNameToOpen.empty() && std::filesystem::path(fileNameToOpen).extension() == WorkbookFile::Extension)
+    {
+        LoadWorkbookFile(fileNameToOpen);
+    }
+    else if (!fileNameToOpen.empty())
     {
         LoadFileIntoDb(fileNameToOpen, fileNameFirstLineHeader);
     }
 
     glfwInit();
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-
-    auto window = glfwCreateWindow(
-        w, h,
-        "Power Cells",
-        nullptr,
-        nullptr);
+    auto window = CreateRendererWindow(
+        rendererKinds.empty() ? RendererKind::Legacy : rendererKinds.front(),
+        "Power Cells");
 
     // If we could not open a window, exit now
     if (!window)
@@ -1291,92 +4021,56 @@ int main(
     glfwSetMouseButtonCallback(window, MouseButtonCallback);
     glfwSetCursorPosCallback(window, CursorPosCallback);
 
-    glfwMakeContextCurrent(window);
-
-    gladLoadGL();
-
     my_stbtt_initfont();
+    tileCache.Init(*renderer);
 
     EnsureSelectionInView();
 
-    glClearColor(0.95f, 0.95f, 0.95f, 1.0f);
+    // The render thread takes over the context; it starts with a snapshot
+    // already published
+    PublishSnapshot(StatusTexts());
+    glfwMakeContextCurrent(nullptr);
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    rendering = true;
+    std::thread renderThread(RenderThread, window);
 
-    double time = glfwGetTime();
-    double prevTime = time;
-    int fps = 0;
-    double realFps = 0;
+    double prevTime = glfwGetTime();
+    double memoryTime = prevTime;
 
-    // Main rendering loop
+    // Input loop. Events are handled here, on the main thread as GLFW
+    // requires, and every round ends with a new snapshot for the render
+    // thread.
     while (running && !glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        glfwWaitEventsTimeout(0.005);
 
-        fps++;
         double newTime = glfwGetTime();
         double timeDiff = newTime - prevTime;
         prevTime = newTime;
-        if ((newTime - time) > 1)
-        {
-            realFps = double(fps) / (newTime - time);
-
-            fps = 0;
-            time = newTime;
-        }
-
-        double mx = 0, my = h / 2;
-        glfwGetCursorPos(window, &mx, &my);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glViewport(0, 0, w, h);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        glEnable(GL_DEPTH_TEST);
-
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
-
-        glMatrixMode(GL_PROJECTION);
-        glPushMatrix();
-        glLoadIdentity();
-
-        glOrtho(0, w, h, 0, -0.2f, 1.0f);
 
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glLoadIdentity();
+        AnimateScroll(timeDiff);
+        UpdateSelectionAggregate(newTime);
+        FinishSortIfDone();
+        FinishExportIfDone();
+        FinishSheetLoadsIfDone();
+        journal->Update();
 
-        // console.Render();
-
-        renderSheet(db, 0, 0);
-
-        glViewport(0, 0, w, h);
-
-        glLoadIdentity();
-        auto fpsstr = fmt::format("fps: {:.2f}", realFps);
-
-        my_stbtt_print(
-            w - my_stbtt_print_width(fpsstr) - (fontSize * 0.4f) - 30,
-            (input_line_h + padding) / 2.0f,
-            fpsstr,
-            glm::vec4(0.3f, 0.3f, 0.3f, 1.0f));
-
-        glMatrixMode(GL_PROJECTION);
-        glPopMatrix();
+        if (newTime - memoryTime >= 1.0)
+        {
+            ForEachCellStore([](CellStore &store) { store.Compact(); });
+            UpdateMemory();
+            memoryTime = newTime;
+        }
 
-        glMatrixMode(GL_MODELVIEW);
-        glPopMatrix();
+        PublishSnapshot(StatusTexts());
+    }
 
-        // Swap front and back buffers (we use a double buffered display)
-        glfwSwapBuffers(window);
+    rendering = false;
+    renderThread.join();
 
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(5ms);
-    }
+    sortProgress.cancelRequested = true;
+    queryExecutor.Stop();
+    journal->Flush();
 
     if (colSizeCursor != nullptr)
     {
@@ -0,0 +1,161 @@
+#include "memoryaccounting.h"
+
+#include <algorithm>
+#include <numeric>
+#include <spdlog/spdlog.h>
+
+static std::string FormatBytes(
+    size_t bytes)
+{
+    if (bytes >= 1024 * 1024)
+    {
+        return fmt::format("{:.1f} MB", bytes / (1024.0 * 1024.0));
+    }
+
+    return fmt::format("{:.1f} KB", bytes / 1024.0);
+}
+
+MemoryAccounting::MemoryAccounting()
+    : _softLimit(0),
+      _total(0),
+      _peakTotal(0),
+      _overLimit(false)
+{}
+
+void MemoryAccounting::SetSoftLimit(
+    size_t bytes)
+{
+    _softLimit = bytes;
+}
+
+size_t MemoryAccounting::SoftLimit() const
+{
+    return _softLimit;
+}
+
+void MemoryAccounting::Register(
+    const std::string &name,
+    Measure measure,
+    Evict evict)
+{
+    Category category;
+    category.name = name;
+    category.evictable = evict != nullptr;
+
+    _categories.push_back(category);
+    _sources.push_back({std::move(measure), std::move(evict)});
+}
+
+void MemoryAccounting::MeasureCategory(
+    size_t i)
+{
+    auto &category = _categories[i];
+
+    _total -= category.bytes;
+    category.bytes = _sources[i].measure();
+    category.peakBytes = std::max(category.peakBytes, category.bytes);
+    _total += category.bytes;
+}
+
+int MemoryAccounting::Update()
+{
+    for (size_t i = 0; i < _categories.size(); i++)
+    {
+        MeasureCategory(i);
+    }
+    _peakTotal = std::max(_peakTotal, _total);
+
+    if (_softLimit == 0 || _total <= _softLimit)
+    {
+        _overLimit = false;
+        return 0;
+    }
+
+    size_t evictable = 0;
+    for (auto const &category : _categories)
+    {
+        if (category.evictable)
+        {
+            evictable += category.bytes;
+        }
+    }
+
+    if (_total - evictable > _softLimit)
+    {
+        // Reported once per stretch over the limit, not every Update
+        if (!_overLimit)
+        {
+            spdlog::warn("memory: {} over the soft limit of {}, only {} of it are caches", FormatBytes(_total), FormatBytes(_softLimit), FormatBytes(evictable));
+        }
+        _overLimit = true;
+
+        return 0;
+    }
+
+    auto target = _softLimit - _softLimit / 8;
+    auto remaining = _total;
+
+    int evicted = 0;
+    for (size_t i = 0; i < _categories.size() && remaining > target; i++)
+    {
+        if (!_categories[i].evictable || _categories[i].bytes == 0)
+        {
+            continue;
+        }
+
+        _sources[i].evict();
+        _categories[i].evictions++;
+        evicted++;
+
+        remaining -= _categories[i].bytes;
+    }
+
+    _overLimit = false;
+
+    return evicted;
+}
+
+const std::vector<MemoryAccounting::Category> &MemoryAccounting::Categories() const
+{
+    return _categories;
+}
+
+size_t MemoryAccounting::Total() const
+{
+    return _total;
+}
+
+size_t MemoryAccounting::PeakTotal() const
+{
+    return _peakTotal;
+}
+
+std::vector<std::string> MemoryAccounting::Dump() const
+{
+    std::vector<size_t> order(_categories.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return _categories[a].bytes > _categories[b].bytes;
+    });
+
+    std::vector<std::string> lines;
+    for (auto i : order)
+    {
+        auto const &category = _categories[i];
+        auto line = fmt::format("{:<14} {:>10}  peak {:>10}", category.name, FormatBytes(category.bytes), FormatBytes(category.peakBytes));
+        if (category.evictions > 0)
+        {
+            line += fmt::format("  evicted {}x", category.evictions);
+        }
+        lines.push_back(line);
+    }
+
+    auto total = fmt::format("{:<14} {:>10}  peak {:>10}", "total", FormatBytes(_total), FormatBytes(_peakTotal));
+    if (_softLimit > 0)
+    {
+        total += fmt::format("  limit {}", FormatBytes(_softLimit));
+    }
+    lines.push_back(total);
+
+    return lines;
+}
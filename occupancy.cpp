@@ -0,0 +1,332 @@
+#include "occupancy.h"
+
+#include <algorithm>
+#include <sqlitelib.h>
+
+std::vector<OccupancyRun>::iterator OccupancyRuns::UpperBound(
+    int32_t i)
+{
+    return std::upper_bound(
+        _runs.begin(),
+        _runs.end(),
+        i,
+        [](int32_t v, const OccupancyRun &run) { return v < run.begin; });
+}
+
+std::vector<OccupancyRun>::const_iterator OccupancyRuns::UpperBound(
+    int32_t i) const
+{
+    return std::upper_bound(
+        _runs.begin(),
+        _runs.end(),
+        i,
+        [](int32_t v, const OccupancyRun &run) { return v < run.begin; });
+}
+
+void OccupancyRuns::Append(
+    int32_t i)
+{
+    if (!_runs.empty() && _runs.back().end == i)
+    {
+        _runs.back().end++;
+    }
+    else if (_runs.empty() || _runs.back().end < i)
+    {
+        _runs.push_back(OccupancyRun{i, i + 1});
+    }
+}
+
+void OccupancyRuns::Set(
+    int32_t i)
+{
+    auto next = UpperBound(i);
+
+    if (next != _runs.begin())
+    {
+        auto prev = next - 1;
+        if (i < prev->end)
+        {
+            return;
+        }
+
+        if (prev->end == i)
+        {
+            prev->end++;
+
+            // Filled the gap between two runs
+            if (next != _runs.end() && next->begin == prev->end)
+            {
+                prev->end = next->end;
+                _runs.erase(next);
+            }
+            return;
+        }
+    }
+
+    if (next != _runs.end() && next->begin == i + 1)
+    {
+        next->begin = i;
+        return;
+    }
+
+    _runs.insert(next, OccupancyRun{i, i + 1});
+}
+
+void OccupancyRuns::Reset(
+    int32_t i)
+{
+    auto next = UpperBound(i);
+    if (next == _runs.begin())
+    {
+        return;
+    }
+
+    auto run = next - 1;
+    if (i >= run->end)
+    {
+        return;
+    }
+
+    if (run->begin == i && run->end == i + 1)
+    {
+        _runs.erase(run);
+    }
+    else if (run->begin == i)
+    {
+        run->begin++;
+    }
+    else if (run->end == i + 1)
+    {
+        run->end--;
+    }
+    else
+    {
+        auto tail = OccupancyRun{i + 1, run->end};
+        run->end = i;
+        _runs.insert(next, tail);
+    }
+}
+
+bool OccupancyRuns::Test(
+    int32_t i) const
+{
+    auto next = UpperBound(i);
+
+    return next != _runs.begin() && i < (next - 1)->end;
+}
+
+int32_t OccupancyRuns::NextEdge(
+    int32_t i) const
+{
+    auto next = UpperBound(i);
+
+    if (next != _runs.begin())
+    {
+        auto run = next - 1;
+        if (i + 1 < run->end)
+        {
+            return run->end - 1;
+        }
+    }
+
+    if (next == _runs.end())
+    {
+        return -1;
+    }
+
+    return next->begin;
+}
+
+int32_t OccupancyRuns::PreviousEdge(
+    int32_t i) const
+{
+    auto next = UpperBound(i);
+    if (next == _runs.begin())
+    {
+        return -1;
+    }
+
+    auto run = next - 1;
+    if (i < run->end)
+    {
+        if (i > run->begin)
+        {
+            return run->begin;
+        }
+
+        // At the start of a run, jump to the end of the one before it
+        if (run == _runs.begin())
+        {
+            return -1;
+        }
+
+        --run;
+    }
+
+    return run->end - 1;
+}
+
+int32_t OccupancyRuns::Last() const
+{
+    return _runs.empty() ? -1 : _runs.back().end - 1;
+}
+
+bool OccupancyRuns::IsEmpty() const
+{
+    return _runs.empty();
+}
+
+size_t OccupancyRuns::MemoryUsage() const
+{
+    return _runs.capacity() * sizeof(OccupancyRun);
+}
+
+void OccupancyIndex::Build(
+    sqlitelib::Sqlite &db,
+    int sheet)
+{
+    Clear(sheet);
+
+    for (auto const &cell : db.execute_cursor<int, int>("SELECT col, row FROM cells WHERE sheet = ? ORDER BY col, row", sheet))
+    {
+        auto col = std::get<0>(cell);
+        if (col < 0)
+        {
+            continue;
+        }
+
+        if (col >= int(_cols.size()))
+        {
+            _cols.resize(col + 1);
+        }
+
+        _cols[col].Append(std::get<1>(cell));
+    }
+}
+
+void OccupancyIndex::Clear(
+    int sheet)
+{
+    _sheet = sheet;
+    _cols.clear();
+    _rows.clear();
+}
+
+void OccupancyIndex::Update(
+    int col,
+    int row,
+    bool occupied)
+{
+    if (col < 0 || row < 0)
+    {
+        return;
+    }
+
+    if (col >= int(_cols.size()))
+    {
+        if (!occupied)
+        {
+            return;
+        }
+        _cols.resize(col + 1);
+    }
+
+    auto cachedRow = _rows.find(row);
+
+    if (occupied)
+    {
+        _cols[col].Set(row);
+        if (cachedRow != _rows.end())
+        {
+            cachedRow->second.Set(col);
+        }
+    }
+    else
+    {
+        _cols[col].Reset(row);
+        if (cachedRow != _rows.end())
+        {
+            cachedRow->second.Reset(col);
+        }
+    }
+}
+
+const OccupancyRuns &OccupancyIndex::Column(
+    int col) const
+{
+    static const OccupancyRuns empty;
+
+    if (col < 0 || col >= int(_cols.size()))
+    {
+        return empty;
+    }
+
+    return _cols[col];
+}
+
+const OccupancyRuns &OccupancyIndex::Row(
+    sqlitelib::Sqlite &db,
+    int row)
+{
+    auto found = _rows.find(row);
+    if (found != _rows.end())
+    {
+        return found->second;
+    }
+
+    if (_rows.size() >= MaxCachedRows)
+    {
+        _rows.clear();
+    }
+
+    auto &runs = _rows[row];
+    for (auto col : db.execute_cursor<int>("SELECT col FROM cells WHERE sheet = ? AND row = ? ORDER BY col", _sheet, row))
+    {
+        if (col >= 0)
+        {
+            runs.Append(col);
+        }
+    }
+
+    return runs;
+}
+
+int OccupancyIndex::LastCol() const
+{
+    for (int col = int(_cols.size()) - 1; col >= 0; col--)
+    {
+        if (!_cols[col].IsEmpty())
+        {
+            return col;
+        }
+    }
+
+    return -1;
+}
+
+int OccupancyIndex::LastRow() const
+{
+    int32_t last = -1;
+    for (auto const &col : _cols)
+    {
+        last = std::max(last, col.Last());
+    }
+
+    return last;
+}
+
+size_t OccupancyIndex::MemoryUsage() const
+{
+    size_t size = _cols.capacity() * sizeof(OccupancyRuns);
+    for (auto const &col : _cols)
+    {
+        size += col.MemoryUsage();
+    }
+
+    for (auto const &row : _rows)
+    {
+        size += sizeof(row) + row.second.MemoryUsage();
+    }
+
+    return size;
+}
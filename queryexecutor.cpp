@@ -0,0 +1,184 @@
+#include "queryexecutor.h"
+
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+
+QueryCancelled::QueryCancelled()
+    : std::runtime_error("query cancelled")
+{}
+
+QueryExecutor::QueryExecutor()
+    : _nextId(1),
+      _stopping(false)
+{}
+
+QueryExecutor::~QueryExecutor()
+{
+    Stop();
+}
+
+bool QueryExecutor::Start(
+    const std::string &uri,
+    int connections)
+{
+    _stopping = false;
+
+    for (int i = 0; i < connections; i++)
+    {
+        auto worker = std::make_unique<Worker>();
+        worker->db = std::make_unique<sqlitelib::Sqlite>(uri.c_str(), SQLITE_OPEN_READONLY | SQLITE_OPEN_URI);
+
+        if (!worker->db->is_open())
+        {
+            spdlog::error("opening a read connection to {} failed", uri);
+            Stop();
+
+            return false;
+        }
+
+        try
+        {
+            worker->db->execute("PRAGMA read_uncommitted = 1;");
+        }
+        catch (const std::exception &ex)
+        {
+            spdlog::error("configuring a read connection failed: {}", worker->db->errormsg());
+        }
+
+        auto &ref = *worker;
+        _workers.push_back(std::move(worker));
+        _workers.back()->thread = std::thread([this, &ref]() { Run(ref); });
+    }
+
+    return true;
+}
+
+void QueryExecutor::Stop()
+{
+    std::deque<QueuedJob> queued;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _stopping = true;
+        queued.swap(_queue);
+
+        for (auto &worker : _workers)
+        {
+            if (worker->current != 0)
+            {
+                worker->cancelled = true;
+                worker->db->interrupt();
+            }
+        }
+    }
+
+    _wake.notify_all();
+
+    std::atomic<bool> cancelled(true);
+    for (auto &job : queued)
+    {
+        job.run(nullptr, cancelled);
+    }
+
+    for (auto &worker : _workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+    _workers.clear();
+}
+
+uint64_t QueryExecutor::Enqueue(
+    Job job)
+{
+    uint64_t id;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        id = _nextId++;
+
+        if (_stopping || _workers.empty())
+        {
+            std::atomic<bool> cancelled(true);
+            job(nullptr, cancelled);
+
+            return id;
+        }
+
+        _queue.push_back(QueuedJob{id, std::move(job)});
+    }
+
+    _wake.notify_one();
+
+    return id;
+}
+
+void QueryExecutor::Cancel(
+    uint64_t id)
+{
+    Job dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        for (auto it = _queue.begin(); it != _queue.end(); ++it)
+        {
+            if (it->id == id)
+            {
+                dropped = std::move(it->run);
+                _queue.erase(it);
+                break;
+            }
+        }
+
+        // The worker clears its current id under the lock before it starts
+        // another query, so the interrupt cannot hit the next one
+        for (auto &worker : _workers)
+        {
+            if (worker->current == id)
+            {
+                worker->cancelled = true;
+                worker->db->interrupt();
+            }
+        }
+    }
+
+    if (dropped)
+    {
+        std::atomic<bool> cancelled(true);
+        dropped(nullptr, cancelled);
+    }
+}
+
+void QueryExecutor::Run(
+    Worker &worker)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _wake.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+
+        // Stop cancels whatever is still queued
+        if (_stopping)
+        {
+            return;
+        }
+
+        auto job = std::move(_queue.front());
+        _queue.pop_front();
+
+        worker.current = job.id;
+        worker.cancelled = false;
+
+        lock.unlock();
+        job.run(worker.db.get(), worker.cancelled);
+        lock.lock();
+
+        worker.current = 0;
+    }
+}
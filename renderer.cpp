@@ -0,0 +1,205 @@
+#include "renderer.h"
+
+#include "corerenderer.h"
+#include "legacyrenderer.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+Renderer::~Renderer() = default;
+
+void Renderer::BeginTarget(
+    GLuint framebuffer,
+    int width,
+    int height)
+{
+    Flush();
+
+    _targets.push_back(Target{framebuffer, width, height});
+    _transforms.push_back(Transform{0.0f, 0.0f, 1.0f});
+
+    if (GLAD_GL_ARB_framebuffer_object)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+    glViewport(0, 0, width, height);
+    glDisable(GL_SCISSOR_TEST);
+
+    ApplyTarget();
+    ApplyTransform();
+}
+
+void Renderer::EndTarget()
+{
+    Flush();
+
+    // Transforms pushed on this target are dropped with it
+    _targets.pop_back();
+    _transforms.resize(_targets.size());
+    glDisable(GL_SCISSOR_TEST);
+
+    if (_targets.empty())
+    {
+        return;
+    }
+
+    auto const &target = _targets.back();
+    if (GLAD_GL_ARB_framebuffer_object)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    }
+    glViewport(0, 0, target.width, target.height);
+
+    ApplyTarget();
+    ApplyTransform();
+}
+
+void Renderer::EndFrame()
+{
+    Flush();
+
+    _quadCount = 0;
+    _drawCallCount = 0;
+}
+
+void Renderer::PushTransform(
+    float x,
+    float y,
+    float scale)
+{
+    auto const &current = CurrentTransform();
+
+    _transforms.push_back(Transform{
+        current.x + x * current.scale,
+        current.y + y * current.scale,
+        current.scale * scale});
+
+    ApplyTransform();
+}
+
+void Renderer::PopTransform()
+{
+    // The transform of the target itself stays
+    if (_transforms.size() > _targets.size())
+    {
+        _transforms.pop_back();
+    }
+
+    ApplyTransform();
+}
+
+float Renderer::Scale() const
+{
+    return CurrentTransform().scale;
+}
+
+const Renderer::Transform &Renderer::CurrentTransform() const
+{
+    static const Transform identity = {0.0f, 0.0f, 1.0f};
+
+    return _transforms.empty() ? identity : _transforms.back();
+}
+
+void Renderer::SetClip(
+    int x,
+    int y,
+    int width,
+    int height)
+{
+    Flush();
+
+    auto targetHeight = _targets.empty() ? 0 : _targets.back().height;
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, targetHeight - (y + height), std::max(width, 0), std::max(height, 0));
+}
+
+void Renderer::ResetClip()
+{
+    Flush();
+
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void Renderer::Flush()
+{}
+
+size_t Renderer::QuadCount() const
+{
+    return _quadCount;
+}
+
+size_t Renderer::DrawCallCount() const
+{
+    return _drawCallCount;
+}
+
+static GLuint CompileShader(
+    GLenum type,
+    const char *source,
+    const char *name)
+{
+    auto shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        char log[512] = {0};
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        spdlog::error("{} shader failed to compile: {}", name, log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+GLuint Renderer::CompileProgram(
+    const char *vertexSource,
+    const char *fragmentSource,
+    const char *name)
+{
+    auto vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource, name);
+    auto fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource, name);
+
+    if (vertexShader == 0 || fragmentShader == 0)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    auto program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        char log[512] = {0};
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        spdlog::error("{} shader failed to link: {}", name, log);
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+std::unique_ptr<Renderer> CreateRenderer(
+    RendererKind kind)
+{
+    if (kind == RendererKind::Core)
+    {
+        return std::make_unique<CoreRenderer>();
+    }
+
+    return std::make_unique<LegacyRenderer>();
+}
@@ -0,0 +1,216 @@
+#include "rowbitmap.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int PopCount(
+    uint64_t word)
+{
+#ifdef _MSC_VER
+    return int(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+static int TrailingZeros(
+    uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return int(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+RowBitmap::RowBitmap()
+    : _size(0),
+      _count(0)
+{}
+
+RowBitmap::RowBitmap(
+    int size,
+    bool value)
+    : _size(size),
+      _words((size + 63) / 64, value ? ~uint64_t(0) : 0),
+      _count(0)
+{
+    ClearTail();
+    Seal();
+}
+
+int RowBitmap::Size() const
+{
+    return _size;
+}
+
+void RowBitmap::Set(
+    int row)
+{
+    _words[row >> 6] |= uint64_t(1) << (row & 63);
+}
+
+void RowBitmap::Reset(
+    int row)
+{
+    _words[row >> 6] &= ~(uint64_t(1) << (row & 63));
+}
+
+bool RowBitmap::Test(
+    int row) const
+{
+    if (row < 0 || row >= _size)
+    {
+        return false;
+    }
+
+    return (_words[row >> 6] >> (row & 63)) & 1;
+}
+
+void RowBitmap::And(
+    const RowBitmap &other)
+{
+    for (size_t i = 0; i < _words.size(); i++)
+    {
+        _words[i] &= i < other._words.size() ? other._words[i] : 0;
+    }
+}
+
+void RowBitmap::Invert()
+{
+    for (auto &word : _words)
+    {
+        word = ~word;
+    }
+
+    ClearTail();
+}
+
+void RowBitmap::ClearTail()
+{
+    if (_size % 64 != 0 && !_words.empty())
+    {
+        _words.back() &= (uint64_t(1) << (_size % 64)) - 1;
+    }
+}
+
+void RowBitmap::Seal()
+{
+    _blockRanks.resize((_words.size() + WordsPerBlock - 1) / WordsPerBlock);
+
+    int count = 0;
+    for (size_t i = 0; i < _words.size(); i++)
+    {
+        if (i % WordsPerBlock == 0)
+        {
+            _blockRanks[i / WordsPerBlock] = count;
+        }
+
+        count += PopCount(_words[i]);
+    }
+
+    _count = count;
+}
+
+int RowBitmap::Count() const
+{
+    return _count;
+}
+
+int RowBitmap::Rank(
+    int row) const
+{
+    row = std::min(row, _size);
+    if (row <= 0)
+    {
+        return 0;
+    }
+
+    auto word = row >> 6;
+    auto block = word / WordsPerBlock;
+    int rank = _blockRanks.empty() ? 0 : _blockRanks[block];
+
+    for (int i = block * WordsPerBlock; i < word; i++)
+    {
+        rank += PopCount(_words[i]);
+    }
+
+    if (row & 63)
+    {
+        rank += PopCount(_words[word] & ((uint64_t(1) << (row & 63)) - 1));
+    }
+
+    return rank;
+}
+
+int RowBitmap::Select(
+    int n) const
+{
+    if (n < 0 || n >= _count)
+    {
+        return -1;
+    }
+
+    // Last block whose rank is <= n holds the n-th set bit
+    auto it = std::upper_bound(_blockRanks.begin(), _blockRanks.end(), n);
+    auto block = int(it - _blockRanks.begin()) - 1;
+    auto remaining = n - _blockRanks[block];
+
+    for (size_t i = size_t(block) * WordsPerBlock; i < _words.size(); i++)
+    {
+        auto word = _words[i];
+        auto bits = PopCount(word);
+        if (remaining < bits)
+        {
+            for (int b = 0; b < remaining; b++)
+            {
+                word &= word - 1;
+            }
+
+            return int(i * 64) + TrailingZeros(word);
+        }
+
+        remaining -= bits;
+    }
+
+    return -1;
+}
+
+int RowBitmap::NextSet(
+    int row) const
+{
+    if (row < 0)
+    {
+        row = 0;
+    }
+
+    if (row >= _size)
+    {
+        return -1;
+    }
+
+    size_t i = row >> 6;
+    auto word = _words[i] & (~uint64_t(0) << (row & 63));
+
+    while (word == 0)
+    {
+        if (++i >= _words.size())
+        {
+            return -1;
+        }
+
+        word = _words[i];
+    }
+
+    return int(i * 64) + TrailingZeros(word);
+}
+
+size_t RowBitmap::MemoryUsage() const
+{
+    return _words.capacity() * sizeof(uint64_t) + _blockRanks.capacity() * sizeof(int);
+}
@@ -0,0 +1,122 @@
+#include "rowview.h"
+
+#include <algorithm>
+
+RowView::RowView()
+    : _identity(true),
+      _isFilter(false)
+{}
+
+RowView::RowView(
+    std::vector<int32_t> rows,
+    const std::string &description)
+    : _identity(false),
+      _isFilter(false),
+      _rows(std::move(rows)),
+      _description(description)
+{}
+
+RowView::RowView(
+    RowBitmap filter,
+    const std::string &description)
+    : _identity(false),
+      _isFilter(true),
+      _filter(std::move(filter)),
+      _description(description)
+{
+    _filter.Seal();
+}
+
+bool RowView::IsIdentity() const
+{
+    return _identity;
+}
+
+const RowBitmap *RowView::Filter() const
+{
+    return _isFilter ? &_filter : nullptr;
+}
+
+int RowView::RowCount() const
+{
+    if (_identity)
+    {
+        return -1;
+    }
+
+    if (_isFilter)
+    {
+        return _filter.Count();
+    }
+
+    return int(_rows.size());
+}
+
+int RowView::ToStorage(
+    int displayRow) const
+{
+    if (_identity)
+    {
+        return displayRow;
+    }
+
+    if (_isFilter)
+    {
+        return _filter.Select(displayRow);
+    }
+
+    if (displayRow < 0 || displayRow >= int(_rows.size()))
+    {
+        return -1;
+    }
+
+    return _rows[displayRow];
+}
+
+int RowView::ToDisplay(
+    int storageRow) const
+{
+    if (_identity)
+    {
+        return storageRow;
+    }
+
+    if (_isFilter)
+    {
+        return _filter.Test(storageRow) ? _filter.Rank(storageRow) : -1;
+    }
+
+    // The inverse is only needed for jumping to a known storage row, so it
+    // is built on first use instead of with every view.
+    if (_inverse.empty() && !_rows.empty())
+    {
+        auto maxRow = *std::max_element(_rows.begin(), _rows.end());
+        _inverse.assign(maxRow + 1, -1);
+        for (size_t i = 0; i < _rows.size(); i++)
+        {
+            _inverse[_rows[i]] = int32_t(i);
+        }
+    }
+
+    if (storageRow < 0 || storageRow >= int(_inverse.size()))
+    {
+        return -1;
+    }
+
+    return _inverse[storageRow];
+}
+
+const std::vector<int32_t> &RowView::Rows() const
+{
+    return _rows;
+}
+
+const std::string &RowView::Description() const
+{
+    return _description;
+}
+
+size_t RowView::MemoryUsage() const
+{
+    return (_rows.capacity() + _inverse.capacity()) * sizeof(int32_t) + _filter.MemoryUsage();
+}
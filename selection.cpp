@@ -0,0 +1,394 @@
+#include "selection.h"
+
+#include <algorithm>
+#include <cellnumber.h>
+#include <rowview.h>
+#include <sqlitelib.h>
+
+CellRange CellRange::FromCorners(
+    int col1,
+    int row1,
+    int col2,
+    int row2)
+{
+    CellRange range;
+
+    range.fromCol = std::min(col1, col2);
+    range.toCol = std::max(col1, col2);
+    range.fromRow = std::min(row1, row2);
+    range.toRow = std::max(row1, row2);
+
+    return range;
+}
+
+bool CellRange::Contains(
+    int col,
+    int row) const
+{
+    return col >= fromCol && col <= toCol && row >= fromRow && row <= toRow;
+}
+
+bool CellRange::Intersects(
+    const CellRange &other) const
+{
+    return fromCol <= other.toCol && other.fromCol <= toCol && fromRow <= other.toRow && other.fromRow <= toRow;
+}
+
+bool CellRange::IntersectWith(
+    const CellRange &other,
+    CellRange &out) const
+{
+    if (!Intersects(other))
+    {
+        return false;
+    }
+
+    out.fromCol = std::max(fromCol, other.fromCol);
+    out.toCol = std::min(toCol, other.toCol);
+    out.fromRow = std::max(fromRow, other.fromRow);
+    out.toRow = std::min(toRow, other.toRow);
+
+    return true;
+}
+
+bool CellRange::IsEntireColumn() const
+{
+    return fromRow == 0 && toRow == MaxCellIndex;
+}
+
+bool CellRange::IsEntireRow() const
+{
+    return fromCol == 0 && toCol == MaxCellIndex;
+}
+
+Selection::Selection()
+{
+    Set(0, 0);
+}
+
+void Selection::Set(
+    int col,
+    int row)
+{
+    _ranges.clear();
+    _ranges.push_back(CellRange::FromCorners(col, row, col, row));
+    _anchorCol = col;
+    _anchorRow = row;
+    _version++;
+}
+
+void Selection::ExtendTo(
+    int col,
+    int row)
+{
+    auto &last = _ranges.back();
+
+    if (last.IsEntireColumn())
+    {
+        last = CellRange::FromCorners(_anchorCol, 0, col, CellRange::MaxCellIndex);
+    }
+    else if (last.IsEntireRow())
+    {
+        last = CellRange::FromCorners(0, _anchorRow, CellRange::MaxCellIndex, row);
+    }
+    else
+    {
+        last = CellRange::FromCorners(_anchorCol, _anchorRow, col, row);
+    }
+
+    _version++;
+}
+
+void Selection::Add(
+    int col,
+    int row)
+{
+    _ranges.push_back(CellRange::FromCorners(col, row, col, row));
+    _anchorCol = col;
+    _anchorRow = row;
+    _version++;
+}
+
+void Selection::SelectColumns(
+    int fromCol,
+    int toCol,
+    bool add)
+{
+    if (!add)
+    {
+        _ranges.clear();
+    }
+
+    _ranges.push_back(CellRange::FromCorners(fromCol, 0, toCol, CellRange::MaxCellIndex));
+    _anchorCol = fromCol;
+    _anchorRow = 0;
+    _version++;
+}
+
+void Selection::SelectRows(
+    int fromRow,
+    int toRow,
+    bool add)
+{
+    if (!add)
+    {
+        _ranges.clear();
+    }
+
+    _ranges.push_back(CellRange::FromCorners(0, fromRow, CellRange::MaxCellIndex, toRow));
+    _anchorCol = 0;
+    _anchorRow = fromRow;
+    _version++;
+}
+
+bool Selection::Contains(
+    int col,
+    int row) const
+{
+    for (auto const &range : _ranges)
+    {
+        if (range.Contains(col, row))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Selection::IsSingleCell() const
+{
+    return _ranges.size() == 1 && _ranges[0].fromCol == _ranges[0].toCol && _ranges[0].fromRow == _ranges[0].toRow;
+}
+
+CellRange Selection::Bounds() const
+{
+    auto bounds = _ranges.front();
+
+    for (auto const &range : _ranges)
+    {
+        bounds.fromCol = std::min(bounds.fromCol, range.fromCol);
+        bounds.toCol = std::max(bounds.toCol, range.toCol);
+        bounds.fromRow = std::min(bounds.fromRow, range.fromRow);
+        bounds.toRow = std::max(bounds.toRow, range.toRow);
+    }
+
+    return bounds;
+}
+
+const std::vector<CellRange> &Selection::Ranges() const
+{
+    return _ranges;
+}
+
+static void SubtractRange(
+    const CellRange &from,
+    const CellRange &cut,
+    std::vector<CellRange> &out)
+{
+    CellRange overlap;
+    if (!from.IntersectWith(cut, overlap))
+    {
+        out.push_back(from);
+        return;
+    }
+
+    // Rows above and below the overlap span the full width of 'from'
+    if (overlap.fromRow > from.fromRow)
+    {
+        out.push_back(CellRange{from.fromCol, from.fromRow, from.toCol, overlap.fromRow - 1});
+    }
+    if (overlap.toRow < from.toRow)
+    {
+        out.push_back(CellRange{from.fromCol, overlap.toRow + 1, from.toCol, from.toRow});
+    }
+
+    // Left and right of the overlap only span the overlapping rows
+    if (overlap.fromCol > from.fromCol)
+    {
+        out.push_back(CellRange{from.fromCol, overlap.fromRow, overlap.fromCol - 1, overlap.toRow});
+    }
+    if (overlap.toCol < from.toCol)
+    {
+        out.push_back(CellRange{overlap.toCol + 1, overlap.fromRow, from.toCol, overlap.toRow});
+    }
+}
+
+std::vector<CellRange> Selection::DisjointRanges() const
+{
+    std::vector<CellRange> result;
+
+    for (auto const &range : _ranges)
+    {
+        std::vector<CellRange> pieces = {range};
+
+        for (auto const &existing : result)
+        {
+            std::vector<CellRange> remaining;
+            for (auto const &piece : pieces)
+            {
+                SubtractRange(piece, existing, remaining);
+            }
+            pieces.swap(remaining);
+        }
+
+        result.insert(result.end(), pieces.begin(), pieces.end());
+    }
+
+    return result;
+}
+
+std::vector<CellRange> Selection::Clip(
+    const CellRange &visible) const
+{
+    std::vector<CellRange> result;
+
+    for (auto const &range : _ranges)
+    {
+        CellRange clipped;
+        if (range.IntersectWith(visible, clipped))
+        {
+            result.push_back(clipped);
+        }
+    }
+
+    return result;
+}
+
+int Selection::AnchorCol() const
+{
+    return _anchorCol;
+}
+
+int Selection::AnchorRow() const
+{
+    return _anchorRow;
+}
+
+unsigned int Selection::Version() const
+{
+    return _version;
+}
+
+void StreamSelection(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const Selection &selection,
+    const RowView &view,
+    std::function<void(int col, int row, const std::string &value)> callback)
+{
+    auto stmt = db.prepare<int, int, std::string>(
+        "SELECT col, row, tmp_value FROM cells WHERE sheet = ? AND col BETWEEN ? AND ? AND row BETWEEN ? AND ? ORDER BY row, col");
+
+    // Other views read each range with one scan over the storage rows it
+    // spans, instead of a query per row, and skip the rows it does not show
+    auto filter = view.Filter();
+    if (filter != nullptr)
+    {
+        for (auto const &range : selection.DisjointRanges())
+        {
+            auto toRow = std::min(range.toRow, view.RowCount() - 1);
+            if (range.fromRow > toRow)
+            {
+                continue;
+            }
+
+            // A filter keeps the storage order, so its display row is the
+            // rank of the storage row
+            int storageRow = -1, displayRow = -1;
+            for (auto const &cell : stmt.execute_cursor(sheet, range.fromCol, range.toCol, view.ToStorage(range.fromRow), view.ToStorage(toRow)))
+            {
+                if (std::get<1>(cell) != storageRow)
+                {
+                    storageRow = std::get<1>(cell);
+                    displayRow = filter->Test(storageRow) ? filter->Rank(storageRow) : -1;
+                }
+
+                if (displayRow >= 0)
+                {
+                    callback(std::get<0>(cell), displayRow, std::get<2>(cell));
+                }
+            }
+        }
+
+        return;
+    }
+
+    if (!view.IsIdentity())
+    {
+        for (auto const &range : selection.DisjointRanges())
+        {
+            auto toRow = std::min(range.toRow, view.RowCount() - 1);
+            if (range.fromRow > toRow)
+            {
+                continue;
+            }
+
+            auto const &rows = view.Rows();
+            auto minmax = std::minmax_element(rows.begin() + range.fromRow, rows.begin() + toRow + 1);
+            auto fromStorage = *minmax.first, toStorage = *minmax.second;
+
+            // Display row of each storage row the range spans, -1 for rows
+            // outside the range
+            std::vector<int32_t> displayRows(toStorage - fromStorage + 1, -1);
+            for (int row = range.fromRow; row <= toRow; row++)
+            {
+                displayRows[rows[row] - fromStorage] = row;
+            }
+
+            for (auto const &cell : stmt.execute_cursor(sheet, range.fromCol, range.toCol, fromStorage, toStorage))
+            {
+                auto displayRow = displayRows[std::get<1>(cell) - fromStorage];
+                if (displayRow >= 0)
+                {
+                    callback(std::get<0>(cell), displayRow, std::get<2>(cell));
+                }
+            }
+        }
+
+        return;
+    }
+
+    for (auto const &range : selection.DisjointRanges())
+    {
+        for (auto const &cell : stmt.execute_cursor(sheet, range.fromCol, range.toCol, range.fromRow, range.toRow))
+        {
+            callback(std::get<0>(cell), std::get<1>(cell), std::get<2>(cell));
+        }
+    }
+}
+
+SelectionAggregate AggregateSelection(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const Selection &selection,
+    const RowView &view)
+{
+    SelectionAggregate aggregate;
+
+    StreamSelection(
+        db,
+        sheet,
+        selection,
+        view,
+        [&](int col, int row, const std::string &value) {
+            (void)col;
+            (void)row;
+
+            if (value.empty())
+            {
+                return;
+            }
+
+            aggregate.count++;
+
+            double number;
+            if (ParseCellNumber(value, number))
+            {
+                aggregate.numericCount++;
+                aggregate.sum += number;
+            }
+        });
+
+    return aggregate;
+}
@@ -0,0 +1,199 @@
+#include "sheetexport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <delimited.h>
+#include <filesystem>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+#include <tuple>
+
+// The buffer is written out once it passes this size
+static const size_t ExportBufferSize = 4 * 1024 * 1024;
+
+double ExportStats::MegabytesPerSecond() const
+{
+    if (seconds <= 0.0)
+    {
+        return 0.0;
+    }
+
+    return double(bytes) / (1024.0 * 1024.0) / seconds;
+}
+
+char SeparatorForFile(
+    const std::string &filename)
+{
+    auto extension = std::filesystem::path(filename).extension().string();
+    if (extension == ".tsv" || extension == ".tab")
+    {
+        return '\t';
+    }
+
+    return ',';
+}
+
+bool ExportDelimited(
+    sqlitelib::Sqlite &db,
+    int sheet,
+    const std::string &filename,
+    char separator,
+    ExportStats &stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    stats = ExportStats();
+
+    auto partName = filename + ".part";
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(partName.c_str(), "wb"), fclose);
+    if (file == nullptr)
+    {
+        spdlog::error("cannot open {} for writing", partName);
+        return false;
+    }
+
+    // The writer buffers already, stdio would copy everything once more
+    setvbuf(file.get(), nullptr, _IONBF, 0);
+
+    DelimitedWriter writer(separator);
+    writer.Reserve(ExportBufferSize + 64 * 1024);
+
+    bool ok = true;
+    auto flush = [&]()
+    {
+        if (ok && writer.Size() > 0 && fwrite(writer.Text().data(), 1, writer.Size(), file.get()) != writer.Size())
+        {
+            spdlog::error("writing {} failed", partName);
+            ok = false;
+        }
+
+        stats.bytes += writer.Size();
+        writer.Clear();
+    };
+
+    try
+    {
+        auto lastCol = db.execute_value<int>("SELECT COALESCE(MAX(col), -1) FROM cells WHERE sheet = ?", sheet);
+        static const std::string empty;
+
+        // Headers are only there when the sheet came from a file with a header line
+        auto headers = db.execute<int, std::string>("SELECT col_index, header FROM cols WHERE sheet = ? AND header IS NOT NULL AND header <> '' ORDER BY col_index", sheet);
+        if (!headers.empty())
+        {
+            int col = 0;
+            for (auto const &header : headers)
+            {
+                for (; col < std::get<0>(header); col++)
+                {
+                    writer.Field(empty);
+                }
+                writer.Field(std::get<1>(header));
+                col++;
+            }
+
+            lastCol = std::max(lastCol, col - 1);
+            for (; col <= lastCol; col++)
+            {
+                writer.Field(empty);
+            }
+            writer.EndLine();
+        }
+
+        int currentRow = -1;
+        int nextCol = 0;
+
+        // Flushes per line, also for the empty lines between stored rows,
+        // so the buffer stays bounded however far apart rows are. False
+        // once writing failed.
+        auto endRow = [&]()
+        {
+            for (; nextCol <= lastCol; nextCol++)
+            {
+                writer.Field(empty);
+            }
+            writer.EndLine();
+            stats.rows++;
+
+            if (writer.Size() >= ExportBufferSize)
+            {
+                flush();
+            }
+
+            return ok;
+        };
+
+        auto cursor = db.prepare<int, int, std::string>("SELECT row, col, tmp_value FROM cells WHERE sheet = ? ORDER BY row, col").execute_cursor(sheet);
+        for (auto const &cell : cursor)
+        {
+            auto row = std::get<0>(cell);
+            auto col = std::get<1>(cell);
+
+            if (row != currentRow)
+            {
+                if (currentRow >= 0 && !endRow())
+                {
+                    break;
+                }
+
+                // Rows without cells are written as empty lines of fields
+                for (currentRow++; ok && currentRow < row; currentRow++)
+                {
+                    nextCol = 0;
+                    endRow();
+                }
+
+                if (!ok)
+                {
+                    break;
+                }
+
+                nextCol = 0;
+            }
+
+            for (; nextCol < col; nextCol++)
+            {
+                writer.Field(empty);
+            }
+            writer.Field(std::get<2>(cell));
+            nextCol = col + 1;
+            stats.cells++;
+        }
+
+        if (ok && currentRow >= 0)
+        {
+            endRow();
+        }
+        flush();
+    }
+    catch (const std::exception &ex)
+    {
+        // Interrupted or failed reading, no partial file stays behind
+        file.reset();
+        std::error_code error;
+        std::filesystem::remove(partName, error);
+        throw;
+    }
+
+    file.reset();
+
+    std::error_code error;
+    if (ok)
+    {
+        std::filesystem::rename(partName, filename, error);
+        if (error)
+        {
+            spdlog::error("replacing {} failed: {}", filename, error.message());
+            ok = false;
+        }
+    }
+
+    if (!ok)
+    {
+        std::filesystem::remove(partName, error);
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return ok;
+}
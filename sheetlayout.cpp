@@ -0,0 +1,187 @@
+#include "sheetlayout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <sqlitelib.h>
+
+// Shared by all layouts, so layouts of different sheets never have the same
+// version and a swapped in layout always counts as changed
+static std::atomic<unsigned int> nextVersion(1);
+
+AxisLayout::AxisLayout(
+    int defaultSize)
+    : _defaultSize(defaultSize),
+      _version(0)
+{
+    UpdatePrefix();
+}
+
+void AxisLayout::Clear()
+{
+    _deltas.clear();
+    UpdatePrefix();
+}
+
+void AxisLayout::Assign(
+    std::vector<std::pair<int, int>> deltas)
+{
+    deltas.erase(
+        std::remove_if(deltas.begin(), deltas.end(), [](const std::pair<int, int> &entry) { return entry.second == 0; }),
+        deltas.end());
+
+    _deltas = std::move(deltas);
+    UpdatePrefix();
+}
+
+void AxisLayout::SetDelta(
+    int index,
+    int delta)
+{
+    auto found = std::lower_bound(
+        _deltas.begin(),
+        _deltas.end(),
+        index,
+        [](const std::pair<int, int> &entry, int i) { return entry.first < i; });
+
+    if (found != _deltas.end() && found->first == index)
+    {
+        if (delta == 0)
+        {
+            _deltas.erase(found);
+        }
+        else
+        {
+            found->second = delta;
+        }
+    }
+    else if (delta != 0)
+    {
+        _deltas.insert(found, std::make_pair(index, delta));
+    }
+
+    UpdatePrefix();
+}
+
+void AxisLayout::UpdatePrefix()
+{
+    _version = nextVersion++;
+
+    _prefix.resize(_deltas.size() + 1);
+    _prefix[0] = 0;
+    for (size_t i = 0; i < _deltas.size(); i++)
+    {
+        _prefix[i + 1] = _prefix[i] + _deltas[i].second;
+    }
+}
+
+int AxisLayout::Size(
+    int index) const
+{
+    auto found = std::lower_bound(
+        _deltas.begin(),
+        _deltas.end(),
+        index,
+        [](const std::pair<int, int> &entry, int i) { return entry.first < i; });
+
+    if (found != _deltas.end() && found->first == index)
+    {
+        return _defaultSize + found->second;
+    }
+
+    return _defaultSize;
+}
+
+int64_t AxisLayout::Start(
+    int index) const
+{
+    auto before = std::lower_bound(
+        _deltas.begin(),
+        _deltas.end(),
+        index,
+        [](const std::pair<int, int> &entry, int i) { return entry.first < i; });
+
+    return int64_t(index) * _defaultSize + _prefix[before - _deltas.begin()];
+}
+
+int AxisLayout::IndexAt(
+    int64_t pixel) const
+{
+    if (pixel <= 0)
+    {
+        return 0;
+    }
+
+    // Starts grow with the index, so the last resized entry starting at or
+    // before the pixel is found with a binary search over the deltas
+    size_t lo = 0, hi = _deltas.size();
+    while (lo < hi)
+    {
+        auto mid = (lo + hi) / 2;
+        auto start = int64_t(_deltas[mid].first) * _defaultSize + _prefix[mid];
+        if (start <= pixel)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0)
+    {
+        return int(pixel / _defaultSize);
+    }
+
+    auto const &entry = _deltas[lo - 1];
+    auto start = int64_t(entry.first) * _defaultSize + _prefix[lo - 1];
+    auto end = start + _defaultSize + entry.second;
+    if (pixel < end)
+    {
+        return entry.first;
+    }
+
+    return entry.first + 1 + int((pixel - end) / _defaultSize);
+}
+
+unsigned int AxisLayout::Version() const
+{
+    return _version;
+}
+
+size_t AxisLayout::MemoryUsage() const
+{
+    return _deltas.capacity() * sizeof(std::pair<int, int>) + _prefix.capacity() * sizeof(int64_t);
+}
+
+SheetLayout::SheetLayout(
+    int defaultColWidth,
+    int defaultRowHeight)
+    : cols(defaultColWidth),
+      rows(defaultRowHeight)
+{}
+
+void SheetLayout::Load(
+    sqlitelib::Sqlite &db,
+    int sheet)
+{
+    // Read in index order, so the deltas are taken as they are
+    std::vector<std::pair<int, int>> deltas;
+    for (auto const &col : db.execute_cursor<int, int>("SELECT col_index, size FROM cols WHERE sheet = ? ORDER BY col_index", sheet))
+    {
+        deltas.emplace_back(std::get<0>(col), std::get<1>(col));
+    }
+    cols.Assign(std::move(deltas));
+
+    deltas = std::vector<std::pair<int, int>>();
+    for (auto const &row : db.execute_cursor<int, int>("SELECT row_index, size FROM rows WHERE sheet = ? ORDER BY row_index", sheet))
+    {
+        deltas.emplace_back(std::get<0>(row), std::get<1>(row));
+    }
+    rows.Assign(std::move(deltas));
+}
+
+size_t SheetLayout::MemoryUsage() const
+{
+    return cols.MemoryUsage() + rows.MemoryUsage();
+}
@@ -1,3 +1,3 @@
-
+#include "stb_rect_pack.h" // use the real packer instead of the built-in fallback
 #define STB_TRUETYPE_IMPLEMENTATION  // force following include to generate implementation
 #include "stb_truetype.h"
@@ -0,0 +1,130 @@
+#include "textcache.h"
+
+#include "glyphatlas.h"
+
+#include <algorithm>
+#include <cstring>
+
+size_t TextRun::Fit(
+    float maxWidth) const
+{
+    // positions[i + 1] is where glyph i ends
+    auto end = std::upper_bound(positions.begin() + 1, positions.end(), maxWidth);
+
+    return size_t(end - positions.begin()) - 1;
+}
+
+TextCache::TextCache(
+    GlyphAtlas &atlas,
+    size_t capacity)
+    : _atlas(atlas),
+      _capacity(capacity)
+{}
+
+const std::string &TextCache::Key(
+    const std::string &text,
+    float size)
+{
+    _key.assign(sizeof(size), '\0');
+    std::memcpy(&_key[0], &size, sizeof(size));
+    _key += text;
+
+    return _key;
+}
+
+bool TextCache::Layout(
+    const std::string &text,
+    float size,
+    TextRun &run)
+{
+    const float scale = size / GlyphAtlas::SdfPixelHeight;
+    bool complete = true;
+
+    const char *txt = text.c_str();
+    const char *end = txt + text.size();
+
+    float x = 0;
+    while (txt < end && *txt != '\n')
+    {
+        auto codepoint = DecodeUtf8(txt, end);
+
+        // Tabs are four digits wide and other control characters one digit
+        auto repeat = codepoint == '\t' ? 4 : 1;
+        auto glyph = _atlas.Get(codepoint < 32 ? '0' : codepoint);
+        if (glyph == nullptr)
+        {
+            complete = false;
+            continue;
+        }
+
+        run.codepoints.push_back(codepoint < 32 ? 0 : codepoint);
+        run.positions.push_back(x);
+        x += glyph->advance * scale * repeat;
+    }
+
+    run.positions.push_back(x);
+    run.width = x;
+
+    return complete;
+}
+
+const TextRun &TextCache::Get(
+    const std::string &text,
+    float size)
+{
+    auto const &key = Key(text, size);
+
+    auto found = _index.find(key);
+    if (found != _index.end())
+    {
+        _entries.splice(_entries.begin(), _entries, found->second);
+        return found->second->run;
+    }
+
+    Entry entry;
+    entry.key = key;
+
+    // Runs with glyphs the atlas could not provide are not cached, they are
+    // laid out again once the atlas has room
+    if (!Layout(text, size, entry.run))
+    {
+        static TextRun incomplete;
+        incomplete = std::move(entry.run);
+        return incomplete;
+    }
+
+    _entries.push_front(std::move(entry));
+    _index[key] = _entries.begin();
+
+    while (_entries.size() > _capacity)
+    {
+        _index.erase(_entries.back().key);
+        _entries.pop_back();
+    }
+
+    return _entries.front().run;
+}
+
+void TextCache::Clear()
+{
+    _entries.clear();
+    _index.clear();
+}
+
+size_t TextCache::Count() const
+{
+    return _entries.size();
+}
+
+size_t TextCache::MemoryUsage() const
+{
+    size_t size = 0;
+    for (auto const &entry : _entries)
+    {
+        size += sizeof(Entry) + entry.key.capacity() * 2 + sizeof(void *) * 4;
+        size += entry.run.codepoints.capacity() * sizeof(uint32_t);
+        size += entry.run.positions.capacity() * sizeof(float);
+    }
+
+    return size;
+}
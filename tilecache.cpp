@@ -0,0 +1,262 @@
+#include "tilecache.h"
+
+#include <algorithm>
+
+static int64_t FloorDiv(
+    int64_t value,
+    int64_t divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+std::vector<TileCache::TileKey> TileCache::TilesOverlapping(
+    int64_t x0,
+    int64_t y0,
+    int64_t x1,
+    int64_t y1)
+{
+    std::vector<TileKey> keys;
+    if (x1 <= x0 || y1 <= y0)
+    {
+        return keys;
+    }
+
+    for (auto ty = FloorDiv(y0, TileSize); ty <= FloorDiv(y1 - 1, TileSize); ty++)
+    {
+        for (auto tx = FloorDiv(x0, TileSize); tx <= FloorDiv(x1 - 1, TileSize); tx++)
+        {
+            keys.push_back(TileKey(tx, ty));
+        }
+    }
+
+    return keys;
+}
+
+TileCache::TileCache()
+    : _renderer(nullptr),
+      _framebuffer(0),
+      _frame(0),
+      _offscreen(false)
+{}
+
+void TileCache::Init(
+    Renderer &renderer)
+{
+    _renderer = &renderer;
+    _offscreen = GLAD_GL_ARB_framebuffer_object != 0;
+
+    if (_offscreen)
+    {
+        glGenFramebuffers(1, &_framebuffer);
+    }
+}
+
+void TileCache::Release()
+{
+    Trim();
+
+    if (_framebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &_framebuffer);
+        _framebuffer = 0;
+    }
+}
+
+bool TileCache::IsOffscreen() const
+{
+    return _offscreen;
+}
+
+GLuint TileCache::AcquireTexture()
+{
+    if (!_freeTextures.empty())
+    {
+        auto texture = _freeTextures.back();
+        _freeTextures.pop_back();
+        return texture;
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TileSize, TileSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return texture;
+}
+
+void TileCache::EvictUnused()
+{
+    // Least recently composited tile first, tiles on screen are never evicted
+    while (_tiles.size() >= MaxTiles)
+    {
+        auto oldest = std::min_element(
+            _tiles.begin(),
+            _tiles.end(),
+            [](const std::map<TileKey, Tile>::value_type &a, const std::map<TileKey, Tile>::value_type &b) { return a.second.lastUsed < b.second.lastUsed; });
+
+        if (oldest->second.lastUsed == _frame)
+        {
+            return;
+        }
+
+        _freeTextures.push_back(oldest->second.texture);
+        _tiles.erase(oldest);
+    }
+}
+
+void TileCache::RenderTile(
+    const TileKey &key,
+    GLuint texture,
+    const RenderFunction &render)
+{
+    _renderer->BeginTarget(_framebuffer, TileSize, TileSize);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    render(key.first * TileSize, key.second * TileSize, TileSize);
+
+    _renderer->EndTarget();
+}
+
+void TileCache::Draw(
+    int64_t scrollX,
+    int64_t scrollY,
+    int x,
+    int y,
+    int width,
+    int height,
+    const RenderFunction &render)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    _frame++;
+
+    auto fromTileX = FloorDiv(scrollX, TileSize);
+    auto fromTileY = FloorDiv(scrollY, TileSize);
+    auto toTileX = FloorDiv(scrollX + width - 1, TileSize);
+    auto toTileY = FloorDiv(scrollY + height - 1, TileSize);
+
+    if (!_offscreen)
+    {
+        for (auto ty = fromTileY; ty <= toTileY; ty++)
+        {
+            for (auto tx = fromTileX; tx <= toTileX; tx++)
+            {
+                auto sx = x + int(tx * TileSize - scrollX);
+                auto sy = y + int(ty * TileSize - scrollY);
+
+                auto clipX0 = std::max(sx, x), clipY0 = std::max(sy, y);
+                auto clipX1 = std::min(sx + TileSize, x + width), clipY1 = std::min(sy + TileSize, y + height);
+                _renderer->SetClip(clipX0, clipY0, clipX1 - clipX0, clipY1 - clipY0);
+
+                _renderer->PushTransform(float(sx), float(sy), 1.0f);
+                render(tx * TileSize, ty * TileSize, TileSize);
+                _renderer->PopTransform();
+            }
+        }
+        _renderer->ResetClip();
+
+        return;
+    }
+
+    _renderer->ResetClip();
+    for (auto ty = fromTileY; ty <= toTileY; ty++)
+    {
+        for (auto tx = fromTileX; tx <= toTileX; tx++)
+        {
+            auto key = TileKey(tx, ty);
+            auto found = _tiles.find(key);
+            if (found != _tiles.end())
+            {
+                found->second.lastUsed = _frame;
+                continue;
+            }
+
+            EvictUnused();
+
+            Tile tile;
+            tile.texture = AcquireTexture();
+            tile.lastUsed = _frame;
+            RenderTile(key, tile.texture, render);
+            _tiles[key] = tile;
+        }
+    }
+
+    _renderer->SetClip(x, y, width, height);
+
+    for (auto ty = fromTileY; ty <= toTileY; ty++)
+    {
+        for (auto tx = fromTileX; tx <= toTileX; tx++)
+        {
+            auto sx = float(x + int(tx * TileSize - scrollX));
+            auto sy = float(y + int(ty * TileSize - scrollY));
+
+            // The tile was rendered top down, so its top row is at t = 1
+            TexturedQuad quad = {sx, sy, sx + TileSize, sy + TileSize, 0.0f, 1.0f, 1.0f, 0.0f};
+            _renderer->DrawTexture(_tiles[TileKey(tx, ty)].texture, quad);
+        }
+    }
+
+    _renderer->ResetClip();
+}
+
+void TileCache::Invalidate()
+{
+    for (auto const &tile : _tiles)
+    {
+        _freeTextures.push_back(tile.second.texture);
+    }
+    _tiles.clear();
+}
+
+void TileCache::Trim()
+{
+    Invalidate();
+
+    if (!_freeTextures.empty())
+    {
+        glDeleteTextures(GLsizei(_freeTextures.size()), _freeTextures.data());
+        _freeTextures.clear();
+    }
+}
+
+void TileCache::InvalidateRect(
+    int64_t x0,
+    int64_t y0,
+    int64_t x1,
+    int64_t y1)
+{
+    auto fromTileX = FloorDiv(x0, TileSize), toTileX = FloorDiv(x1 - 1, TileSize);
+    auto fromTileY = FloorDiv(y0, TileSize), toTileY = FloorDiv(y1 - 1, TileSize);
+
+    for (auto it = _tiles.begin(); it != _tiles.end();)
+    {
+        auto tx = it->first.first, ty = it->first.second;
+        if (tx >= fromTileX && tx <= toTileX && ty >= fromTileY && ty <= toTileY)
+        {
+            _freeTextures.push_back(it->second.texture);
+            it = _tiles.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+size_t TileCache::TileCount() const
+{
+    return _tiles.size();
+}
+
+size_t TileCache::MemoryUsage() const
+{
+    return (_tiles.size() + _freeTextures.size()) * TileSize * TileSize * 4;
+}
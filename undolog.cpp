@@ -0,0 +1,414 @@
+#include "undolog.h"
+
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+
+static void PutVarint(
+    std::vector<char> &out,
+    uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+static uint64_t GetVarint(
+    const std::vector<char> &in,
+    size_t &pos)
+{
+    uint64_t value = 0;
+    int shift = 0;
+
+    while (pos < in.size())
+    {
+        auto byte = uint8_t(in[pos++]);
+        value |= uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+        shift += 7;
+    }
+
+    return value;
+}
+
+// Small differences of either sign become small unsigned numbers
+static uint64_t ZigZag(
+    int64_t value)
+{
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static int64_t UnZigZag(
+    uint64_t value)
+{
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+static void PutString(
+    std::vector<char> &out,
+    const std::string &value)
+{
+    PutVarint(out, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+CellDeltas::CellDeltas()
+    : _count(0),
+      _segmentCount(0),
+      _previousCol(0),
+      _previousRow(0)
+{}
+
+void CellDeltas::Add(
+    int col,
+    int row,
+    const std::string &before,
+    const std::string &after)
+{
+    // Every segment starts over at (0, 0), so it decodes on its own
+    if (_segments.empty() || _segmentCount == SegmentCells)
+    {
+        _segments.emplace_back();
+        _segmentCount = 0;
+        _previousCol = 0;
+        _previousRow = 0;
+    }
+
+    auto &segment = _segments.back();
+    PutVarint(segment, ZigZag(int64_t(row) - _previousRow));
+    PutVarint(segment, ZigZag(int64_t(col) - _previousCol));
+    PutString(segment, before);
+    PutString(segment, after);
+
+    _previousCol = col;
+    _previousRow = row;
+    _segmentCount++;
+    _count++;
+}
+
+size_t CellDeltas::Count() const
+{
+    return _count;
+}
+
+size_t CellDeltas::MemoryUsage() const
+{
+    size_t size = _segments.capacity() * sizeof(std::vector<char>);
+    for (auto const &segment : _segments)
+    {
+        size += segment.capacity();
+    }
+
+    return size;
+}
+
+void CellDeltas::Decode(
+    const std::vector<char> &segment,
+    bool after,
+    const Callback &callback)
+{
+    int64_t col = 0, row = 0;
+    size_t pos = 0;
+    std::string value;
+
+    while (pos < segment.size())
+    {
+        row += UnZigZag(GetVarint(segment, pos));
+        col += UnZigZag(GetVarint(segment, pos));
+
+        auto beforeSize = GetVarint(segment, pos);
+        auto beforePos = pos;
+        pos += beforeSize;
+
+        auto afterSize = GetVarint(segment, pos);
+        auto afterPos = pos;
+        pos += afterSize;
+
+        if (after)
+        {
+            value.assign(segment.data() + afterPos, afterSize);
+        }
+        else
+        {
+            value.assign(segment.data() + beforePos, beforeSize);
+        }
+
+        callback(int(col), int(row), value);
+    }
+}
+
+UndoLog::UndoLog(
+    sqlitelib::Sqlite &db,
+    size_t memoryBudget,
+    size_t maxRecords)
+    : _db(db),
+      _memoryBudget(memoryBudget),
+      _maxRecords(maxRecords),
+      _nextId(1),
+      _memoryUsage(0),
+      _spilledBytes(0)
+{}
+
+void UndoLog::Push(
+    Entry entry)
+{
+    for (auto &redo : _redo)
+    {
+        Drop(redo);
+    }
+    _redo.clear();
+
+    entry.id = _nextId++;
+    entry.segmentCount = entry.deltas._segments.size();
+    _memoryUsage += entry.deltas.MemoryUsage();
+    _undo.push_back(std::move(entry));
+
+    while (_undo.size() > _maxRecords)
+    {
+        Drop(_undo.front());
+        _undo.pop_front();
+    }
+
+    EnforceBudget();
+}
+
+void UndoLog::PushCells(
+    int sheet,
+    const std::string &description,
+    CellDeltas deltas)
+{
+    if (deltas.Count() == 0)
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.record.kind = UndoKind::Cells;
+    entry.record.sheet = sheet;
+    entry.record.description = description;
+    entry.deltas = std::move(deltas);
+
+    Push(std::move(entry));
+}
+
+void UndoLog::PushSize(
+    int sheet,
+    UndoKind kind,
+    int index,
+    int before,
+    int after)
+{
+    Entry entry;
+    entry.record.kind = kind;
+    entry.record.sheet = sheet;
+    entry.record.description = kind == UndoKind::ColSize ? "column width" : "row height";
+    entry.record.index = index;
+    entry.record.before = before;
+    entry.record.after = after;
+
+    Push(std::move(entry));
+}
+
+void UndoLog::PushView(
+    int sheet,
+    const std::string &description,
+    std::shared_ptr<const RowView> view)
+{
+    Entry entry;
+    entry.record.kind = UndoKind::View;
+    entry.record.sheet = sheet;
+    entry.record.description = description;
+    entry.record.view = std::move(view);
+
+    Push(std::move(entry));
+}
+
+bool UndoLog::CanUndo() const
+{
+    return !_undo.empty();
+}
+
+bool UndoLog::CanRedo() const
+{
+    return !_redo.empty();
+}
+
+int UndoLog::NextSheet(
+    bool redo) const
+{
+    if (redo)
+    {
+        return _redo.empty() ? -1 : _redo.back().record.sheet;
+    }
+
+    return _undo.empty() ? -1 : _undo.back().record.sheet;
+}
+
+void UndoLog::Spill(
+    Entry &entry)
+{
+    if (entry.spilled || entry.deltas._segments.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        _db.execute("BEGIN;");
+
+        auto insert = _db.prepare("INSERT INTO undo_segments (record, seq, data) VALUES (?, ?, ?)");
+        for (size_t seq = 0; seq < entry.deltas._segments.size(); seq++)
+        {
+            insert.execute(entry.id, int(seq), entry.deltas._segments[seq]);
+            entry.spilledBytes += entry.deltas._segments[seq].size();
+        }
+
+        _db.execute("COMMIT;");
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("spilling undo record failed: {}", _db.errormsg());
+        entry.spilledBytes = 0;
+
+        try
+        {
+            _db.execute("ROLLBACK;");
+        }
+        catch (const std::exception &rollbackEx)
+        {
+            // BEGIN failed, no transaction was open
+        }
+
+        return;
+    }
+
+    _memoryUsage -= entry.deltas.MemoryUsage();
+    _spilledBytes += entry.spilledBytes;
+    entry.deltas._segments = std::vector<std::vector<char>>();
+    entry.spilled = true;
+}
+
+void UndoLog::Drop(
+    Entry &entry)
+{
+    if (entry.spilled)
+    {
+        try
+        {
+            _db.execute("DELETE FROM undo_segments WHERE record = ?", entry.id);
+        }
+        catch (const std::exception &ex)
+        {
+            spdlog::error("dropping undo record failed: {}", _db.errormsg());
+        }
+
+        _spilledBytes -= entry.spilledBytes;
+    }
+    else
+    {
+        _memoryUsage -= entry.deltas.MemoryUsage();
+    }
+}
+
+void UndoLog::EnforceBudget()
+{
+    // Oldest undo records first, the next redo record last
+    for (auto it = _undo.begin(); it != _undo.end() && _memoryUsage > _memoryBudget; ++it)
+    {
+        Spill(*it);
+    }
+
+    for (auto it = _redo.begin(); it != _redo.end() && _memoryUsage > _memoryBudget; ++it)
+    {
+        Spill(*it);
+    }
+}
+
+void UndoLog::Apply(
+    const Entry &entry,
+    bool after,
+    const CellDeltas::Callback &setCell)
+{
+    if (!entry.spilled)
+    {
+        for (auto const &segment : entry.deltas._segments)
+        {
+            CellDeltas::Decode(segment, after, setCell);
+        }
+
+        return;
+    }
+
+    // Only one segment of a spilled record is in memory at a time
+    for (size_t seq = 0; seq < entry.segmentCount; seq++)
+    {
+        std::vector<char> segment;
+
+        try
+        {
+            segment = _db.execute_value<std::vector<char>>("SELECT data FROM undo_segments WHERE record = ? AND seq = ?", entry.id, int(seq));
+        }
+        catch (const std::exception &ex)
+        {
+            spdlog::error("reading undo record failed: {}", _db.errormsg());
+            return;
+        }
+
+        CellDeltas::Decode(segment, after, setCell);
+    }
+}
+
+bool UndoLog::Undo(
+    UndoRecord &record,
+    const CellDeltas::Callback &setCell)
+{
+    if (_undo.empty())
+    {
+        return false;
+    }
+
+    auto entry = std::move(_undo.back());
+    _undo.pop_back();
+
+    Apply(entry, false, setCell);
+    record = entry.record;
+
+    _redo.push_back(std::move(entry));
+
+    return true;
+}
+
+bool UndoLog::Redo(
+    UndoRecord &record,
+    const CellDeltas::Callback &setCell)
+{
+    if (_redo.empty())
+    {
+        return false;
+    }
+
+    auto entry = std::move(_redo.back());
+    _redo.pop_back();
+
+    Apply(entry, true, setCell);
+    record = entry.record;
+
+    _undo.push_back(std::move(entry));
+
+    return true;
+}
+
+size_t UndoLog::MemoryUsage() const
+{
+    return _memoryUsage;
+}
+
+size_t UndoLog::SpilledBytes() const
+{
+    return _spilledBytes;
+}
@@ -0,0 +1,70 @@
+#include "viewsnapshot.h"
+
+#include <utility>
+
+void TileInvalidations::Merge(
+    const TileInvalidations &other)
+{
+    all = all || other.all;
+
+    if (all)
+    {
+        rects.clear();
+        return;
+    }
+
+    rects.insert(rects.end(), other.rects.begin(), other.rects.end());
+}
+
+SnapshotBuffer::SnapshotBuffer() = default;
+
+ViewSnapshot &SnapshotBuffer::Back()
+{
+    return _back;
+}
+
+void SnapshotBuffer::InvalidateAll()
+{
+    _backInvalidations.all = true;
+    _backInvalidations.rects.clear();
+}
+
+void SnapshotBuffer::InvalidateRect(
+    int64_t x0,
+    int64_t y0,
+    int64_t x1,
+    int64_t y1)
+{
+    if (!_backInvalidations.all)
+    {
+        _backInvalidations.rects.push_back(TileInvalidations::Rect{x0, y0, x1, y1});
+    }
+}
+
+void SnapshotBuffer::Publish()
+{
+    auto front = std::make_shared<const ViewSnapshot>(std::move(_back));
+    _back = ViewSnapshot();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // The old front snapshot is freed outside the lock, when the render
+        // thread no longer holds it
+        std::swap(_front, front);
+        _pendingInvalidations.Merge(_backInvalidations);
+    }
+
+    _backInvalidations = TileInvalidations();
+}
+
+std::shared_ptr<const ViewSnapshot> SnapshotBuffer::Acquire(
+    TileInvalidations &invalidations)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    invalidations = std::move(_pendingInvalidations);
+    _pendingInvalidations = TileInvalidations();
+
+    return _front;
+}
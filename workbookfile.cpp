@@ -0,0 +1,868 @@
+#include "workbookfile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <sheetexport.h>
+#include <spdlog/spdlog.h>
+#include <sqlitelib.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char Magic[4] = {'P', 'C', 'W', 'B'};
+
+enum ValueType : uint8_t
+{
+    StringValue = 0,
+    IntegerValue = 1,
+    RealValue = 2,
+};
+
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t reserved;
+};
+
+struct WorkbookFile::Footer
+{
+    uint64_t stringsOffset;
+    uint64_t stringCount;
+    uint64_t columnsOffset;
+    uint64_t columnCount;
+    uint64_t colsOffset;
+    uint64_t colsCount;
+    uint64_t rowsOffset;
+    uint64_t rowsCount;
+    uint64_t sheetsOffset;
+    uint64_t sheetsCount;
+    uint64_t cellCount;
+    uint32_t version;
+    char magic[4];
+};
+
+struct WorkbookFile::ColumnEntry
+{
+    int32_t sheet;
+    int32_t col;
+    uint32_t chunkCount;
+    uint32_t reserved;
+    uint64_t chunksOffset;
+};
+
+struct WorkbookFile::ChunkEntry
+{
+    int32_t firstRow;
+    uint32_t count;
+    uint64_t offset;
+};
+
+static uint64_t Align8(
+    uint64_t size)
+{
+    return (size + 7) & ~uint64_t(7);
+}
+
+// Row offsets, types and values of a chunk, each part 8 byte aligned
+static uint64_t ChunkBytes(
+    uint64_t count)
+{
+    return Align8(count * sizeof(uint16_t)) + Align8(count) + count * sizeof(uint64_t);
+}
+
+// Numbers are kept as numbers only when formatting them gives back the text
+static uint8_t EncodeValue(
+    const std::string &text,
+    uint64_t &value)
+{
+    if (text.empty() || text.size() > 32)
+    {
+        return StringValue;
+    }
+
+    auto first = text.data();
+    auto last = text.data() + text.size();
+    char formatted[64];
+
+    int64_t integer;
+    auto parsed = std::from_chars(first, last, integer);
+    if (parsed.ec == std::errc() && parsed.ptr == last)
+    {
+        auto written = std::to_chars(formatted, formatted + sizeof(formatted), integer);
+        if (size_t(written.ptr - formatted) == text.size() && memcmp(formatted, first, text.size()) == 0)
+        {
+            value = uint64_t(integer);
+            return IntegerValue;
+        }
+    }
+
+    double real;
+    parsed = std::from_chars(first, last, real);
+    if (parsed.ec == std::errc() && parsed.ptr == last)
+    {
+        auto written = std::to_chars(formatted, formatted + sizeof(formatted), real);
+        if (written.ec == std::errc() && size_t(written.ptr - formatted) == text.size() && memcmp(formatted, first, text.size()) == 0)
+        {
+            memcpy(&value, &real, sizeof(value));
+            return RealValue;
+        }
+    }
+
+    return StringValue;
+}
+
+WorkbookFile::WorkbookFile()
+    : _data(nullptr),
+      _size(0),
+      _footer(nullptr),
+      _columns(nullptr),
+      _stringOffsets(nullptr),
+      _cols(nullptr),
+      _rows(nullptr),
+      _sheets(nullptr),
+      _file(nullptr),
+      _mapping(nullptr)
+{}
+
+WorkbookFile::~WorkbookFile()
+{
+    Close();
+}
+
+bool WorkbookFile::InBounds(
+    uint64_t offset,
+    uint64_t size) const
+{
+    return offset <= _size && size <= _size - offset;
+}
+
+bool WorkbookFile::Open(
+    const std::string &path)
+{
+    Close();
+
+#ifdef _WIN32
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        spdlog::error("cannot open {}", path);
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        spdlog::error("{} is not a workbook file", path);
+        return false;
+    }
+
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    auto view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr)
+    {
+        if (mapping != nullptr)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        spdlog::error("mapping {} failed", path);
+        return false;
+    }
+
+    _file = file;
+    _mapping = mapping;
+    _data = static_cast<const uint8_t *>(view);
+    _size = size_t(fileSize.QuadPart);
+#else
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        spdlog::error("cannot open {}", path);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        spdlog::error("{} is not a workbook file", path);
+        return false;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    auto view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        spdlog::error("mapping {} failed", path);
+        return false;
+    }
+
+    _data = static_cast<const uint8_t *>(view);
+    _size = size_t(info.st_size);
+#endif
+
+    auto valid = [this]() {
+        if (_size < sizeof(FileHeader) + sizeof(Footer))
+        {
+            return false;
+        }
+
+        auto header = reinterpret_cast<const FileHeader *>(_data);
+        _footer = reinterpret_cast<const Footer *>(_data + _size - sizeof(Footer));
+        if (memcmp(header->magic, Magic, 4) != 0 || header->version != Version ||
+            memcmp(_footer->magic, Magic, 4) != 0 || _footer->version != Version)
+        {
+            return false;
+        }
+
+        auto const &footer = *_footer;
+        if (footer.stringCount >= _size / sizeof(uint64_t) || !InBounds(footer.stringsOffset, (footer.stringCount + 1) * sizeof(uint64_t)) ||
+            footer.columnCount > _size / sizeof(ColumnEntry) || !InBounds(footer.columnsOffset, footer.columnCount * sizeof(ColumnEntry)) ||
+            footer.colsCount > _size / sizeof(LayoutEntry) || !InBounds(footer.colsOffset, footer.colsCount * sizeof(LayoutEntry)) ||
+            footer.rowsCount > _size / sizeof(LayoutEntry) || !InBounds(footer.rowsOffset, footer.rowsCount * sizeof(LayoutEntry)) ||
+            footer.sheetsCount > _size / sizeof(SheetEntry) || !InBounds(footer.sheetsOffset, footer.sheetsCount * sizeof(SheetEntry)))
+        {
+            return false;
+        }
+
+        if ((footer.stringsOffset | footer.columnsOffset | footer.colsOffset | footer.rowsOffset | footer.sheetsOffset) % 8 != 0)
+        {
+            return false;
+        }
+
+        _stringOffsets = reinterpret_cast<const uint64_t *>(_data + footer.stringsOffset);
+        _columns = reinterpret_cast<const ColumnEntry *>(_data + footer.columnsOffset);
+        _cols = reinterpret_cast<const LayoutEntry *>(_data + footer.colsOffset);
+        _rows = reinterpret_cast<const LayoutEntry *>(_data + footer.rowsOffset);
+        _sheets = reinterpret_cast<const SheetEntry *>(_data + footer.sheetsOffset);
+
+        // The chunk directories are small, the chunks are checked when read
+        for (uint64_t i = 0; i < footer.columnCount; i++)
+        {
+            auto const &column = _columns[i];
+            if (column.chunksOffset % 8 != 0 || !InBounds(column.chunksOffset, uint64_t(column.chunkCount) * sizeof(ChunkEntry)))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    if (!valid())
+    {
+        spdlog::error("{} is not a workbook file or is damaged", path);
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void WorkbookFile::Close()
+{
+    if (_data == nullptr)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(static_cast<HANDLE>(_mapping));
+    CloseHandle(static_cast<HANDLE>(_file));
+#else
+    munmap(const_cast<uint8_t *>(_data), _size);
+#endif
+
+    _data = nullptr;
+    _size = 0;
+    _footer = nullptr;
+    _columns = nullptr;
+    _stringOffsets = nullptr;
+    _cols = nullptr;
+    _rows = nullptr;
+    _sheets = nullptr;
+    _file = nullptr;
+    _mapping = nullptr;
+}
+
+bool WorkbookFile::IsOpen() const
+{
+    return _data != nullptr;
+}
+
+uint64_t WorkbookFile::CellCount() const
+{
+    return _footer != nullptr ? _footer->cellCount : 0;
+}
+
+std::string WorkbookFile::String(
+    uint32_t index) const
+{
+    if (_footer == nullptr || index >= _footer->stringCount)
+    {
+        return std::string();
+    }
+
+    auto bytesOffset = _footer->stringsOffset + (_footer->stringCount + 1) * sizeof(uint64_t);
+    auto begin = _stringOffsets[index];
+    auto end = _stringOffsets[index + 1];
+    if (begin > end || !InBounds(bytesOffset + begin, end - begin))
+    {
+        return std::string();
+    }
+
+    return std::string(reinterpret_cast<const char *>(_data + bytesOffset + begin), size_t(end - begin));
+}
+
+void WorkbookFile::ForEachInColumn(
+    const ColumnEntry &column,
+    int fromRow,
+    int toRow,
+    const CellCallback &callback) const
+{
+    auto chunks = reinterpret_cast<const ChunkEntry *>(_data + column.chunksOffset);
+    auto chunksEnd = chunks + column.chunkCount;
+
+    // Chunks are in row order, start at the one that may hold fromRow
+    auto chunk = std::upper_bound(chunks, chunksEnd, fromRow, [](int row, const ChunkEntry &entry) { return row < entry.firstRow; });
+    if (chunk != chunks)
+    {
+        chunk--;
+    }
+
+    std::string value;
+    char formatted[64];
+
+    for (; chunk != chunksEnd && chunk->firstRow <= toRow; ++chunk)
+    {
+        if (chunk->count > uint32_t(ChunkRows) || chunk->offset % 8 != 0 || !InBounds(chunk->offset, ChunkBytes(chunk->count)))
+        {
+            spdlog::error("skipping a damaged chunk of column {}", column.col);
+            continue;
+        }
+
+        auto rowOffsets = reinterpret_cast<const uint16_t *>(_data + chunk->offset);
+        auto types = _data + chunk->offset + Align8(chunk->count * sizeof(uint16_t));
+        auto values = reinterpret_cast<const uint64_t *>(types + Align8(chunk->count));
+
+        auto begin = uint32_t(0);
+        if (fromRow > chunk->firstRow)
+        {
+            begin = uint32_t(std::lower_bound(rowOffsets, rowOffsets + chunk->count, uint32_t(fromRow - chunk->firstRow)) - rowOffsets);
+        }
+
+        for (auto i = begin; i < chunk->count; i++)
+        {
+            auto row = chunk->firstRow + int(rowOffsets[i]);
+            if (row > toRow)
+            {
+                break;
+            }
+
+            switch (types[i])
+            {
+                case IntegerValue:
+                {
+                    auto written = std::to_chars(formatted, formatted + sizeof(formatted), int64_t(values[i]));
+                    value.assign(formatted, written.ptr);
+                    break;
+                }
+                case RealValue:
+                {
+                    double real;
+                    memcpy(&real, &values[i], sizeof(real));
+                    auto written = std::to_chars(formatted, formatted + sizeof(formatted), real);
+                    value.assign(formatted, written.ptr);
+                    break;
+                }
+                default:
+                    value = String(uint32_t(values[i]));
+                    break;
+            }
+
+            callback(column.sheet, column.col, row, value);
+        }
+    }
+}
+
+void WorkbookFile::ForEach(
+    int sheet,
+    int fromCol,
+    int fromRow,
+    int toCol,
+    int toRow,
+    const CellCallback &callback) const
+{
+    if (_footer == nullptr)
+    {
+        return;
+    }
+
+    // Columns are in (sheet, col) order
+    auto columnsEnd = _columns + _footer->columnCount;
+    auto column = std::lower_bound(_columns, columnsEnd, std::make_pair(sheet, fromCol), [](const ColumnEntry &entry, const std::pair<int, int> &key) {
+        return std::make_pair(int(entry.sheet), int(entry.col)) < key;
+    });
+
+    for (; column != columnsEnd && column->sheet == sheet && column->col <= toCol; ++column)
+    {
+        ForEachInColumn(*column, fromRow, toRow, callback);
+    }
+}
+
+void WorkbookFile::ForEachCell(
+    const CellCallback &callback) const
+{
+    if (_footer == nullptr)
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; i < _footer->columnCount; i++)
+    {
+        ForEachInColumn(_columns[i], 0, std::numeric_limits<int>::max(), callback);
+    }
+}
+
+int WorkbookFile::LastRow(
+    int sheet) const
+{
+    if (_footer == nullptr)
+    {
+        return -1;
+    }
+
+    auto columnsEnd = _columns + _footer->columnCount;
+    auto column = std::lower_bound(_columns, columnsEnd, sheet, [](const ColumnEntry &entry, int key) { return entry.sheet < key; });
+
+    int lastRow = -1;
+    for (; column != columnsEnd && column->sheet == sheet; ++column)
+    {
+        if (column->chunkCount == 0)
+        {
+            continue;
+        }
+
+        auto const &chunk = reinterpret_cast<const ChunkEntry *>(_data + column->chunksOffset)[column->chunkCount - 1];
+        if (chunk.count == 0 || chunk.count > uint32_t(ChunkRows) || chunk.offset % 8 != 0 || !InBounds(chunk.offset, ChunkBytes(chunk.count)))
+        {
+            continue;
+        }
+
+        auto rowOffsets = reinterpret_cast<const uint16_t *>(_data + chunk.offset);
+        lastRow = std::max(lastRow, chunk.firstRow + int(rowOffsets[chunk.count - 1]));
+    }
+
+    return lastRow;
+}
+
+size_t WorkbookFile::ColCount() const
+{
+    return _footer != nullptr ? size_t(_footer->colsCount) : 0;
+}
+
+const WorkbookFile::LayoutEntry &WorkbookFile::Col(
+    size_t i) const
+{
+    return _cols[i];
+}
+
+size_t WorkbookFile::RowCount() const
+{
+    return _footer != nullptr ? size_t(_footer->rowsCount) : 0;
+}
+
+const WorkbookFile::LayoutEntry &WorkbookFile::Row(
+    size_t i) const
+{
+    return _rows[i];
+}
+
+size_t WorkbookFile::SheetCount() const
+{
+    return _footer != nullptr ? size_t(_footer->sheetsCount) : 0;
+}
+
+const WorkbookFile::SheetEntry &WorkbookFile::Sheet(
+    size_t i) const
+{
+    return _sheets[i];
+}
+
+bool WorkbookFile::LoadLayoutInto(
+    sqlitelib::Sqlite &db) const
+{
+    if (_footer == nullptr)
+    {
+        return false;
+    }
+
+    try
+    {
+        db.execute("BEGIN;");
+
+        db.execute("DELETE FROM cells;");
+        db.execute("DELETE FROM cols;");
+        db.execute("DELETE FROM rows;");
+        db.execute("DELETE FROM sheets;");
+
+        auto insertCol = db.prepare("INSERT INTO cols (sheet, col_index, size) VALUES (?, ?, ?)");
+        auto insertColHeader = db.prepare("INSERT INTO cols (sheet, col_index, size, header) VALUES (?, ?, ?, ?)");
+        for (size_t i = 0; i < ColCount(); i++)
+        {
+            auto const &col = Col(i);
+            if (col.header == NoString)
+            {
+                insertCol.execute(int(col.sheet), int(col.index), int(col.size));
+            }
+            else
+            {
+                insertColHeader.execute(int(col.sheet), int(col.index), int(col.size), String(col.header));
+            }
+        }
+
+        auto insertRow = db.prepare("INSERT INTO rows (sheet, row_index, size) VALUES (?, ?, ?)");
+        for (size_t i = 0; i < RowCount(); i++)
+        {
+            insertRow.execute(int(Row(i).sheet), int(Row(i).index), int(Row(i).size));
+        }
+
+        auto insertSheet = db.prepare("INSERT INTO sheets (id, title) VALUES (?, ?)");
+        for (size_t i = 0; i < SheetCount(); i++)
+        {
+            insertSheet.execute(int(Sheet(i).id), String(Sheet(i).title));
+        }
+
+        // Files written before there were sheets only have cells, their
+        // sheets are named from the column directory like the cells table
+        // would name them
+        auto insertCellSheet = db.prepare("INSERT OR IGNORE INTO sheets (id, title) VALUES (?, 'Sheet' || (? + 1))");
+        for (uint64_t i = 0; i < _footer->columnCount; i++)
+        {
+            if (i == 0 || _columns[i].sheet != _columns[i - 1].sheet)
+            {
+                insertCellSheet.execute(int(_columns[i].sheet), int(_columns[i].sheet));
+            }
+        }
+
+        db.execute("COMMIT;");
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("loading the workbook file failed: {}", db.errormsg());
+
+        try
+        {
+            db.execute("ROLLBACK;");
+        }
+        catch (const std::exception &rollbackEx)
+        {
+            // BEGIN failed, no transaction was open
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+bool WorkbookFile::LoadCellsInto(
+    sqlitelib::Sqlite &db,
+    const std::function<void(uint64_t cells)> &progress) const
+{
+    if (_footer == nullptr)
+    {
+        return false;
+    }
+
+    try
+    {
+        db.execute("BEGIN;");
+
+        // function holds the same text as tmp_value until formulas exist
+        uint64_t inserted = 0;
+        auto insertCell = db.prepare("INSERT INTO cells (col, row, function, tmp_value, sheet) VALUES (?, ?, ?, ?, ?)");
+        ForEachCell([&](int sheet, int col, int row, const std::string &value) {
+            insertCell.execute(col, row, value, value, sheet);
+            if (++inserted % ChunkRows == 0 && progress)
+            {
+                progress(inserted);
+            }
+        });
+
+        db.execute("COMMIT;");
+    }
+    catch (const std::exception &ex)
+    {
+        spdlog::error("loading the cells of the workbook file failed: {}", db.errormsg());
+
+        try
+        {
+            db.execute("ROLLBACK;");
+        }
+        catch (const std::exception &rollbackEx)
+        {
+            // BEGIN failed, no transaction was open
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+bool WorkbookFile::Save(
+    sqlitelib::Sqlite &db,
+    const std::string &path,
+    ExportStats &stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    stats = ExportStats();
+
+    auto partName = path + ".part";
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(partName.c_str(), "wb"), fclose);
+    if (file == nullptr)
+    {
+        spdlog::error("cannot open {} for writing", partName);
+        return false;
+    }
+
+    setvbuf(file.get(), nullptr, _IOFBF, 1024 * 1024);
+
+    uint64_t offset = 0;
+    bool ok = true;
+
+    auto write = [&](const void *data, size_t size) {
+        if (ok && size > 0 && fwrite(data, 1, size, file.get()) != size)
+        {
+            ok = false;
+        }
+        offset += size;
+    };
+
+    auto pad = [&]() {
+        static const char zeros[8] = {};
+        write(zeros, size_t(Align8(offset) - offset));
+    };
+
+    // Keys of an unordered_map stay where they are, so the strings can be
+    // listed by pointer in the order of their index
+    std::unordered_map<std::string, uint32_t> dictionary;
+    std::vector<const std::string *> strings;
+
+    auto intern = [&](const std::string &text) {
+        auto found = dictionary.emplace(text, uint32_t(strings.size()));
+        if (found.second)
+        {
+            strings.push_back(&found.first->first);
+        }
+
+        return found.first->second;
+    };
+
+    struct PendingColumn
+    {
+        ColumnEntry entry;
+        std::vector<ChunkEntry> chunks;
+    };
+
+    std::vector<PendingColumn> columns;
+    std::vector<LayoutEntry> cols;
+    std::vector<LayoutEntry> rows;
+    std::vector<SheetEntry> sheets;
+
+    try
+    {
+        FileHeader header = {{Magic[0], Magic[1], Magic[2], Magic[3]}, Version, 0};
+        write(&header, sizeof(header));
+
+        std::vector<uint16_t> rowOffsets;
+        std::vector<uint8_t> types;
+        std::vector<uint64_t> values;
+        int chunkFirstRow = 0;
+
+        auto flushChunk = [&]() {
+            if (rowOffsets.empty())
+            {
+                return;
+            }
+
+            columns.back().chunks.push_back(ChunkEntry{chunkFirstRow, uint32_t(rowOffsets.size()), offset});
+
+            write(rowOffsets.data(), rowOffsets.size() * sizeof(uint16_t));
+            pad();
+            write(types.data(), types.size());
+            pad();
+            write(values.data(), values.size() * sizeof(uint64_t));
+
+            rowOffsets.clear();
+            types.clear();
+            values.clear();
+        };
+
+        auto cursor = db.prepare<int, int, int, std::string>("SELECT sheet, col, row, tmp_value FROM cells ORDER BY sheet, col, row").execute_cursor();
+        for (auto const &cell : cursor)
+        {
+            auto sheet = std::get<0>(cell);
+            auto col = std::get<1>(cell);
+            auto row = std::get<2>(cell);
+            auto const &text = std::get<3>(cell);
+
+            if (row < 0 || col < 0)
+            {
+                continue;
+            }
+
+            if (columns.empty() || columns.back().entry.sheet != sheet || columns.back().entry.col != col)
+            {
+                flushChunk();
+                columns.push_back(PendingColumn{ColumnEntry{sheet, col, 0, 0, 0}, {}});
+            }
+
+            auto firstRow = row - row % ChunkRows;
+            if (firstRow != chunkFirstRow)
+            {
+                flushChunk();
+                chunkFirstRow = firstRow;
+            }
+
+            uint64_t value = 0;
+            auto type = EncodeValue(text, value);
+            if (type == StringValue)
+            {
+                value = intern(text);
+            }
+
+            rowOffsets.push_back(uint16_t(row - firstRow));
+            types.push_back(type);
+            values.push_back(value);
+
+            stats.cells++;
+            stats.rows = std::max<int64_t>(stats.rows, row + 1);
+        }
+        flushChunk();
+        pad();
+
+        for (auto const &col : db.execute<int, int, std::string, int>("SELECT col_index, COALESCE(size, 0), COALESCE(header, ''), sheet FROM cols ORDER BY sheet, col_index"))
+        {
+            auto const &text = std::get<2>(col);
+            cols.push_back(LayoutEntry{std::get<0>(col), std::get<1>(col), text.empty() ? NoString : intern(text), std::get<3>(col)});
+        }
+
+        for (auto const &row : db.execute<int, int, int>("SELECT row_index, COALESCE(size, 0), sheet FROM rows ORDER BY sheet, row_index"))
+        {
+            rows.push_back(LayoutEntry{std::get<0>(row), std::get<1>(row), NoString, std::get<2>(row)});
+        }
+
+        for (auto const &sheet : db.execute<int, std::string>("SELECT id, COALESCE(title, '') FROM sheets ORDER BY id"))
+        {
+            sheets.push_back(SheetEntry{std::get<0>(sheet), intern(std::get<1>(sheet))});
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        // Interrupted or failed reading, no partial file stays behind
+        file.reset();
+        std::error_code error;
+        std::filesystem::remove(partName, error);
+        throw;
+    }
+
+    Footer footer = {};
+
+    footer.stringsOffset = offset;
+    footer.stringCount = strings.size();
+    uint64_t stringOffset = 0;
+    for (auto string : strings)
+    {
+        write(&stringOffset, sizeof(stringOffset));
+        stringOffset += string->size();
+    }
+    write(&stringOffset, sizeof(stringOffset));
+    for (auto string : strings)
+    {
+        write(string->data(), string->size());
+    }
+    pad();
+
+    for (auto &column : columns)
+    {
+        column.entry.chunkCount = uint32_t(column.chunks.size());
+        column.entry.chunksOffset = offset;
+        write(column.chunks.data(), column.chunks.size() * sizeof(ChunkEntry));
+    }
+
+    footer.columnsOffset = offset;
+    footer.columnCount = columns.size();
+    for (auto const &column : columns)
+    {
+        write(&column.entry, sizeof(ColumnEntry));
+    }
+
+    footer.colsOffset = offset;
+    footer.colsCount = cols.size();
+    write(cols.data(), cols.size() * sizeof(LayoutEntry));
+
+    footer.rowsOffset = offset;
+    footer.rowsCount = rows.size();
+    write(rows.data(), rows.size() * sizeof(LayoutEntry));
+
+    footer.sheetsOffset = offset;
+    footer.sheetsCount = sheets.size();
+    write(sheets.data(), sheets.size() * sizeof(SheetEntry));
+
+    footer.cellCount = uint64_t(stats.cells);
+    footer.version = Version;
+    memcpy(footer.magic, Magic, sizeof(Magic));
+    write(&footer, sizeof(footer));
+
+    stats.bytes = offset;
+
+    if (fflush(file.get()) != 0)
+    {
+        ok = false;
+    }
+    file.reset();
+
+    std::error_code error;
+    if (ok)
+    {
+        std::filesystem::rename(partName, path, error);
+        if (error)
+        {
+            spdlog::error("replacing {} failed: {}", path, error.message());
+            ok = false;
+        }
+    }
+    else
+    {
+        spdlog::error("writing {} failed", partName);
+    }
+
+    if (!ok)
+    {
+        std::filesystem::remove(partName, error);
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return ok;
+}